@@ -0,0 +1,81 @@
+// Compares FlatHashMap with std::unordered_map on the workload the
+// interpreter gives it: a small table of short identifier keys, looked up
+// far more often than it changes.
+//
+//   make bench && ./bench/hash_map
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common/flat_hash_map.h"
+
+namespace {
+
+constexpr int ROUNDS = 1'000'000;
+
+const std::vector<std::string> NAMES = {
+    "x", "y", "name", "count", "total", "init", "value", "next", "left", "right",
+    "width", "height", "push", "length", "index", "result", "fib", "helper",
+    "accumulator", "currentNode", "isInitialized", "print", "clock", "list",
+};
+
+// Keeps results alive so the loops aren't optimized away.
+volatile double sink;
+
+// Runs body once per name, ROUNDS times, and returns nanoseconds per call.
+template <typename F>
+double timeNs(F body) {
+    auto start = std::chrono::steady_clock::now();
+    double total = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < NAMES.size(); i++) total += body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    sink = total;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (double(ROUNDS) * NAMES.size());
+}
+
+void report(const char* what, double stdNs, double flatNs) {
+    std::printf("%-24s %9.2f ns %9.2f ns %7.2fx\n", what, stdNs, flatNs, stdNs / flatNs);
+}
+
+}  // namespace
+
+int main() {
+    std::unordered_map<std::string, double> stdMap;
+    FlatHashMap<std::string, double> flatMap;
+    std::vector<size_t> hashes;
+    for (size_t i = 0; i < NAMES.size(); i++) {
+        stdMap[NAMES[i]] = static_cast<double>(i);
+        flatMap[NAMES[i]] = static_cast<double>(i);
+        hashes.push_back(FlatHashMap<std::string, double>::hashOf(NAMES[i]));
+    }
+
+    // Misses are what a global lookup does in every scope it walks through.
+    std::vector<std::string> misses;
+    for (const std::string& name : NAMES) misses.push_back(name + "_");
+
+    std::printf("%-24s %12s %12s %8s\n", "", "unordered", "flat", "speedup");
+
+    double stdHit = timeNs([&](size_t i) { return stdMap.find(NAMES[i])->second; });
+    report("hit", stdHit, timeNs([&](size_t i) { return *flatMap.find(NAMES[i]); }));
+    report("hit, hash precomputed", stdHit,
+           timeNs([&](size_t i) { return *flatMap.find(NAMES[i], hashes[i]); }));
+
+    report("miss",
+           timeNs([&](size_t i) { return double(stdMap.count(misses[i])); }),
+           timeNs([&](size_t i) { return double(flatMap.contains(misses[i])); }));
+
+    report("erase + insert",
+           timeNs([&](size_t i) {
+               stdMap.erase(NAMES[i]);
+               return stdMap[NAMES[i]] = double(i);
+           }),
+           timeNs([&](size_t i) {
+               flatMap.erase(NAMES[i]);
+               return flatMap[NAMES[i]] = double(i);
+           }));
+    return 0;
+}
@@ -0,0 +1,53 @@
+// Embedding example: compile a rule script once, then call into it
+// repeatedly from C++ without re-parsing.
+//
+//     make examples/embed && ./examples/embed
+#include <iostream>
+#include "lox.h"
+
+static const char* rules = R"(
+fun score(amount, country) {
+  var risk = amount / 100;
+  if (country == "XX") risk = risk * 10;
+  if (risk > limit()) return "review";
+  return "accept";
+}
+
+fun checked(x) {
+  if (x < 0) fail("negative input");
+  return x;
+}
+)";
+
+int main() {
+    Lox lox;
+    
+    // Natives can carry state; this one counts how often Lox asks for it.
+    int limitCalls = 0;
+    lox.defineNative("limit", 0, [&limitCalls](int, Value*) {
+        limitCalls++;
+        return Value(50.0);
+    });
+    lox.defineNative("fail", 1, [](int, Value* args) -> Value {
+        throw LoxError(args[0].toString());
+    });
+    
+    std::shared_ptr<Script> script = lox.compile(rules);
+    if (!script || !lox.run(*script)) return 65;
+    
+    Value score = lox.getGlobal("score");
+    const double amounts[] = {100, 2500, 9000};
+    for (double amount : amounts) {
+        std::cout << amount << " from XX: " << lox.call(score, amount, "XX").toString() << std::endl;
+        std::cout << amount << " from NL: " << lox.call(score, amount, "NL").toString() << std::endl;
+    }
+    std::cout << "limit() called " << limitCalls << " times" << std::endl;
+    
+    try {
+        lox.call(lox.getGlobal("checked"), -1.0);
+    } catch (const RuntimeError& error) {
+        std::cout << "runtime error: " << error.what() << std::endl;
+    }
+    
+    return 0;
+}
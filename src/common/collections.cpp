@@ -0,0 +1,125 @@
+#include "collections.h"
+#include "error.h"
+#include <cmath>
+
+size_t LoxList::checkIndex(const Value& index, size_t limit) {
+    if (!index.isNumber()) throw LoxError("Index must be a number.");
+    double number = index.asNumber();
+    if (number != std::floor(number)) throw LoxError("Index must be a whole number.");
+    if (number < 0 || number >= static_cast<double>(limit)) throw LoxError("Index out of range.");
+    return static_cast<size_t>(number);
+}
+
+std::string LoxList::toString() const {
+    if (printing) return "[...]";
+    printing = true;
+    
+    std::string text = "[";
+    for (size_t i = 0; i < elements.size(); i++) {
+        if (i > 0) text += ", ";
+        text += elements[i].toString();
+    }
+    text += "]";
+    
+    printing = false;
+    return text;
+}
+
+int64_t LoxMap::find(const Value& key, size_t hash) const {
+    if (index.empty()) return -1;
+    
+    size_t mask = index.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        int32_t entry = index[slot];
+        if (entry == EMPTY) return -1;
+        if (entry != REMOVED && entries[entry].hash == hash && entries[entry].key.isEqual(key)) {
+            return static_cast<int64_t>(slot);
+        }
+    }
+}
+
+const Value* LoxMap::get(const Value& key) const {
+    int64_t slot = find(key, key.hash());
+    if (slot < 0) return nullptr;
+    return &entries[index[slot]].value;
+}
+
+void LoxMap::set(const Value& key, const Value& value) {
+    writeBarrier(key);
+    writeBarrier(value);
+    size_t hash = key.hash();
+    int64_t slot = find(key, hash);
+    if (slot >= 0) {
+        entries[index[slot]].value = value;
+        return;
+    }
+    
+    // Keep the table at most three quarters full, counting removed slots.
+    if ((entries.size() + 1) * 4 > index.size() * 3) {
+        size_t capacity = 8;
+        while (capacity * 3 < (count + 1) * 4 * 2) capacity *= 2;
+        rebuild(capacity);
+    }
+    
+    size_t mask = index.size() - 1;
+    size_t free = hash & mask;
+    while (index[free] >= 0) free = (free + 1) & mask;
+    index[free] = static_cast<int32_t>(entries.size());
+    entries.push_back(Entry{key, value, hash, false});
+    count++;
+}
+
+bool LoxMap::remove(const Value& key) {
+    int64_t slot = find(key, key.hash());
+    if (slot < 0) return false;
+    
+    Entry& entry = entries[index[slot]];
+    entry.key = Value();
+    entry.value = Value();
+    entry.removed = true;
+    index[slot] = REMOVED;
+    count--;
+    return true;
+}
+
+void LoxMap::clear() {
+    entries.clear();
+    index.clear();
+    count = 0;
+}
+
+// Drops removed entries and rehashes into a table of `capacity` slots.
+void LoxMap::rebuild(size_t capacity) {
+    std::vector<Entry> live;
+    live.reserve(count + 1);
+    for (Entry& entry : entries) {
+        if (!entry.removed) live.push_back(std::move(entry));
+    }
+    entries = std::move(live);
+    
+    index.assign(capacity, EMPTY);
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < entries.size(); i++) {
+        size_t slot = entries[i].hash & mask;
+        while (index[slot] != EMPTY) slot = (slot + 1) & mask;
+        index[slot] = static_cast<int32_t>(i);
+    }
+}
+
+std::string LoxMap::toString() const {
+    if (printing) return "{...}";
+    printing = true;
+    
+    std::string text = "{";
+    bool first = true;
+    for (const Entry& entry : entries) {
+        if (entry.removed) continue;
+        if (!first) text += ", ";
+        first = false;
+        text += entry.key.toString() + ": " + entry.value.toString();
+    }
+    text += "}";
+    
+    printing = false;
+    return text;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "value.h"
+
+// Growable array of values, stored contiguously. Indexing and appending are
+// O(1), the latter amortized.
+class LoxList : public LoxObject {
+private:
+    mutable bool printing = false;  // cuts off lists that contain themselves
+
+public:
+    std::vector<Value> elements;
+    
+    LoxList() : LoxObject(ObjType::LIST) {}
+    explicit LoxList(std::vector<Value> elements) : LoxObject(ObjType::LIST), elements(std::move(elements)) {}
+    
+    std::string toString() const override;
+    
+    // Checks that `index` is a whole number below `limit` and returns it.
+    // Throws LoxError otherwise.
+    static size_t checkIndex(const Value& index, size_t limit);
+};
+
+// Hash map keyed on any value, which iterates in insertion order. Entries
+// live in one dense array; an open-addressing table of 32-bit entry numbers,
+// probed linearly, finds them. A lookup touches two flat arrays instead of
+// chasing bucket nodes, and iterating is a linear scan.
+class LoxMap : public LoxObject {
+public:
+    struct Entry {
+        Value key;
+        Value value;
+        size_t hash;
+        bool removed;
+    };
+
+private:
+    static constexpr int32_t EMPTY = -1;
+    static constexpr int32_t REMOVED = -2;
+    
+    std::vector<Entry> entries;  // may contain removed entries until the next rebuild
+    std::vector<int32_t> index;  // power-of-two size
+    size_t count = 0;
+    mutable bool printing = false;
+    
+    // Slot in `index` holding the key, or -1.
+    int64_t find(const Value& key, size_t hash) const;
+    void rebuild(size_t capacity);
+
+public:
+    LoxMap() : LoxObject(ObjType::MAP) {}
+    
+    // Null if the key is absent.
+    const Value* get(const Value& key) const;
+    void set(const Value& key, const Value& value);
+    bool remove(const Value& key);
+    void clear();
+    size_t size() const { return count; }
+    
+    // Skip entries marked removed when iterating.
+    const std::vector<Entry>& getEntries() const { return entries; }
+    
+    std::string toString() const override;
+};
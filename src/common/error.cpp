@@ -1,8 +1,4 @@
 #include "error.h"
-#include <iostream>
-
-bool ErrorReporter::hadError = false;
-bool ErrorReporter::hadRuntimeError = false;
 
 void ErrorReporter::error(int line, const std::string& message) {
     report(line, "", message);
@@ -17,12 +13,25 @@ void ErrorReporter::error(const Token& token, const std::string& message) {
 }
 
 void ErrorReporter::runtimeError(const RuntimeError& error) {
-    std::cerr << error.what() << std::endl;
-    std::cerr << "[line " << error.token.line << "]" << std::endl;
+    std::lock_guard<std::mutex> lock(mutex);
+    *err << error.what() << std::endl;
+    *err << "[line " << error.token.line << "]" << std::endl;
     hadRuntimeError = true;
 }
 
 void ErrorReporter::report(int line, const std::string& where, const std::string& message) {
-    std::cerr << "[line " << line << "] Error" << where << ": " << message << std::endl;
+    std::lock_guard<std::mutex> lock(mutex);
+    *err << "[line " << line << "] Error" << where << ": " << message << std::endl;
+    hadError = true;
+}
+
+void ErrorReporter::forward(const std::string& messages) {
+    std::lock_guard<std::mutex> lock(mutex);
+    *err << messages << std::flush;
     hadError = true;
+}
+
+void ErrorReporter::reset() {
+    hadError = false;
+    hadRuntimeError = false;
 }
\ No newline at end of file
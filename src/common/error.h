@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include "token.h"
@@ -28,15 +31,25 @@ public:
         : LoxError(message), token(token) {}
 };
 
-// ReturnException moved to interpreter.h to avoid circular dependency
-
+// Error state belongs to one interpreter instance. Reporting is thread-safe
+// because modules are parsed on worker threads.
 class ErrorReporter {
+private:
+    std::ostream* err;
+    std::mutex mutex;
+
 public:
-    static bool hadError;
-    static bool hadRuntimeError;
+    std::atomic<bool> hadError{false};
+    std::atomic<bool> hadRuntimeError{false};
+    
+    explicit ErrorReporter(std::ostream& err = std::cerr) : err(&err) {}
+    
+    void error(int line, const std::string& message);
+    void error(const Token& token, const std::string& message);
+    void runtimeError(const RuntimeError& error);
+    void report(int line, const std::string& where, const std::string& message);
     
-    static void error(int line, const std::string& message);
-    static void error(const Token& token, const std::string& message);
-    static void runtimeError(const RuntimeError& error);
-    static void report(int line, const std::string& where, const std::string& message);
+    // Copies errors collected by another reporter into this one.
+    void forward(const std::string& messages);
+    void reset();
 };
\ No newline at end of file
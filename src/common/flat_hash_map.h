@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Hashes handed to FlatHashMap always have their top bit set, so that a zero
+// hash can mark an empty slot. Tables index with the low bits, which the
+// finalizer below makes depend on every input byte.
+constexpr size_t HASH_OCCUPIED = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+inline size_t hashMix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x) | HASH_OCCUPIED;
+}
+
+// Consumes eight bytes per multiply, which for the short names that make up
+// most keys means one or two rounds.
+inline size_t hashBytes(const char* data, size_t length) {
+    uint64_t hash = length * 0x9e3779b97f4a7c15ULL;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+        hash ^= hash >> 29;
+    }
+    if (length > 0) {
+        uint64_t word = 0;
+        for (size_t i = 0; i < length; i++) {
+            word |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (i * 8);
+        }
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+    }
+    return hashMix(hash);
+}
+
+inline size_t hashString(const std::string& text) {
+    return hashBytes(text.data(), text.size());
+}
+
+template <typename K, typename Enable = void>
+struct FlatHash;
+
+template <>
+struct FlatHash<std::string> {
+    size_t operator()(const std::string& key) const { return hashString(key); }
+};
+
+template <typename K>
+struct FlatHash<K, std::enable_if_t<std::is_integral_v<K> || std::is_enum_v<K>>> {
+    size_t operator()(K key) const { return hashMix(static_cast<uint64_t>(key)); }
+};
+
+// Open-addressing hash map with linear probing, for the runtime's name
+// lookups. Keys, values and each key's hash sit inline in one array, so a
+// probe reads consecutive memory, mismatches are rejected by comparing
+// hashes before keys, and growing never rehashes a key. Callers that already
+// know a key's hash (tokens carry the hash of their lexeme) can pass it in
+// and skip hashing altogether. Removal shifts later entries back instead of
+// leaving tombstones.
+//
+// Keys and values must be default constructible; pointers to values stay
+// valid only until the next insertion.
+template <typename K, typename V, typename Hash = FlatHash<K>>
+class FlatHashMap {
+public:
+    struct Slot {
+        size_t hash = 0;  // 0 when empty
+        K key{};
+        V value{};
+    };
+
+    template <typename SlotType>
+    class Iterator {
+    private:
+        SlotType* slot;
+        SlotType* end;
+
+        void skipEmpty() {
+            while (slot != end && slot->hash == 0) slot++;
+        }
+
+    public:
+        Iterator(SlotType* slot, SlotType* end) : slot(slot), end(end) { skipEmpty(); }
+
+        SlotType& operator*() const { return *slot; }
+        SlotType* operator->() const { return slot; }
+        Iterator& operator++() {
+            slot++;
+            skipEmpty();
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const { return slot != other.slot; }
+        bool operator==(const Iterator& other) const { return slot == other.slot; }
+    };
+
+    using iterator = Iterator<Slot>;
+    using const_iterator = Iterator<const Slot>;
+
+private:
+    std::vector<Slot> slots;  // power-of-two size, or empty
+    size_t count = 0;
+
+    size_t findSlot(const K& key, size_t hash) const {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& slot = slots[i];
+            if (slot.hash == 0) return SIZE_MAX;
+            if (slot.hash == hash && slot.key == key) return i;
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> old = std::move(slots);
+        slots = std::vector<Slot>(old.empty() ? 8 : old.size() * 2);
+        size_t mask = slots.size() - 1;
+        for (Slot& slot : old) {
+            if (slot.hash == 0) continue;
+            size_t i = slot.hash & mask;
+            while (slots[i].hash != 0) i = (i + 1) & mask;
+            slots[i] = std::move(slot);
+        }
+    }
+
+public:
+    FlatHashMap() = default;
+    FlatHashMap(std::initializer_list<std::pair<K, V>> entries) {
+        for (const auto& entry : entries) (*this)[entry.first] = entry.second;
+    }
+
+    static size_t hashOf(const K& key) { return Hash()(key) | HASH_OCCUPIED; }
+
+    V* find(const K& key, size_t hash) {
+        if (count == 0) return nullptr;
+        size_t i = findSlot(key, hash);
+        return i == SIZE_MAX ? nullptr : &slots[i].value;
+    }
+    const V* find(const K& key, size_t hash) const {
+        return const_cast<FlatHashMap*>(this)->find(key, hash);
+    }
+    V* find(const K& key) { return find(key, hashOf(key)); }
+    const V* find(const K& key) const { return find(key, hashOf(key)); }
+    bool contains(const K& key) const { return find(key) != nullptr; }
+
+    // For callers that cache where a key was found: the index of its slot,
+    // or SIZE_MAX. Entries move when the table grows or an earlier key is
+    // erased, so findAt() checks the slot still holds the key.
+    size_t slotOf(const K& key, size_t hash) const { return count == 0 ? SIZE_MAX : findSlot(key, hash); }
+    const V* findAt(size_t index, const K& key, size_t hash) const {
+        if (index >= slots.size()) return nullptr;
+        const Slot& slot = slots[index];
+        return slot.hash == hash && slot.key == key ? &slot.value : nullptr;
+    }
+
+    // Returns the key's value, inserting a default one if it is missing.
+    V& insert(const K& key, size_t hash) {
+        if (count != 0) {
+            size_t i = findSlot(key, hash);
+            if (i != SIZE_MAX) return slots[i].value;
+        }
+
+        // At most three quarters full keeps probe sequences short.
+        if ((count + 1) * 4 > slots.size() * 3) grow();
+
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while (slots[i].hash != 0) i = (i + 1) & mask;
+        slots[i].hash = hash;
+        slots[i].key = key;
+        count++;
+        return slots[i].value;
+    }
+    V& operator[](const K& key) { return insert(key, hashOf(key)); }
+
+    bool erase(const K& key) {
+        if (count == 0) return false;
+        size_t i = findSlot(key, hashOf(key));
+        if (i == SIZE_MAX) return false;
+
+        // Pull back every later entry of the cluster that may live at i.
+        size_t mask = slots.size() - 1;
+        for (size_t j = (i + 1) & mask; slots[j].hash != 0; j = (j + 1) & mask) {
+            size_t home = slots[j].hash & mask;
+            bool staysPut = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+            if (staysPut) continue;
+            slots[i] = std::move(slots[j]);
+            i = j;
+        }
+        slots[i] = Slot();
+        count--;
+        return true;
+    }
+
+    void clear() {
+        slots.clear();
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    iterator begin() { return iterator(slots.data(), slots.data() + slots.size()); }
+    iterator end() { return iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+    const_iterator begin() const { return const_iterator(slots.data(), slots.data() + slots.size()); }
+    const_iterator end() const {
+        return const_iterator(slots.data() + slots.size(), slots.data() + slots.size());
+    }
+};
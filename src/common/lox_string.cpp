@@ -0,0 +1,77 @@
+#include "lox_string.h"
+#include "flat_hash_map.h"
+#include "../gc/allocator.h"
+#include <vector>
+
+LoxString::LoxString(std::string text) : text(std::move(text)), length_(this->text.size()) {}
+
+LoxString::LoxString(std::shared_ptr<LoxString> left, std::shared_ptr<LoxString> right)
+    : left(std::move(left)), right(std::move(right)) {
+    length_ = this->left->length() + this->right->length();
+}
+
+// Ropes built in a loop are as deep as the loop is long, so children are
+// released iteratively instead of by a chain of recursive destructors.
+LoxString::~LoxString() {
+    std::vector<std::shared_ptr<LoxString>> pending;
+    if (left != nullptr) pending.push_back(std::move(left));
+    if (right != nullptr) pending.push_back(std::move(right));
+
+    while (!pending.empty()) {
+        std::shared_ptr<LoxString> node = std::move(pending.back());
+        pending.pop_back();
+        if (node.use_count() != 1) continue;
+        if (node->left != nullptr) pending.push_back(std::move(node->left));
+        if (node->right != nullptr) pending.push_back(std::move(node->right));
+    }
+}
+
+std::shared_ptr<LoxString> LoxString::concat(const std::shared_ptr<LoxString>& left,
+                                             const std::shared_ptr<LoxString>& right) {
+    if (left->length() == 0) return right;
+    if (right->length() == 0) return left;
+
+    if (left->length() + right->length() < ROPE_MIN) {
+        std::string text;
+        text.reserve(left->length() + right->length());
+        text += left->str();
+        text += right->str();
+        return makePooled<LoxString>(std::move(text));
+    }
+    return makePooled<LoxString>(left, right);
+}
+
+size_t LoxString::hash() const {
+    size_t hash = hash_.load(std::memory_order_relaxed);
+    if (hash == 0) {
+        const std::string& text = str();
+        hash = hashBytes(text.data(), text.size());  // never 0
+        hash_.store(hash, std::memory_order_relaxed);
+    }
+    return hash;
+}
+
+void LoxString::flatten() const {
+    std::string result;
+    result.reserve(length_);
+
+    // Walk the leaves left to right with an explicit stack; nodes that were
+    // already flattened count as leaves.
+    std::vector<const LoxString*> stack;
+    stack.push_back(this);
+    while (!stack.empty()) {
+        const LoxString* node = stack.back();
+        stack.pop_back();
+        if (node->left == nullptr) {
+            result += node->text;
+        } else {
+            stack.push_back(node->right.get());
+            stack.push_back(node->left.get());
+        }
+    }
+
+    text = std::move(result);
+    // Dropping the children can free a deep rope; ~LoxString handles that.
+    std::shared_ptr<LoxString> oldLeft = std::move(left);
+    std::shared_ptr<LoxString> oldRight = std::move(right);
+}
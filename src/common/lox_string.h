@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+// Immutable string payload shared by every Value that holds it, so copying a
+// string value never copies its text. Concatenating two long strings makes a
+// rope node in constant time; the text is only assembled the first time
+// something reads it (printing, comparing, hashing), and is then cached in
+// the node. A loop of `s = s + x` therefore costs linear, not quadratic, time.
+//
+// Flattening writes to the node, so a rope built by one interpreter must not
+// be read by another concurrently. Flat strings, such as AST literals, are
+// only written through the atomic hash cache and may be shared freely.
+class LoxString {
+private:
+    mutable std::string text;
+    mutable std::shared_ptr<LoxString> left;
+    mutable std::shared_ptr<LoxString> right;
+    size_t length_;
+    mutable std::atomic<size_t> hash_{0};  // 0 until computed
+
+    void flatten() const;
+
+public:
+    // Concatenations shorter than this are copied flat straight away.
+    static constexpr size_t ROPE_MIN = 64;
+
+    explicit LoxString(std::string text);
+    LoxString(std::shared_ptr<LoxString> left, std::shared_ptr<LoxString> right);
+    ~LoxString();
+
+    LoxString(const LoxString&) = delete;
+    LoxString& operator=(const LoxString&) = delete;
+
+    static std::shared_ptr<LoxString> concat(const std::shared_ptr<LoxString>& left,
+                                             const std::shared_ptr<LoxString>& right);
+
+    size_t length() const { return length_; }
+    bool isFlat() const { return left == nullptr; }
+    const std::string& str() const {
+        if (left != nullptr) flatten();
+        return text;
+    }
+    // Computed once and cached, so rehashing a string key is free.
+    size_t hash() const;
+};
@@ -0,0 +1,25 @@
+#include "number.h"
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+
+size_t formatNumber(double value, char* out) {
+    char* end = out + NUMBER_MAX_CHARS;
+    
+    // Counters, indexes and sizes are whole; skip the general algorithm.
+    if (value >= -9007199254740992.0 && value <= 9007199254740992.0) {
+        int64_t integer = static_cast<int64_t>(value);
+        if (static_cast<double>(integer) == value && !(integer == 0 && std::signbit(value))) {
+            return static_cast<size_t>(std::to_chars(out, end, integer).ptr - out);
+        }
+    }
+    
+    // 0/0 has its sign bit set on x86; the sign of a NaN means nothing.
+    if (std::isnan(value)) value = std::fabs(value);
+    return static_cast<size_t>(std::to_chars(out, end, value).ptr - out);
+}
+
+std::string formatNumber(double value) {
+    char buffer[NUMBER_MAX_CHARS];
+    return std::string(buffer, formatNumber(value, buffer));
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Longest text formatNumber can produce: "-2.2250738585072014e-308".
+constexpr size_t NUMBER_MAX_CHARS = 32;
+
+// Formats a number as the shortest text that reads back as the same double.
+// Whole numbers that a double holds exactly print as plain integers, without
+// a fraction or exponent. Independent of the locale. Writes at most
+// NUMBER_MAX_CHARS bytes to `out`, unterminated, and returns the count.
+size_t formatNumber(double value, char* out);
+std::string formatNumber(double value);
@@ -0,0 +1,81 @@
+#include "output.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+OutputBuffer::OutputBuffer(std::ostream& sink, size_t capacity) : sink(&sink), buffer(capacity) {
+    if (&sink == &std::cout) {
+        this->sink = nullptr;
+        fd = STDOUT_FILENO;
+        lineBuffered = isatty(fd);
+    }
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::setCapacity(size_t capacity) {
+    flush();
+    buffer.assign(capacity, '\0');
+}
+
+void OutputBuffer::setLineBuffered(bool lineBuffered) {
+    this->lineBuffered = lineBuffered;
+    if (lineBuffered) flush();
+}
+
+void OutputBuffer::write(const char* data, size_t length) {
+    if (length > buffer.size() - size) {
+        flush();
+        // Too big to be worth copying.
+        if (length >= buffer.size()) {
+            writeOut(data, length);
+            return;
+        }
+    }
+
+    std::memcpy(buffer.data() + size, data, length);
+    size += length;
+    if (lineBuffered && std::memchr(data, '\n', length) != nullptr) flush();
+}
+
+void OutputBuffer::writeLine(const std::string& text) {
+    if (text.size() < buffer.size() - size) {
+        std::memcpy(buffer.data() + size, text.data(), text.size());
+        size += text.size();
+        buffer[size++] = '\n';
+        if (lineBuffered) flush();
+        return;
+    }
+
+    write(text.data(), text.size());
+    write("\n", 1);
+}
+
+void OutputBuffer::flush() {
+    if (size == 0) return;
+    size_t length = size;
+    size = 0;
+    writeOut(buffer.data(), length);
+}
+
+void OutputBuffer::writeOut(const char* data, size_t length) {
+    if (sink != nullptr) {
+        sink->write(data, static_cast<std::streamsize>(length));
+        return;
+    }
+
+    // The host may have written to std::cout too; keep that in order.
+    std::cout.flush();
+    while (length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;  // The reader went away; drop the output.
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+}
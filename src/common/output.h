@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Buffered sink for program output, shared by both engines. Printing
+// appends to an in-memory buffer; the bytes leave in large writes when it
+// fills, on flush(), and on destruction.
+//
+// Output bound for std::cout skips iostreams and goes to file descriptor 1
+// with write(2); when that is a terminal, each complete line is flushed so
+// interactive use still feels immediate. Any other stream, such as the
+// string stream capturing an isolate's output, receives the buffered bytes.
+class OutputBuffer {
+private:
+    std::ostream* sink;  // null when writing to the descriptor
+    int fd = -1;
+    std::vector<char> buffer;
+    size_t size = 0;
+    bool lineBuffered = false;
+
+    void writeOut(const char* data, size_t length);
+
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    explicit OutputBuffer(std::ostream& sink, size_t capacity = DEFAULT_CAPACITY);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    // Flushes, then changes the buffer size. A capacity of 0 writes through.
+    void setCapacity(size_t capacity);
+    void setLineBuffered(bool lineBuffered);
+
+    void write(const char* data, size_t length);
+    void write(const std::string& text) { write(text.data(), text.size()); }
+    void writeLine(const std::string& text);
+    void flush();
+};
@@ -1,14 +1,15 @@
 #pragma once
 
 #include <string>
-#include <unordered_map>
+#include "flat_hash_map.h"
 
 enum class TokenType {
     // Single-character tokens
     LEFT_PAREN, RIGHT_PAREN,
     LEFT_BRACE, RIGHT_BRACE,
+    LEFT_BRACKET, RIGHT_BRACKET,
     COMMA, DOT, MINUS, PLUS,
-    SEMICOLON, SLASH, STAR,
+    COLON, SEMICOLON, SLASH, STAR,
 
     // One or two character tokens
     BANG, BANG_EQUAL,
@@ -21,7 +22,7 @@ enum class TokenType {
 
     // Keywords
     AND, CLASS, ELSE, FALSE,
-    FUN, FOR, IF, NIL, OR,
+    FUN, FOR, IF, IMPORT, NIL, OR,
     PRINT, RETURN, SUPER, THIS,
     TRUE, VAR, WHILE,
 
@@ -33,14 +34,15 @@ struct Token {
     std::string lexeme;
     std::string literal;
     int line;
+    size_t hash;  // of the lexeme, so name lookups never rehash it
 
     Token(TokenType type, const std::string& lexeme, const std::string& literal, int line)
-        : type(type), lexeme(lexeme), literal(literal), line(line) {}
+        : type(type), lexeme(lexeme), literal(literal), line(line), hash(hashString(lexeme)) {}
 };
 
 class TokenUtils {
 public:
-    static std::unordered_map<std::string, TokenType> keywords;
+    static const FlatHashMap<std::string, TokenType> keywords;
     static std::string tokenTypeToString(TokenType type);
     static TokenType getKeywordType(const std::string& text);
 };
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "value.h"
 #include "../interpreter/callable.h"
-#include <sstream>
+#include "number.h"
 
 bool Value::isTruthy() const {
     switch (type) {
@@ -17,32 +17,41 @@ bool Value::isEqual(const Value& other) const {
         case ValueType::NIL: return true;
         case ValueType::BOOLEAN: return asBool() == other.asBool();
         case ValueType::NUMBER: return asNumber() == other.asNumber();
-        case ValueType::STRING: return asString() == other.asString();
+        case ValueType::STRING: {
+            const std::shared_ptr<LoxString>& a = asLoxString();
+            const std::shared_ptr<LoxString>& b = other.asLoxString();
+            return a == b || (a->length() == b->length() && a->str() == b->str());
+        }
         case ValueType::OBJECT: return asObject() == other.asObject();
         default: return false;
     }
 }
 
+size_t Value::hash() const {
+    switch (type) {
+        case ValueType::NIL: return 0x9e3779b9;
+        case ValueType::BOOLEAN: return asBool() ? 1231 : 1237;
+        case ValueType::NUMBER: {
+            // Adding 0.0 folds -0 into 0, which compares equal to it.
+            return std::hash<double>()(asNumber() + 0.0);
+        }
+        case ValueType::STRING: return asLoxString()->hash();
+        case ValueType::OBJECT: return std::hash<LoxObject*>()(asObject().get());
+        default: return 0;
+    }
+}
+
 std::string Value::toString() const {
     switch (type) {
         case ValueType::NIL: return "nil";
         case ValueType::BOOLEAN: return asBool() ? "true" : "false";
-        case ValueType::NUMBER: {
-            std::ostringstream oss;
-            oss << asNumber();
-            return oss.str();
-        }
+        case ValueType::NUMBER: return formatNumber(asNumber());
         case ValueType::STRING: return asString();
         case ValueType::OBJECT: return asObject()->toString();
         default: return "unknown";
     }
 }
 
-bool Value::isCallable() const {
-    return isObject() && asObject() && 
-           (asObject()->getType() == "function" || asObject()->getType() == "class");
-}
-
-std::shared_ptr<LoxCallable> Value::asCallable() const {
-    return std::dynamic_pointer_cast<LoxCallable>(asObject());
+LoxCallable* Value::asCallable() const {
+    return static_cast<LoxCallable*>(asObject().get());
 }
\ No newline at end of file
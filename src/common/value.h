@@ -3,6 +3,8 @@
 #include <string>
 #include <memory>
 #include <variant>
+#include "lox_string.h"
+#include "../gc/allocator.h"
 
 // Forward declarations
 class LoxObject;
@@ -18,19 +20,50 @@ enum class ValueType {
     OBJECT
 };
 
+// Object kinds. Type tests and casts dispatch on this tag rather than on
+// RTTI. The callable kinds come first.
+enum class ObjType : unsigned char {
+    FUNCTION,
+    NATIVE,
+    BOUND_NATIVE,
+    BOUND_METHOD,
+    CLASS,
+    INSTANCE,
+    MODULE,
+    STRING_BUILDER,
+    LIST,
+    MAP
+};
+
+// Base class for all Lox objects. Objects are reference counted, and the
+// garbage collector frees the cycles among them. The object's type tag
+// lives in its GcNode header.
+class LoxObject : public GcNode, public std::enable_shared_from_this<LoxObject> {
+public:
+    explicit LoxObject(ObjType type) : GcNode(Kind::OBJECT, static_cast<unsigned char>(type)) {}
+    virtual ~LoxObject() = default;
+    virtual std::string toString() const = 0;
+
+    ObjType type() const { return static_cast<ObjType>(tag); }
+};
+
 class Value {
 public:
     ValueType type;
-    std::variant<std::nullptr_t, bool, double, std::string, std::shared_ptr<LoxObject>> value;
+    std::variant<std::nullptr_t, bool, double, std::shared_ptr<LoxString>, std::shared_ptr<LoxObject>> value;
 
     Value() : type(ValueType::NIL), value(nullptr) {}
     Value(bool b) : type(ValueType::BOOLEAN), value(b) {}
     Value(double d) : type(ValueType::NUMBER), value(d) {}
-    Value(const std::string& s) : type(ValueType::STRING), value(s) {}
+    Value(std::string s) : type(ValueType::STRING), value(makePooled<LoxString>(std::move(s))) {}
+    Value(const char* s) : Value(std::string(s)) {}
+    Value(std::shared_ptr<LoxString> s) : type(ValueType::STRING), value(std::move(s)) {}
     Value(std::shared_ptr<LoxObject> obj) : type(ValueType::OBJECT), value(obj) {}
 
     bool isTruthy() const;
     bool isEqual(const Value& other) const;
+    // Consistent with isEqual: equal values hash alike.
+    size_t hash() const;
     std::string toString() const;
 
     // Type checking helpers
@@ -39,24 +72,39 @@ public:
     bool isNumber() const { return type == ValueType::NUMBER; }
     bool isString() const { return type == ValueType::STRING; }
     bool isObject() const { return type == ValueType::OBJECT; }
-    bool isCallable() const;
+    bool isObjType(ObjType objType) const { return isObject() && asObject() && asObject()->type() == objType; }
+    bool isCallable() const {
+        if (!isObject() || !asObject()) return false;
+        // FUNCTION, NATIVE, BOUND_NATIVE, BOUND_METHOD and CLASS come first.
+        return asObject()->type() <= ObjType::CLASS;
+    }
 
     // Value extraction helpers
     bool asBool() const { return std::get<bool>(value); }
     double asNumber() const { return std::get<double>(value); }
-    std::string asString() const { return std::get<std::string>(value); }
-    std::shared_ptr<LoxObject> asObject() const { return std::get<std::shared_ptr<LoxObject>>(value); }
-    std::shared_ptr<class LoxCallable> asCallable() const;
+    const std::string& asString() const { return asLoxString()->str(); }
+    const std::shared_ptr<LoxString>& asLoxString() const { return std::get<std::shared_ptr<LoxString>>(value); }
+    const std::shared_ptr<LoxObject>& asObject() const { return std::get<std::shared_ptr<LoxObject>>(value); }
+    class LoxCallable* asCallable() const;
+
+    // For code that has proven the value is a number (see NumberInference):
+    // no type check on the read, and no variant reassignment on the write
+    // when the value already holds a number.
+    double unboxedNumber() const { return *std::get_if<double>(&value); }
+    void setNumber(double d) {
+        if (type == ValueType::NUMBER) {
+            *std::get_if<double>(&value) = d;
+        } else {
+            *this = Value(d);
+        }
+    }
 };
 
-// Base class for all Lox objects
-class LoxObject {
-public:
-    virtual ~LoxObject() = default;
-    virtual std::string toString() const = 0;
-    virtual std::string getType() const = 0;
-    
-    // GC support
-    bool isMarked = false;
-    std::shared_ptr<LoxObject> next = nullptr;
-};
\ No newline at end of file
+// Stores of a value into an object, an environment or an upvalue go through
+// this, so that an incremental collection sees references that move behind
+// its back.
+inline void writeBarrier(const Value& value) {
+    if (GarbageCollector::marking != nullptr && value.isObject() && value.asObject() != nullptr) {
+        GarbageCollector::marking->shade(value.asObject().get());
+    }
+}
@@ -0,0 +1,334 @@
+#include "allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+
+namespace {
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// Blocks a thread's cache takes from or gives back to the pool at a time.
+constexpr uint32_t BATCH = 32;
+
+constexpr size_t SLABS_PER_REGION = SlabAllocator::REGION_SIZE / SlabAllocator::SLAB_SIZE;
+static_assert(SLABS_PER_REGION == 64, "a region's slabs are tracked in a 64-bit mask");
+
+// A mapping that slabs are cut from. Released slabs are handed back to the
+// system with madvise, and a region none of whose slabs is in use is
+// unmapped.
+struct Region {
+    char* base;
+    uint64_t inUse = 0;  // bit i: slab i is carved and committed
+};
+
+std::atomic<bool> hugePages{false};
+
+// Heads every slab; slabs are aligned to their size, so a block finds its
+// slab by masking its address. The pool keeps each slab's free blocks on
+// the slab itself.
+struct Slab {
+    Region* region;
+    Slab* prev;
+    Slab* next;
+    FreeBlock* free;
+    uint32_t freeCount;
+    uint32_t capacity;
+    uint32_t sizeClass;
+    int bin;  // in Pool::bins, or NO_BIN while every block is in use
+};
+
+constexpr size_t HEADER_SIZE = (sizeof(Slab) + SlabAllocator::GRANULE - 1) / SlabAllocator::GRANULE * SlabAllocator::GRANULE;
+
+// Slabs with free blocks are binned by how full they are. Refills take
+// from the fullest, so that allocation packs into few slabs while the
+// sparse ones drain until they are empty and can be released.
+constexpr int PARTIAL_BINS = 8;
+constexpr int EMPTY_BIN = PARTIAL_BINS;
+constexpr int NO_BIN = -1;
+
+Slab* slabOf(void* block) {
+    return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(block) & ~(uintptr_t(SlabAllocator::SLAB_SIZE) - 1));
+}
+
+// Free blocks no thread has cached, and the slabs they came from.
+struct Pool {
+    std::mutex mutex;
+    Slab* bins[SlabAllocator::CLASS_COUNT][PARTIAL_BINS + 1] = {};
+    std::vector<Region*> regions;
+    size_t slabBytes = 0;
+    size_t freeBytes = 0;  // in blocks on the slabs' free lists
+
+    void unbin(Slab* slab) {
+        if (slab->bin == NO_BIN) return;
+        if (slab->prev != nullptr) slab->prev->next = slab->next;
+        else bins[slab->sizeClass][slab->bin] = slab->next;
+        if (slab->next != nullptr) slab->next->prev = slab->prev;
+        slab->bin = NO_BIN;
+    }
+
+    void rebin(Slab* slab) {
+        int bin = slab->freeCount == 0 ? NO_BIN
+                  : slab->freeCount == slab->capacity
+                      ? EMPTY_BIN
+                      : static_cast<int>((slab->freeCount * PARTIAL_BINS - 1) / slab->capacity);
+        if (bin == slab->bin) return;
+        unbin(slab);
+        if (bin == NO_BIN) return;
+        Slab*& head = bins[slab->sizeClass][bin];
+        slab->prev = nullptr;
+        slab->next = head;
+        if (head != nullptr) head->prev = slab;
+        head = slab;
+        slab->bin = bin;
+    }
+
+    // Maps a region aligned to its size.
+    Region* mapRegion() {
+        size_t size = SlabAllocator::REGION_SIZE;
+        void* mapping = mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) throw std::bad_alloc();
+        auto start = reinterpret_cast<uintptr_t>(mapping);
+        uintptr_t aligned = (start + size - 1) & ~(uintptr_t(size) - 1);
+        if (aligned > start) munmap(mapping, aligned - start);
+        munmap(reinterpret_cast<void*>(aligned + size), start + size - aligned);
+#ifdef MADV_HUGEPAGE
+        if (hugePages.load(std::memory_order_relaxed)) madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+        auto* region = new Region();
+        region->base = reinterpret_cast<char*>(aligned);
+        regions.push_back(region);
+        return region;
+    }
+
+    // A slab from the fullest region with room, or from a new region.
+    Slab* carveSlab() {
+        Region* region = nullptr;
+        int used = -1;
+        for (Region* candidate : regions) {
+            int count = __builtin_popcountll(candidate->inUse);
+            if (count < static_cast<int>(SLABS_PER_REGION) && count > used) {
+                region = candidate;
+                used = count;
+            }
+        }
+        if (region == nullptr) region = mapRegion();
+        int index = __builtin_ctzll(~region->inUse);
+        region->inUse |= uint64_t(1) << index;
+        auto* slab = reinterpret_cast<Slab*>(region->base + static_cast<size_t>(index) * SlabAllocator::SLAB_SIZE);
+        slab->region = region;
+        return slab;
+    }
+
+    Slab* newSlab(size_t sizeClass) {
+        size_t size = (sizeClass + 1) * SlabAllocator::GRANULE;
+        Slab* slab = carveSlab();
+        slab->capacity = static_cast<uint32_t>((SlabAllocator::SLAB_SIZE - HEADER_SIZE) / size);
+        slab->sizeClass = static_cast<uint32_t>(sizeClass);
+        slab->freeCount = slab->capacity;
+        slab->bin = NO_BIN;
+        slab->free = nullptr;
+        char* blocks = reinterpret_cast<char*>(slab) + HEADER_SIZE;
+        for (size_t i = slab->capacity; i > 0; i--) {
+            auto* block = reinterpret_cast<FreeBlock*>(blocks + (i - 1) * size);
+            block->next = slab->free;
+            slab->free = block;
+        }
+        slabBytes += SlabAllocator::SLAB_SIZE;
+        freeBytes += slab->capacity * size;
+        rebin(slab);
+        return slab;
+    }
+
+    // Gives an empty slab's memory back to the system, and its region's
+    // mapping once none of it is in use.
+    void releaseSlab(Slab* slab) {
+        unbin(slab);
+        slabBytes -= SlabAllocator::SLAB_SIZE;
+        freeBytes -= slab->capacity * (slab->sizeClass + 1) * SlabAllocator::GRANULE;
+
+        Region* region = slab->region;
+        size_t index = static_cast<size_t>(reinterpret_cast<char*>(slab) - region->base) / SlabAllocator::SLAB_SIZE;
+        region->inUse &= ~(uint64_t(1) << index);
+        if (region->inUse != 0) {
+            madvise(slab, SlabAllocator::SLAB_SIZE, MADV_DONTNEED);
+            return;
+        }
+        munmap(region->base, SlabAllocator::REGION_SIZE);
+        regions.erase(std::find(regions.begin(), regions.end(), region));
+        delete region;
+    }
+
+    // The fullest slab with a free block, or a new one.
+    Slab* fullest(size_t sizeClass) {
+        for (Slab* slab : bins[sizeClass]) {
+            if (slab != nullptr) return slab;
+        }
+        return newSlab(sizeClass);
+    }
+};
+
+// Never destroyed: strings in shared ASTs are freed during static
+// destruction, possibly after this would have been.
+Pool& pool() {
+    static Pool* instance = new Pool();
+    return *instance;
+}
+
+struct ThreadCache {
+    FreeBlock* lists[SlabAllocator::CLASS_COUNT];
+    uint32_t counts[SlabAllocator::CLASS_COUNT];
+    bool retired;  // the thread is exiting; frees go back to the pool
+};
+
+// Trivially destructible, so it stays usable while other thread_locals are
+// destroyed; CacheFlusher gives its blocks back when the thread exits.
+thread_local ThreadCache cache;
+
+// Returns a list of blocks of one size class to their slabs.
+void giveBack(FreeBlock* first, FreeBlock* last, size_t sizeClass) {
+    size_t size = (sizeClass + 1) * SlabAllocator::GRANULE;
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    last->next = nullptr;
+    for (FreeBlock* block = first; block != nullptr;) {
+        FreeBlock* next = block->next;
+        Slab* slab = slabOf(block);
+        block->next = slab->free;
+        slab->free = block;
+        slab->freeCount++;
+        shared.freeBytes += size;
+        shared.rebin(slab);
+        block = next;
+    }
+}
+
+struct CacheFlusher {
+    ~CacheFlusher() {
+        for (size_t i = 0; i < SlabAllocator::CLASS_COUNT; i++) {
+            FreeBlock* first = cache.lists[i];
+            if (first == nullptr) continue;
+            FreeBlock* last = first;
+            while (last->next != nullptr) last = last->next;
+            giveBack(first, last, i);
+            cache.lists[i] = nullptr;
+            cache.counts[i] = 0;
+        }
+        cache.retired = true;
+    }
+};
+
+thread_local CacheFlusher flusher;
+
+// Moves a batch of blocks from the pool into the cache, taking them from
+// the fullest slabs.
+void refill(size_t sizeClass) {
+    (void)&flusher;  // registers the flush at thread exit
+    size_t size = (sizeClass + 1) * SlabAllocator::GRANULE;
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+
+    uint32_t taken = 0;
+    while (taken < BATCH) {
+        Slab* slab = shared.fullest(sizeClass);
+        while (taken < BATCH && slab->free != nullptr) {
+            FreeBlock* block = slab->free;
+            slab->free = block->next;
+            slab->freeCount--;
+            block->next = cache.lists[sizeClass];
+            cache.lists[sizeClass] = block;
+            cache.counts[sizeClass]++;
+            shared.freeBytes -= size;
+            taken++;
+        }
+        shared.rebin(slab);
+    }
+}
+
+}  // namespace
+
+void* SlabAllocator::allocate(size_t size) {
+    if (size > MAX_SIZE || size == 0) return ::operator new(size);
+    size_t sizeClass = (size - 1) / GRANULE;
+    if (cache.lists[sizeClass] == nullptr) refill(sizeClass);
+    FreeBlock* block = cache.lists[sizeClass];
+    cache.lists[sizeClass] = block->next;
+    cache.counts[sizeClass]--;
+    return block;
+}
+
+void SlabAllocator::deallocate(void* pointer, size_t size) {
+    if (size > MAX_SIZE || size == 0) {
+        ::operator delete(pointer);
+        return;
+    }
+    size_t sizeClass = (size - 1) / GRANULE;
+    auto* block = static_cast<FreeBlock*>(pointer);
+    if (cache.retired) {
+        giveBack(block, block, sizeClass);
+        return;
+    }
+    // A thread may only ever free, so its cache must be flushed at exit
+    // too; otherwise its blocks keep their slabs from ever emptying.
+    (void)&flusher;
+    block->next = cache.lists[sizeClass];
+    cache.lists[sizeClass] = block;
+
+    // Keep a batch for the next allocations and hand the rest back, so a
+    // thread that frees what another allocated doesn't hoard it.
+    if (++cache.counts[sizeClass] >= 2 * BATCH) {
+        FreeBlock* first = block;
+        FreeBlock* last = block;
+        for (uint32_t i = 1; i < BATCH; i++) last = last->next;
+        cache.lists[sizeClass] = last->next;
+        cache.counts[sizeClass] -= BATCH;
+        giveBack(first, last, sizeClass);
+    }
+}
+
+size_t SlabAllocator::getSlabBytes() {
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    return shared.slabBytes;
+}
+
+size_t SlabAllocator::getFreeBytes() {
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    return shared.freeBytes;
+}
+
+size_t SlabAllocator::trim() {
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (shared.freeBytes <= shared.slabBytes * FRAGMENTATION_LIMIT / 100) return 0;
+
+    size_t released = 0;
+    for (auto& bins : shared.bins) {
+        // One empty slab per class stays, so that a program hovering around
+        // a slab boundary doesn't map and free one over and over.
+        Slab* slab = bins[EMPTY_BIN] != nullptr ? bins[EMPTY_BIN]->next : nullptr;
+        while (slab != nullptr) {
+            Slab* next = slab->next;
+            shared.releaseSlab(slab);
+            released += SLAB_SIZE;
+            slab = next;
+        }
+    }
+    return released;
+}
+
+size_t SlabAllocator::getMappedBytes() {
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    return shared.regions.size() * REGION_SIZE;
+}
+
+void SlabAllocator::setHugePages(bool enable) {
+    hugePages.store(enable, std::memory_order_relaxed);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "gc.h"
+
+// Size-segregated allocator for the runtime's small, numerous allocations:
+// objects, environments, upvalues and strings, each together with its
+// shared_ptr control block. Requests up to MAX_SIZE bytes are rounded up to
+// a multiple of GRANULE and served from slabs cut into blocks of that size;
+// larger ones go to operator new. Slabs are cut from regions mapped from the
+// system with mmap, and given back to it when empty.
+//
+// Every thread keeps a free list per size class and only takes the shared
+// pool's lock to move a batch of blocks in or out, so isolates on different
+// threads don't contend. A block may be freed on any thread; it joins that
+// thread's cache.
+//
+// Objects are held through shared_ptrs and raw pointers all over the
+// runtime, so they can't be moved to compact the heap. Instead the pool
+// fights fragmentation by where it allocates: it hands out blocks from the
+// fullest slabs first, so that live objects pack together and the sparse
+// slabs empty out, and trim() returns empty slabs to the system: their
+// pages with madvise, and whole regions with munmap.
+class SlabAllocator {
+public:
+    static constexpr size_t GRANULE = 16;
+    static constexpr size_t MAX_SIZE = 512;
+    static constexpr size_t CLASS_COUNT = MAX_SIZE / GRANULE;
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+    static constexpr size_t REGION_SIZE = 4 * 1024 * 1024;
+    // Free blocks may take up this much of the slabs, in percent, before
+    // trim() releases empty ones.
+    static constexpr size_t FRAGMENTATION_LIMIT = 25;
+
+    static void* allocate(size_t size);
+    static void deallocate(void* block, size_t size);
+    // The bytes an allocation of `size` really takes.
+    static size_t blockSize(size_t size) {
+        return size <= MAX_SIZE ? (size + GRANULE - 1) / GRANULE * GRANULE : size;
+    }
+    // Bytes of slabs held, by every thread.
+    static size_t getSlabBytes();
+    // Bytes of address space mapped for regions.
+    static size_t getMappedBytes();
+    // Bytes of free blocks in the slabs, not counting threads' caches.
+    static size_t getFreeBytes();
+    // If free blocks exceed FRAGMENTATION_LIMIT, frees the slabs they
+    // fill entirely. Returns the bytes released.
+    static size_t trim();
+    // Asks for transparent huge pages in regions mapped from now on.
+    static void setHugePages(bool enable);
+};
+
+// Standard allocator over SlabAllocator, for std::allocate_shared. Reports
+// the size of the allocation it makes through `allocated`.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    size_t* allocated = nullptr;
+
+    PoolAllocator() = default;
+    explicit PoolAllocator(size_t* allocated) : allocated(allocated) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : allocated(other.allocated) {}
+
+    T* allocate(size_t n) {
+        size_t size = n * sizeof(T);
+        if (allocated != nullptr) *allocated = SlabAllocator::blockSize(size);
+        return static_cast<T*>(SlabAllocator::allocate(size));
+    }
+    void deallocate(T* block, size_t n) { SlabAllocator::deallocate(block, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+// std::make_shared for runtime objects: allocates from the slabs, and
+// charges nodes' bytes to the collector they belong to.
+template <typename T, typename... Args>
+std::shared_ptr<T> makePooled(Args&&... args) {
+    size_t bytes = 0;
+    std::shared_ptr<T> object = std::allocate_shared<T>(PoolAllocator<T>(&bytes), std::forward<Args>(args)...);
+    if constexpr (std::is_base_of<GcNode, T>::value) GarbageCollector::account(object.get(), bytes);
+    return object;
+}
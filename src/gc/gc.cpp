@@ -0,0 +1,779 @@
+#include "gc.h"
+#include "allocator.h"
+#include "../common/collections.h"
+#include "../common/error.h"
+#include "../common/thread_pool.h"
+#include "../interpreter/interpreter.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+thread_local GarbageCollector* GarbageCollector::current = nullptr;
+thread_local GarbageCollector* GarbageCollector::marking = nullptr;
+
+// How many nodes a slice handles between looks at the clock.
+static constexpr int CLOCK_INTERVAL = 256;
+
+GcNode::GcNode(Kind kind, unsigned char tag) : kind(kind), tag(tag) {
+    if (GarbageCollector::current != nullptr) GarbageCollector::current->link(this);
+}
+
+GcNode::~GcNode() {
+    if (owner != nullptr) owner->unlink(this);
+}
+
+GarbageCollector::GarbageCollector() = default;
+
+GarbageCollector::~GarbageCollector() {
+    collect("teardown");
+    // Whatever survives is held from outside the isolate, by its host.
+    for (GcNode* node = head; node != nullptr;) {
+        GcNode* next = node->next;
+        node->owner = nullptr;
+        node->prev = node->next = nullptr;
+        bytesAllocated -= node->bytes;
+        node = next;
+    }
+}
+
+// New nodes go in front of the cursor, so the running phase doesn't visit
+// them; they count as reachable until the next collection.
+void GarbageCollector::link(GcNode* node) {
+    node->owner = this;
+    node->next = head;
+    if (head != nullptr) head->prev = node;
+    head = node;
+    nodeCount++;
+
+    if (phase == Phase::IDLE) {
+        if (nodeCount >= nextGC) due = true;
+    } else {
+        node->cycle = cycle;
+        node->marked = true;
+        if (++created >= SLICE_INTERVAL) due = true;
+    }
+}
+
+void GarbageCollector::unlink(GcNode* node) {
+    if (node == cursor) cursor = node->next;
+    if (node->prev != nullptr) node->prev->next = node->next;
+    else head = node->next;
+    if (node->next != nullptr) node->next->prev = node->prev;
+    nodeCount--;
+    bytesAllocated -= node->bytes;
+}
+
+void GarbageCollector::setMaxHeap(size_t bytes) {
+    maxHeap = bytes;
+    nextGCBytes = bytes == 0 ? SIZE_MAX : std::min(bytes / 2, nextGCBytes);
+}
+
+// The heap has grown past the point where a cap wants it collected. The
+// allocation that went over the cap fails; short of that, a collection
+// starts at the next safepoint, since objects the interpreter is building
+// may be held only by raw pointers here.
+void GarbageCollector::heapFull() {
+    if (bytesAllocated > maxHeap) {
+        throw LoxError("Out of memory: the heap limit of " + std::to_string(maxHeap) + " bytes was exceeded.");
+    }
+    if (phase == Phase::IDLE && sweepQueue.empty()) due = true;
+}
+
+void GarbageCollector::setLog(GcLog* log) {
+    this->log = log;
+    if (log != nullptr) isolate = log->attach();
+}
+
+void GarbageCollector::collect(const char* cause) {
+    Scope scope(*this);
+    deadline = std::chrono::steady_clock::time_point::max();
+    auto start = std::chrono::steady_clock::now();
+    sweep(SIZE_MAX);
+    logPause(&GcEvent::sweepTime, start);
+
+    bool fresh = phase == Phase::IDLE;
+    if (fresh) begin(cause);
+    start = std::chrono::steady_clock::now();
+    if (!fresh || !collectInParallel()) advance();
+    logPause(&GcEvent::markTime, start);
+
+    start = std::chrono::steady_clock::now();
+    sweep(SIZE_MAX);
+    logPause(&GcEvent::sweepTime, start);
+}
+
+void GarbageCollector::step() {
+    due = stressGC;
+    created = 0;
+    Scope scope(*this);
+
+    deadline = std::chrono::steady_clock::time_point::max();
+    if (pauseTarget.count() > 0 && !stressGC) deadline = std::chrono::steady_clock::now() + pauseTarget;
+    auto start = std::chrono::steady_clock::now();
+    if (!sweepQueue.empty()) {
+        sweep(pauseTarget.count() > 0 ? SIZE_MAX : SWEEP_SLICE);
+        logPause(&GcEvent::sweepTime, start);
+        return;
+    }
+    if (phase == Phase::IDLE) {
+        begin(stressGC ? "stress" : "heap");
+        start = std::chrono::steady_clock::now();
+        if (pauseTarget.count() == 0 && collectInParallel()) {
+            logPause(&GcEvent::markTime, start);
+            return;
+        }
+    }
+    advance();
+    logPause(&GcEvent::markTime, start);
+}
+
+// What the type counts of a collection's event call each kind of node.
+static const char* typeName(GcNode::Kind kind, const GcNode* node) {
+    switch (kind) {
+        case GcNode::Kind::ENVIRONMENT: return "environment";
+        case GcNode::Kind::UPVALUE: return "upvalue";
+        case GcNode::Kind::OBJECT: break;
+    }
+    switch (static_cast<const LoxObject*>(node)->type()) {
+        case ObjType::FUNCTION: return "function";
+        case ObjType::NATIVE:
+        case ObjType::BOUND_NATIVE: return "native";
+        case ObjType::BOUND_METHOD: return "bound_method";
+        case ObjType::CLASS: return "class";
+        case ObjType::INSTANCE: return "instance";
+        case ObjType::MODULE: return "module";
+        case ObjType::STRING_BUILDER: return "string_builder";
+        case ObjType::LIST: return "list";
+        case ObjType::MAP: return "map";
+    }
+    return "object";
+}
+
+void GarbageCollector::begin(const char* cause) {
+    cycle++;
+    if (cycle == 0) cycle++;  // 0 marks state as stale
+    phase = Phase::COUNT;
+    cursor = head;
+    marking = this;
+
+    if (log == nullptr) return;
+    event = GcEvent();
+    event.isolate = isolate;
+    event.collection = collections + 1;
+    event.cause = cause;
+    event.mode = deadline != std::chrono::steady_clock::time_point::max() ? "incremental" : "full";
+    event.start = log->now();
+    event.nodesBefore = nodeCount;
+    event.bytesBefore = bytesAllocated;
+    event.freed = freed;
+    for (GcNode* node = head; node != nullptr; node = node->next) {
+        const char* name = typeName(node->kind, node);
+        auto type = std::find_if(event.types.begin(), event.types.end(),
+                                 [name](const auto& entry) { return entry.first == name; });
+        if (type == event.types.end()) event.types.emplace_back(name, 1);
+        else type->second++;
+    }
+}
+
+// Counts the work since `start` as a pause of the collection being logged,
+// and writes the collection's event once its sweep is done.
+void GarbageCollector::logPause(double GcEvent::*time, std::chrono::steady_clock::time_point start) {
+    if (log == nullptr || event.collection == 0) return;
+    double pause = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    event.*time += pause;
+    event.pauses++;
+    event.longestPause = std::max(event.longestPause, pause);
+    log->recordPause(pause);
+
+    if (phase != Phase::IDLE || !sweepQueue.empty()) return;
+    event.end = log->now();
+    event.nodesAfter = nodeCount;
+    event.bytesAfter = bytesAllocated;
+    event.freed = freed - event.freed;
+    event.nextGC = nextGC;
+    log->write(event);
+    event = GcEvent();
+}
+
+bool GarbageCollector::outOfTime() {
+    if (deadline == std::chrono::steady_clock::time_point::max() || --untilClock > 0) return false;
+    untilClock = CLOCK_INTERVAL;
+    return std::chrono::steady_clock::now() >= deadline;
+}
+
+bool GarbageCollector::advance() {
+    untilClock = CLOCK_INTERVAL;
+
+    // Count every node's references, less those from other nodes.
+    while (phase == Phase::COUNT) {
+        GcNode* node;
+        if (partial != nullptr) {
+            node = static_cast<GcNode*>(partial.get());
+        } else if (cursor != nullptr) {
+            node = cursor;
+            cursor = node->next;
+            touch(node);
+            long count = useCount(node);
+            // Nodes no shared_ptr owns can't be garbage.
+            if (count == 0) count = INT32_MAX;
+            node->refs = static_cast<int32_t>(std::min<long>(node->refs + count, INT32_MAX));
+        } else {
+            phase = Phase::MARK;
+            cursor = head;
+            break;
+        }
+        bool complete = scan(node, [&](GcNode* child) {
+            touch(child);
+            child->refs--;
+        });
+        if (!complete || outOfTime()) return false;
+    }
+
+    // Mark what is reachable from nodes referenced from outside, then
+    // gather what is left as candidates for the last step. Marks the write
+    // barrier adds are traced in either walk.
+    for (;;) {
+        if (partial != nullptr || !grayStack.empty()) {
+            std::shared_ptr<void> gray;
+            if (partial == nullptr) {
+                gray = std::move(grayStack.back());
+                grayStack.pop_back();
+            }
+            GcNode* node = static_cast<GcNode*>(partial != nullptr ? partial.get() : gray.get());
+            if (!scan(node, [&](GcNode* child) { mark(child); })) return false;
+        } else if (cursor != nullptr) {
+            GcNode* node = cursor;
+            cursor = node->next;
+            touch(node);
+            if (node->marked) {
+                // Already reachable
+            } else if (phase == Phase::MARK) {
+                if (node->refs > 0) mark(node);
+            } else {
+                candidates.emplace_back(node, lock(node));
+            }
+        } else if (phase == Phase::MARK) {
+            phase = Phase::GATHER;
+            cursor = head;
+        } else {
+            finish();
+            return true;
+        }
+        if (outOfTime()) return false;
+    }
+}
+
+// Calls `visit` on each of a node's references to this collector's nodes,
+// resuming where the last slice stopped if it stopped in this node. Huge
+// lists and maps take several slices. Returns false, keeping the node and
+// its progress, if the slice runs out of time first.
+template <typename Visit>
+bool GarbageCollector::scan(GcNode* node, Visit&& visit) {
+    size_t skip = partial != nullptr ? partialDone : 0;
+    size_t index = 0;
+    bool complete = forEachReference(node, [&](GcNode* child) {
+        if (index++ < skip) return true;
+        if (child->owner == this) visit(child);
+        return !outOfTime();
+    });
+    if (complete) {
+        partial.reset();
+        return true;
+    }
+    if (partial == nullptr) partial = lock(node);
+    partialDone = index;
+    if (partial != nullptr) return false;
+
+    // A node nothing owns could be gone by the next slice; finish it now.
+    index = 0;
+    forEachReference(node, [&](GcNode* child) {
+        if (index++ >= partialDone && child->owner == this) visit(child);
+        return true;
+    });
+    return true;
+}
+
+// Checks the candidates against their reference counts as they are now,
+// with the program stopped, and frees the ones that are garbage after all.
+void GarbageCollector::finish() {
+    marking = nullptr;
+    phase = Phase::IDLE;
+    cursor = nullptr;
+
+    std::vector<std::pair<GcNode*, std::shared_ptr<void>>> garbage;
+    garbage.swap(candidates);
+    garbage.erase(std::remove_if(garbage.begin(), garbage.end(),
+                                 [](const auto& candidate) { return candidate.first->marked; }),
+                  garbage.end());
+
+    // Start a fresh count over just the candidates; their own hold on each
+    // one is not a reference.
+    cycle++;
+    if (cycle == 0) cycle++;
+    for (auto& candidate : garbage) {
+        candidate.first->cycle = cycle;
+        candidate.first->marked = false;
+        candidate.first->refs = static_cast<int32_t>(std::min<long>(useCount(candidate.first) - 1, INT32_MAX));
+    }
+    for (auto& candidate : garbage) {
+        forEachReference(candidate.first, [&](GcNode* child) {
+            if (child->owner == this && child->cycle == cycle) child->refs--;
+            return true;
+        });
+    }
+    // Whatever a candidate with references left over reaches among the
+    // others is live too.
+    std::vector<GcNode*> live;
+    for (auto& candidate : garbage) {
+        if (candidate.first->refs > 0) {
+            candidate.first->marked = true;
+            live.push_back(candidate.first);
+        }
+    }
+    while (!live.empty()) {
+        GcNode* node = live.back();
+        live.pop_back();
+        forEachReference(node, [&](GcNode* child) {
+            if (child->owner == this && child->cycle == cycle && !child->marked) {
+                child->marked = true;
+                live.push_back(child);
+            }
+            return true;
+        });
+    }
+
+    garbage.erase(std::remove_if(garbage.begin(), garbage.end(),
+                                 [](const auto& candidate) { return candidate.first->marked; }),
+                  garbage.end());
+    collections++;
+    created = 0;
+    if (garbage.empty()) {
+        complete();
+    } else {
+        // Freed a slice at a time from the next safepoint on
+        sweepQueue = std::move(garbage);
+        due = true;
+    }
+}
+
+// Frees up to `limit` nodes of garbage, or as many as the slice has time
+// for: breaks every reference out of each one, then lets go of it, and
+// reference counting does the rest. Garbage stays unreachable, so nothing
+// the program does in between can get at it. The next collection waits
+// until the sweep is done.
+void GarbageCollector::sweep(size_t limit) {
+    if (sweepQueue.empty()) return;
+    untilClock = CLOCK_INTERVAL;
+    size_t end = swept + std::min(limit, sweepQueue.size() - swept);
+    while (swept < end) {
+        auto& node = sweepQueue[swept++];
+        clearReferences(node.first);
+        node.second.reset();
+        freed++;
+        if (outOfTime()) break;
+    }
+    if (swept < sweepQueue.size()) {
+        due = true;
+        return;
+    }
+    sweepQueue.clear();
+    swept = 0;
+    complete();
+}
+
+// Sets the next collection's threshold once the sweep is done, and gives
+// the slabs the sweep emptied back to the system if the heap has become
+// fragmented.
+void GarbageCollector::complete() {
+    nextGC = std::max(MIN_NEXT_GC, nodeCount * GC_HEAP_GROW_FACTOR);
+    // Under a cap, collect again once half the headroom left is used up.
+    if (maxHeap > 0) nextGCBytes = bytesAllocated < maxHeap ? bytesAllocated + (maxHeap - bytesAllocated) / 2 : maxHeap;
+    size_t released = SlabAllocator::trim();
+    if (log != nullptr) event.releasedBytes += released;
+}
+
+// Counts and marks a stopped heap on several threads. While the workers
+// run, each node's `refs` holds its position in `nodes`, so that its count
+// and mark can live in side tables they update atomically. Marking shares
+// gray nodes through a queue per worker; a worker that has run out steals
+// a batch from another's.
+struct GarbageCollector::ParallelMark {
+    // Gray nodes a worker has put up for stealing. Its owner takes from the
+    // back, thieves from the front.
+    struct GrayQueue {
+        std::mutex mutex;
+        std::deque<GcNode*> nodes;
+    };
+
+    static constexpr size_t SHARE_BATCH = 64;
+
+    GarbageCollector& collector;
+    ThreadPool& pool;
+    size_t threads;
+    std::vector<GcNode*> nodes;
+    std::vector<std::atomic<int32_t>> counts;
+    std::vector<std::atomic<bool>> marks;
+    std::vector<GrayQueue> queues;
+    std::atomic<size_t> busy;
+
+    ParallelMark(GarbageCollector& collector, ThreadPool& pool, size_t threads)
+        : collector(collector), pool(pool), threads(threads), counts(collector.nodeCount),
+          marks(collector.nodeCount), queues(threads), busy(threads) {
+        nodes.reserve(collector.nodeCount);
+        for (GcNode* node = collector.head; node != nullptr; node = node->next) {
+            node->cycle = collector.cycle;
+            node->refs = static_cast<int32_t>(nodes.size());
+            nodes.push_back(node);
+        }
+    }
+
+    // Runs `task(index, worker)` for every node, split evenly between the
+    // workers, and waits for them all.
+    template <typename Task>
+    void forEachNode(Task task) {
+        for (size_t worker = 0; worker < threads; worker++) {
+            pool.submit([this, worker, task] {
+                size_t end = nodes.size() * (worker + 1) / threads;
+                for (size_t i = nodes.size() * worker / threads; i < end; i++) task(i, worker);
+            });
+        }
+        pool.wait();
+    }
+
+    bool isOwned(GcNode* node) const { return node->owner == &collector; }
+
+    // Returns true if this call is the one that marked the node.
+    bool shade(GcNode* node) {
+        std::atomic<bool>& mark = marks[static_cast<size_t>(node->refs)];
+        return !mark.load(std::memory_order_relaxed) && !mark.exchange(true, std::memory_order_relaxed);
+    }
+
+    void run() {
+        forEachNode([this](size_t i, size_t) {
+            long count = useCount(nodes[i]);
+            if (count == 0) count = INT32_MAX;
+            counts[i].store(static_cast<int32_t>(std::min<long>(count, INT32_MAX)), std::memory_order_relaxed);
+        });
+        forEachNode([this](size_t i, size_t) {
+            forEachReference(nodes[i], [this](GcNode* child) {
+                if (isOwned(child)) counts[static_cast<size_t>(child->refs)].fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            });
+        });
+
+        std::vector<std::vector<GcNode*>> stacks(threads);
+        forEachNode([this, &stacks](size_t i, size_t worker) {
+            if (counts[i].load(std::memory_order_relaxed) > 0 && shade(nodes[i])) {
+                stacks[worker].push_back(nodes[i]);
+                drain(worker, stacks[worker]);
+            }
+        });
+        for (size_t worker = 0; worker < threads; worker++) {
+            pool.submit([this, worker, &stacks] { steal(worker, stacks[worker]); });
+        }
+        pool.wait();
+
+        for (size_t i = 0; i < nodes.size(); i++) {
+            nodes[i]->refs = counts[i].load(std::memory_order_relaxed);
+            nodes[i]->marked = marks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    void drain(size_t worker, std::vector<GcNode*>& stack) {
+        while (!stack.empty()) {
+            GcNode* node = stack.back();
+            stack.pop_back();
+            forEachReference(node, [this, &stack](GcNode* child) {
+                if (isOwned(child) && shade(child)) stack.push_back(child);
+                return true;
+            });
+            if (stack.size() >= 2 * SHARE_BATCH) {
+                GrayQueue& queue = queues[worker];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.nodes.insert(queue.nodes.end(), stack.begin(), stack.begin() + SHARE_BATCH);
+                stack.erase(stack.begin(), stack.begin() + SHARE_BATCH);
+            }
+        }
+    }
+
+    // Takes back the worker's own queue or, if that is empty, half of
+    // another's.
+    bool take(size_t worker, std::vector<GcNode*>& stack) {
+        for (size_t i = 0; i < threads; i++) {
+            GrayQueue& queue = queues[(worker + i) % threads];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.nodes.empty()) continue;
+            if (i == 0) {
+                stack.insert(stack.end(), queue.nodes.begin(), queue.nodes.end());
+                queue.nodes.clear();
+            } else {
+                auto half = queue.nodes.begin() + static_cast<std::ptrdiff_t>((queue.nodes.size() + 1) / 2);
+                stack.insert(stack.end(), queue.nodes.begin(), half);
+                queue.nodes.erase(queue.nodes.begin(), half);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool anyQueued() {
+        for (GrayQueue& queue : queues) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.nodes.empty()) return true;
+        }
+        return false;
+    }
+
+    // Marks until every worker has run out of gray nodes. Only a queue's
+    // owner adds to it, and a worker only leaves with its own queue empty,
+    // so none are left behind.
+    void steal(size_t worker, std::vector<GcNode*>& stack) {
+        drain(worker, stack);
+        for (;;) {
+            if (take(worker, stack)) {
+                drain(worker, stack);
+                continue;
+            }
+            busy.fetch_sub(1);
+            for (;;) {
+                if (anyQueued()) {
+                    busy.fetch_add(1);
+                    break;
+                }
+                if (busy.load() == 0) return;
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+// The workers every collector in the process marks with, started by the
+// first parallel collection. Each collection already keeps every core
+// busy, so only one uses them at a time; a collector that finds them
+// taken marks on its own thread instead.
+struct MarkingPool {
+    size_t threads = ThreadPool::defaultThreadCount();
+    ThreadPool pool{threads};
+    std::mutex inUse;
+};
+
+// Never destroyed, so that collectors torn down at exit can still use it.
+static MarkingPool& markingPool() {
+    static MarkingPool* pool = new MarkingPool;
+    return *pool;
+}
+
+// Runs the whole of a collection begin() has just started with the program
+// stopped, counting and marking on every core. Returns false without doing
+// anything where that wouldn't pay off, on small heaps and single-core
+// machines, or while another collector has the marking pool.
+bool GarbageCollector::collectInParallel() {
+    if (ThreadPool::defaultThreadCount() < 2 || nodeCount < PARALLEL_MIN_NODES || nodeCount > INT32_MAX) {
+        return false;
+    }
+    MarkingPool& marking = markingPool();
+    std::unique_lock<std::mutex> taken(marking.inUse, std::try_to_lock);
+    if (!taken.owns_lock()) return false;
+
+    if (log != nullptr) event.mode = "parallel";
+    ParallelMark(*this, marking.pool, marking.threads).run();
+    taken.unlock();
+    for (GcNode* node = head; node != nullptr; node = node->next) {
+        if (!node->marked) candidates.emplace_back(node, lock(node));
+    }
+    finish();
+    return true;
+}
+
+// Resets a node's scratch state the first time a collection looks at it.
+void GarbageCollector::touch(GcNode* node) {
+    if (node->cycle == cycle) return;
+    node->cycle = cycle;
+    node->refs = 0;
+    node->marked = false;
+}
+
+void GarbageCollector::mark(GcNode* node) {
+    touch(node);
+    if (node->marked) return;
+    node->marked = true;
+    // Held while gray, so the program can't free it between slices.
+    std::shared_ptr<void> gray = lock(node);
+    if (gray != nullptr) grayStack.push_back(std::move(gray));
+}
+
+long GarbageCollector::useCount(GcNode* node) {
+    switch (node->kind) {
+        case GcNode::Kind::OBJECT: return static_cast<LoxObject*>(node)->weak_from_this().use_count();
+        case GcNode::Kind::ENVIRONMENT: return static_cast<Environment*>(node)->weak_from_this().use_count();
+        case GcNode::Kind::UPVALUE: return static_cast<LoxUpvalue*>(node)->weak_from_this().use_count();
+    }
+    return 0;
+}
+
+// The shared_ptrs are aliased to point at the node itself.
+std::shared_ptr<void> GarbageCollector::lock(GcNode* node) {
+    switch (node->kind) {
+        case GcNode::Kind::OBJECT: {
+            std::shared_ptr<LoxObject> object = static_cast<LoxObject*>(node)->weak_from_this().lock();
+            return std::shared_ptr<void>(object, object != nullptr ? node : nullptr);
+        }
+        case GcNode::Kind::ENVIRONMENT: {
+            std::shared_ptr<Environment> environment = static_cast<Environment*>(node)->weak_from_this().lock();
+            return std::shared_ptr<void>(environment, environment != nullptr ? node : nullptr);
+        }
+        case GcNode::Kind::UPVALUE: {
+            std::shared_ptr<LoxUpvalue> upvalue = static_cast<LoxUpvalue*>(node)->weak_from_this().lock();
+            return std::shared_ptr<void>(upvalue, upvalue != nullptr ? node : nullptr);
+        }
+    }
+    return nullptr;
+}
+
+// Calls `visit` once for every reference a node holds to another node, in
+// the same order each time, until it returns false. Returns whether it got
+// through all of them. It must see exactly the references the node owns:
+// one it missed only keeps garbage alive, but one it made up could get a
+// live node freed.
+template <typename Visit>
+bool GarbageCollector::forEachReference(GcNode* node, Visit&& visit) {
+    auto visitValue = [&](const Value& value) {
+        return !value.isObject() || value.asObject() == nullptr || visit(value.asObject().get());
+    };
+
+    switch (node->kind) {
+        case GcNode::Kind::ENVIRONMENT: {
+            auto* environment = static_cast<Environment*>(node);
+            if (environment->enclosing != nullptr && !visit(environment->enclosing.get())) return false;
+            for (const auto& slot : environment->values) {
+                if (!visitValue(slot.value)) return false;
+            }
+            return true;
+        }
+        case GcNode::Kind::UPVALUE:
+            return visitValue(static_cast<LoxUpvalue*>(node)->closed);
+        case GcNode::Kind::OBJECT:
+            break;
+    }
+
+    auto* object = static_cast<LoxObject*>(node);
+    switch (object->type()) {
+        case ObjType::FUNCTION: {
+            auto* function = static_cast<LoxFunction*>(object);
+            if (function->globals != nullptr && !visit(function->globals.get())) return false;
+            for (const auto& upvalue : function->upvalues) {
+                if (upvalue != nullptr && !visit(upvalue.get())) return false;
+            }
+            return true;
+        }
+        case ObjType::NATIVE:
+            // A native's captures are opaque, and keep what they hold alive.
+            return true;
+        case ObjType::BOUND_NATIVE: {
+            auto* bound = static_cast<BoundNative*>(object);
+            return bound->receiver == nullptr || visit(bound->receiver.get());
+        }
+        case ObjType::BOUND_METHOD: {
+            auto* bound = static_cast<LoxBoundMethod*>(object);
+            if (bound->receiver != nullptr && !visit(bound->receiver.get())) return false;
+            return bound->method == nullptr || visit(bound->method.get());
+        }
+        case ObjType::CLASS: {
+            auto* klass = static_cast<LoxClass*>(object);
+            if (klass->superclass != nullptr && !visit(klass->superclass.get())) return false;
+            for (const auto& method : klass->methods) {
+                if (method.value != nullptr && !visit(method.value.get())) return false;
+            }
+            return true;
+        }
+        case ObjType::INSTANCE: {
+            auto* instance = static_cast<LoxInstance*>(object);
+            if (instance->klass != nullptr && !visit(instance->klass.get())) return false;
+            for (const auto& field : instance->fields) {
+                if (!visitValue(field.value)) return false;
+            }
+            return true;
+        }
+        case ObjType::MODULE: {
+            auto* module = static_cast<LoxModule*>(object);
+            return module->environment == nullptr || visit(module->environment.get());
+        }
+        case ObjType::LIST:
+            for (const Value& element : static_cast<LoxList*>(object)->elements) {
+                if (!visitValue(element)) return false;
+            }
+            return true;
+        case ObjType::MAP:
+            for (const auto& entry : static_cast<LoxMap*>(object)->getEntries()) {
+                if (!visitValue(entry.key) || !visitValue(entry.value)) return false;
+            }
+            return true;
+        case ObjType::STRING_BUILDER:
+            return true;
+    }
+    return true;
+}
+
+void GarbageCollector::clearReferences(GcNode* node) {
+    switch (node->kind) {
+        case GcNode::Kind::ENVIRONMENT: {
+            auto* environment = static_cast<Environment*>(node);
+            environment->values.clear();
+            environment->enclosing.reset();
+            return;
+        }
+        case GcNode::Kind::UPVALUE:
+            static_cast<LoxUpvalue*>(node)->closed = Value();
+            return;
+        case GcNode::Kind::OBJECT:
+            break;
+    }
+
+    auto* object = static_cast<LoxObject*>(node);
+    switch (object->type()) {
+        case ObjType::FUNCTION: {
+            auto* function = static_cast<LoxFunction*>(object);
+            function->globals.reset();
+            function->upvalues.clear();
+            break;
+        }
+        case ObjType::NATIVE:
+            break;
+        case ObjType::BOUND_NATIVE:
+            static_cast<BoundNative*>(object)->receiver.reset();
+            break;
+        case ObjType::BOUND_METHOD: {
+            auto* bound = static_cast<LoxBoundMethod*>(object);
+            bound->receiver.reset();
+            bound->method.reset();
+            break;
+        }
+        case ObjType::CLASS: {
+            auto* klass = static_cast<LoxClass*>(object);
+            klass->superclass.reset();
+            klass->methods.clear();
+            klass->initializer = nullptr;
+            break;
+        }
+        case ObjType::INSTANCE: {
+            auto* instance = static_cast<LoxInstance*>(object);
+            instance->klass.reset();
+            instance->fields.clear();
+            break;
+        }
+        case ObjType::MODULE:
+            static_cast<LoxModule*>(object)->environment.reset();
+            break;
+        case ObjType::LIST:
+            static_cast<LoxList*>(object)->elements.clear();
+            break;
+        case ObjType::MAP:
+            static_cast<LoxMap*>(object)->clear();
+            break;
+        case ObjType::STRING_BUILDER:
+            break;
+    }
+}
@@ -1,49 +1,206 @@
 #pragma once
 
-#include <vector>
+#include <chrono>
+#include <cstdint>
 #include <memory>
-#include "../common/value.h"
+#include <vector>
+
+#include "gc_log.h"
+
+class GarbageCollector;
+
+// Anything that can hold references, and so be part of a reference cycle:
+// Lox objects, environments and upvalues. Reference counting frees
+// everything else; the collector only has to find cycles that nothing
+// outside them refers to. A node created while a collector is active on
+// its thread links itself into that collector's list, and unlinks when it
+// is destroyed.
+class GcNode {
+public:
+    enum class Kind : unsigned char { OBJECT, ENVIRONMENT, UPVALUE };
+
+    GcNode(const GcNode&) = delete;
+    GcNode& operator=(const GcNode&) = delete;
+
+protected:
+    explicit GcNode(Kind kind, unsigned char tag = 0);
+    ~GcNode();
 
-class GarbageCollector {
 private:
-    static const size_t GC_HEAP_GROW_FACTOR = 2;
-    
-    std::vector<std::shared_ptr<LoxObject>> objects;
-    size_t bytesAllocated;
-    size_t nextGC;
-    
-    std::vector<Value*> grayStack;
-    
-    void markRoots();
-    void traceReferences();
-    void blackenObject(std::shared_ptr<LoxObject> object);
-    void markValue(Value value);
-    void markObject(std::shared_ptr<LoxObject> object);
-    void sweep();
-    void freeObjects();
+    friend class GarbageCollector;
+
+    GarbageCollector* owner = nullptr;
+    GcNode* prev = nullptr;
+    GcNode* next = nullptr;
+    // Scratch state of the collection numbered `cycle`; stale otherwise.
+    uint32_t cycle = 0;
+    int32_t refs = 0;     // references from outside the collector's nodes
+    uint32_t bytes = 0;   // of its allocation, when it came from makePooled
+    bool marked = false;  // known to be reachable
+    const Kind kind;
 
+protected:
+    // A subclass's own type tag, kept in what would otherwise be padding.
+    const unsigned char tag;
+};
+
+// Collects garbage reference cycles: closures that refer to themselves,
+// lists that contain themselves, every global function of a module that
+// has been dropped. A collection counts each node's references, subtracts
+// the ones coming from other nodes, and marks everything reachable from
+// nodes with references left over. What stays unmarked can only be reached
+// from itself; the collector clears its references and reference counting
+// frees it.
+//
+// By default a collection runs in one go once enough nodes have been
+// created, counting and marking large heaps on every core. With a pause
+// target it is incremental instead: counting and
+// marking proceed in slices of at most that long, interleaved with the
+// program, and only the last step, which re-checks the unmarked nodes
+// against their current reference counts, holds the program up for longer.
+// That step is exact, so nothing the program changed between slices can
+// get a live node freed; write barriers on stores into fields, globals,
+// collections and upvalues mark the stored value, which keeps the set of
+// nodes it re-checks small.
+//
+// Either way the garbage is freed lazily, a slice at a time at the
+// safepoints that follow, and the next collection starts once it is all
+// gone.
+class GarbageCollector {
 public:
+    // The collector of the isolate running on this thread, if any.
+    static thread_local GarbageCollector* current;
+    // Set while an incremental collection is marking on this thread.
+    static thread_local GarbageCollector* marking;
+
+    // Makes a collector current on this thread for its lifetime.
+    class Scope {
+    private:
+        GarbageCollector* previous;
+
+    public:
+        explicit Scope(GarbageCollector& collector) : previous(current) { current = &collector; }
+        ~Scope() { current = previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
     GarbageCollector();
     ~GarbageCollector();
-    
-    void collectGarbage();
-    void* allocate(size_t size);
-    void* reallocate(void* pointer, size_t oldSize, size_t newSize);
-    void free(void* pointer, size_t size);
-    
-    // Object tracking
-    void addObject(std::shared_ptr<LoxObject> object);
-    void removeObject(std::shared_ptr<LoxObject> object);
-    
+    GarbageCollector(const GarbageCollector&) = delete;
+    GarbageCollector& operator=(const GarbageCollector&) = delete;
+
+    // The interpreter calls this between statements and calls, where no
+    // object is held only by a raw pointer. Cheap unless a collection or
+    // slice is due.
+    void safepoint() {
+        if (due) step();
+    }
+    // Runs a whole collection now, finishing one in progress.
+    void collect(const char* cause = "explicit");
+
+    // 0 collects in one go; otherwise collections run in slices of about
+    // this long.
+    void setPauseTarget(std::chrono::microseconds target) { pauseTarget = target; }
+    // Collects at every safepoint, to shake out missing references.
+    void enableStressGC(bool enable) { stressGC = enable; due = due || enable; }
+    // Writes an event to `log` for every collection from now on.
+    void setLog(GcLog* log);
+
+    void shade(GcNode* node) {
+        if (node->owner == this) mark(node);
+    }
+
+    // Caps the bytes the nodes may take up; 0 lifts the cap. Collections
+    // start early as the heap nears it, and an allocation that goes over
+    // it throws LoxError.
+    void setMaxHeap(size_t bytes);
+
+    // Charges a node's allocation to its collector, for as long as it lives.
+    static void account(GcNode* node, size_t bytes) {
+        node->bytes = static_cast<uint32_t>(bytes);
+        GarbageCollector* owner = node->owner;
+        if (owner == nullptr) return;
+        owner->bytesAllocated += bytes;
+        if (owner->bytesAllocated >= owner->nextGCBytes) owner->heapFull();
+    }
+
     // Statistics
+    size_t getObjectCount() const { return nodeCount; }
     size_t getBytesAllocated() const { return bytesAllocated; }
     size_t getNextGC() const { return nextGC; }
-    size_t getObjectCount() const { return objects.size(); }
-    
-    // Debugging
-    void printStats();
-    void enableStressGC(bool enable);
-    
+    size_t getMaxHeap() const { return maxHeap; }
+    size_t getCollections() const { return collections; }
+    size_t getFreed() const { return freed; }
+
 private:
+    friend class GcNode;
+
+    enum class Phase : unsigned char { IDLE, COUNT, MARK, GATHER };
+
+    static constexpr size_t GC_HEAP_GROW_FACTOR = 2;
+    static constexpr size_t MIN_NEXT_GC = 10000;    // nodes
+    static constexpr size_t SLICE_INTERVAL = 1000;  // nodes created between slices
+    static constexpr size_t SWEEP_SLICE = 1000;     // nodes freed per safepoint
+    static constexpr size_t PARALLEL_MIN_NODES = 100000;
+
+    GcNode* head = nullptr;
+    size_t nodeCount = 0;
+    size_t bytesAllocated = 0;  // by the nodes on the list, control blocks included
+    size_t created = 0;  // since the last collection or slice
+    size_t nextGC = MIN_NEXT_GC;
+    size_t maxHeap = 0;                // bytes; 0 for no cap
+    size_t nextGCBytes = SIZE_MAX;  // collect early above this, under a cap
+    bool due = false;
     bool stressGC = false;
-};
\ No newline at end of file
+    std::chrono::microseconds pauseTarget{0};
+
+    Phase phase = Phase::IDLE;
+    uint32_t cycle = 0;
+    GcNode* cursor = nullptr;  // next node the running phase looks at
+    // A node whose references a slice stopped partway through, and how
+    // many of them it had got through.
+    std::shared_ptr<void> partial;
+    size_t partialDone = 0;
+    std::chrono::steady_clock::time_point deadline;  // of the running slice
+    int untilClock = 0;
+    std::vector<std::shared_ptr<void>> grayStack;   // marked, children not yet
+    std::vector<std::pair<GcNode*, std::shared_ptr<void>>> candidates;  // unmarked when gathered
+    std::vector<std::pair<GcNode*, std::shared_ptr<void>>> sweepQueue;  // garbage not yet freed
+    size_t swept = 0;
+
+    size_t collections = 0;
+    size_t freed = 0;
+
+    GcLog* log = nullptr;
+    int isolate = 0;  // in the log
+    GcEvent event;    // of the collection in progress, when logging
+
+    void link(GcNode* node);
+    void unlink(GcNode* node);
+    void heapFull();
+
+    void step();
+    // Returns true once the collection is complete, or false if the slice
+    // ran out of time first.
+    bool advance();
+    bool outOfTime();
+    void begin(const char* cause);
+    void finish();
+
+    void touch(GcNode* node);
+    void mark(GcNode* node);
+    template <typename Visit>
+    bool scan(GcNode* node, Visit&& visit);
+    void sweep(size_t limit);
+    void complete();
+    void logPause(double GcEvent::*time, std::chrono::steady_clock::time_point start);
+    struct ParallelMark;
+    bool collectInParallel();
+
+    static long useCount(GcNode* node);
+    static std::shared_ptr<void> lock(GcNode* node);
+    template <typename Visit>
+    static bool forEachReference(GcNode* node, Visit&& visit);
+    static void clearReferences(GcNode* node);
+};
@@ -0,0 +1,86 @@
+#include "gc_log.h"
+#include "allocator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Milliseconds with microsecond precision
+static std::string formatTime(double milliseconds) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", milliseconds);
+    return buffer;
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * static_cast<double>(sorted.size())));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+GcLog::GcLog(const std::string& path) : file(path), epoch(std::chrono::steady_clock::now()) {}
+
+int GcLog::attach() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ++isolates;
+}
+
+double GcLog::now() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void GcLog::recordPause(double milliseconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pauses.push_back(milliseconds);
+}
+
+void GcLog::write(const GcEvent& event) {
+    std::string line = "{\"event\": \"collection\", \"isolate\": " + std::to_string(event.isolate) +
+                       ", \"collection\": " + std::to_string(event.collection) +
+                       ", \"cause\": \"" + event.cause + "\", \"mode\": \"" + event.mode +
+                       "\", \"start_ms\": " + formatTime(event.start) +
+                       ", \"end_ms\": " + formatTime(event.end) +
+                       ", \"mark_ms\": " + formatTime(event.markTime) +
+                       ", \"sweep_ms\": " + formatTime(event.sweepTime) +
+                       ", \"pauses\": " + std::to_string(event.pauses) +
+                       ", \"longest_pause_ms\": " + formatTime(event.longestPause) +
+                       ", \"nodes_before\": " + std::to_string(event.nodesBefore) +
+                       ", \"nodes_after\": " + std::to_string(event.nodesAfter) +
+                       ", \"bytes_before\": " + std::to_string(event.bytesBefore) +
+                       ", \"bytes_after\": " + std::to_string(event.bytesAfter) +
+                       ", \"freed\": " + std::to_string(event.freed) +
+                       ", \"released_bytes\": " + std::to_string(event.releasedBytes) +
+                       ", \"next_gc\": " + std::to_string(event.nextGC) + ", \"types\": {";
+    for (size_t i = 0; i < event.types.size(); i++) {
+        if (i > 0) line += ", ";
+        line += std::string("\"") + event.types[i].first + "\": " + std::to_string(event.types[i].second);
+    }
+    line += "}}\n";
+
+    std::lock_guard<std::mutex> lock(mutex);
+    collections++;
+    file << line << std::flush;
+}
+
+std::string GcLog::summarize() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<double> sorted = pauses;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double pause : sorted) total += pause;
+    double max = sorted.empty() ? 0 : sorted.back();
+
+    file << "{\"event\": \"summary\", \"collections\": " << collections << ", \"pauses\": " << sorted.size()
+         << ", \"total_pause_ms\": " << formatTime(total)
+         << ", \"p50_ms\": " << formatTime(percentile(sorted, 50))
+         << ", \"p90_ms\": " << formatTime(percentile(sorted, 90))
+         << ", \"p99_ms\": " << formatTime(percentile(sorted, 99))
+         << ", \"max_ms\": " << formatTime(max) << ", \"slab_bytes\": " << SlabAllocator::getSlabBytes()
+         << ", \"mapped_bytes\": " << SlabAllocator::getMappedBytes() << "}"
+         << std::endl;
+
+    return "gc: " + std::to_string(collections) + " collections, " + std::to_string(sorted.size()) +
+           " pauses totalling " + formatTime(total) + " ms; p50 " + formatTime(percentile(sorted, 50)) +
+           " ms, p90 " + formatTime(percentile(sorted, 90)) + " ms, p99 " + formatTime(percentile(sorted, 99)) +
+           " ms, max " + formatTime(max) + " ms";
+}
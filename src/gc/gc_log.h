@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// What one collection did, from the start of its first slice to the end of
+// its sweep. Times are in milliseconds; start and end count from when the
+// log was opened.
+struct GcEvent {
+    int isolate = 0;
+    size_t collection = 0;
+    const char* cause = "";  // "heap", "stress", "explicit" or "teardown"
+    const char* mode = "";   // "full", "parallel" or "incremental"
+    double start = 0;
+    double end = 0;
+    double markTime = 0;   // counting, marking and checking candidates
+    double sweepTime = 0;  // freeing the garbage
+    size_t pauses = 0;
+    double longestPause = 0;
+    size_t nodesBefore = 0;
+    size_t nodesAfter = 0;
+    size_t bytesBefore = 0;  // allocated by the nodes
+    size_t bytesAfter = 0;
+    size_t releasedBytes = 0;  // of empty slabs, after the sweep
+    size_t freed = 0;
+    size_t nextGC = 0;
+    // Nodes by type when the collection started
+    std::vector<std::pair<const char*, size_t>> types;
+};
+
+// A JSON Lines log of collections (lox --gc-log), shared by every isolate
+// of a run. Each collection is one line; the pauses are also kept, for the
+// summary written when the run ends.
+class GcLog {
+private:
+    std::mutex mutex;
+    std::ofstream file;
+    std::chrono::steady_clock::time_point epoch;
+    std::vector<double> pauses;
+    size_t collections = 0;
+    int isolates = 0;
+
+public:
+    explicit GcLog(const std::string& path);
+    bool isOpen() const { return file.is_open(); }
+
+    // Numbers the isolates, to tell their events apart.
+    int attach();
+    double now() const;
+
+    void recordPause(double milliseconds);
+    void write(const GcEvent& event);
+    // Writes a summary line with the pause percentiles and returns it in a
+    // form for people.
+    std::string summarize();
+};
@@ -0,0 +1,192 @@
+#include "builtins.h"
+#include "callable.h"
+#include "interpreter.h"
+#include "../common/collections.h"
+#include "../common/error.h"
+
+static LoxStringBuilder& builder(const std::shared_ptr<LoxObject>& receiver) {
+    return static_cast<LoxStringBuilder&>(*receiver);
+}
+
+static Value builderAppend(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    if (args[0].isString()) {
+        builder(receiver).buffer += args[0].asString();
+    } else {
+        builder(receiver).buffer += args[0].toString();
+    }
+    return Value(receiver);
+}
+
+static Value builderToString(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    return Value(builder(receiver).buffer);
+}
+
+static Value builderLength(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    return Value(static_cast<double>(builder(receiver).buffer.size()));
+}
+
+static Value builderClear(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    builder(receiver).buffer.clear();
+    return Value(receiver);
+}
+
+struct BuiltinMethod {
+    const char* name;
+    int arity;
+    NativeMethod method;
+};
+
+static const BuiltinMethod builderMethods[] = {
+    {"append", 1, builderAppend},
+    {"toString", 0, builderToString},
+    {"length", 0, builderLength},
+    {"clear", 0, builderClear},
+};
+
+static std::vector<Value>& elements(const std::shared_ptr<LoxObject>& receiver) {
+    return static_cast<LoxList&>(*receiver).elements;
+}
+
+static Value listPush(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    writeBarrier(args[0]);
+    elements(receiver).push_back(args[0]);
+    return Value();
+}
+
+static Value listPop(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    std::vector<Value>& list = elements(receiver);
+    if (list.empty()) throw LoxError("Can't pop from an empty list.");
+    Value last = std::move(list.back());
+    list.pop_back();
+    return last;
+}
+
+static Value listInsert(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    std::vector<Value>& list = elements(receiver);
+    size_t index = LoxList::checkIndex(args[0], list.size() + 1);
+    writeBarrier(args[1]);
+    list.insert(list.begin() + static_cast<std::ptrdiff_t>(index), args[1]);
+    return Value();
+}
+
+static Value listRemoveAt(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    std::vector<Value>& list = elements(receiver);
+    size_t index = LoxList::checkIndex(args[0], list.size());
+    Value removed = std::move(list[index]);
+    list.erase(list.begin() + static_cast<std::ptrdiff_t>(index));
+    return removed;
+}
+
+static Value listLength(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    return Value(static_cast<double>(elements(receiver).size()));
+}
+
+static LoxMap& map(const std::shared_ptr<LoxObject>& receiver) {
+    return static_cast<LoxMap&>(*receiver);
+}
+
+static Value mapHas(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    return Value(map(receiver).get(args[0]) != nullptr);
+}
+
+static Value mapRemove(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    return Value(map(receiver).remove(args[0]));
+}
+
+static Value mapKeys(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    auto keys = makePooled<LoxList>();
+    keys->elements.reserve(map(receiver).size());
+    for (const LoxMap::Entry& entry : map(receiver).getEntries()) {
+        if (!entry.removed) keys->elements.push_back(entry.key);
+    }
+    return Value(std::static_pointer_cast<LoxObject>(keys));
+}
+
+static Value mapValues(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    auto values = makePooled<LoxList>();
+    values->elements.reserve(map(receiver).size());
+    for (const LoxMap::Entry& entry : map(receiver).getEntries()) {
+        if (!entry.removed) values->elements.push_back(entry.value);
+    }
+    return Value(std::static_pointer_cast<LoxObject>(values));
+}
+
+static Value mapLength(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    return Value(static_cast<double>(map(receiver).size()));
+}
+
+static const BuiltinMethod listMethods[] = {
+    {"push", 1, listPush},
+    {"pop", 0, listPop},
+    {"insert", 2, listInsert},
+    {"removeAt", 1, listRemoveAt},
+    {"length", 0, listLength},
+};
+
+static const BuiltinMethod mapMethods[] = {
+    {"has", 1, mapHas},
+    {"remove", 1, mapRemove},
+    {"keys", 0, mapKeys},
+    {"values", 0, mapValues},
+    {"length", 0, mapLength},
+};
+
+template <size_t N>
+static Value bindMethod(const std::shared_ptr<LoxObject>& self, const Token& name,
+                        const BuiltinMethod (&methods)[N]) {
+    for (const BuiltinMethod& method : methods) {
+        if (name.lexeme == method.name) {
+            auto bound = makePooled<BoundNative>(self, method.name, method.arity, method.method);
+            return Value(std::static_pointer_cast<LoxObject>(bound));
+        }
+    }
+    throw RuntimeError(name, "Undefined property '" + name.lexeme + "'.");
+}
+
+Value LoxStringBuilder::get(const std::shared_ptr<LoxObject>& self, const Token& name) {
+    return bindMethod(self, name, builderMethods);
+}
+
+Value collectionMethod(const std::shared_ptr<LoxObject>& self, const Token& name) {
+    if (self->type() == ObjType::LIST) return bindMethod(self, name, listMethods);
+    return bindMethod(self, name, mapMethods);
+}
+
+void defineBuiltins(Interpreter& interpreter) {
+    OutputBuffer& out = interpreter.getOutput();
+    interpreter.defineNative("flush", 0, [&out](int, Value*) {
+        out.flush();
+        return Value();
+    });
+    interpreter.defineNative("List", 0, [](int, Value*) {
+        return Value(std::static_pointer_cast<LoxObject>(makePooled<LoxList>()));
+    });
+    interpreter.defineNative("Map", 0, [](int, Value*) {
+        return Value(std::static_pointer_cast<LoxObject>(makePooled<LoxMap>()));
+    });
+    interpreter.defineNative("StringBuilder", 0, [](int, Value*) {
+        return Value(std::static_pointer_cast<LoxObject>(makePooled<LoxStringBuilder>()));
+    });
+}
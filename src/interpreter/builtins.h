@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "../common/value.h"
+#include "../common/token.h"
+
+class Interpreter;
+
+// Growable buffer for assembling long output. `append` copies only the
+// appended text, where `s = s + x` would at best build a rope node.
+//
+//     var out = StringBuilder();
+//     out.append("total: ").append(42);
+//     print out.toString();
+class LoxStringBuilder : public LoxObject {
+public:
+    std::string buffer;
+    
+    LoxStringBuilder() : LoxObject(ObjType::STRING_BUILDER) {}
+    
+    std::string toString() const override { return "<StringBuilder>"; }
+    
+    // Looks up a method and binds it to `self`, which must be a builder.
+    static Value get(const std::shared_ptr<LoxObject>& self, const Token& name);
+};
+
+// Looks up a method of a List or Map and binds it to `self`.
+Value collectionMethod(const std::shared_ptr<LoxObject>& self, const Token& name);
+
+// Defines the natives every interpreter starts with.
+void defineBuiltins(Interpreter& interpreter);
@@ -0,0 +1,438 @@
+#include "interpreter.h"
+#include "../common/collections.h"
+#include "../common/error.h"
+#include "../vm/ast_compiler.h"
+
+// Counts a call of a function in tiered mode and returns its bytecode once
+// it is hot, compiling it on the way if this call is what made it hot.
+// Returns null while the function should stay in the tree-walker.
+CompiledFunction* Interpreter::tierUp(FunctionStmt& function) {
+    CompiledFunction* code = function.compiled.load(std::memory_order_acquire);
+    if (code != nullptr) return code;
+
+    unsigned hotness = function.hotness.load(std::memory_order_relaxed) + 1;
+    function.hotness.store(hotness, std::memory_order_relaxed);
+    if (hotness < tierUpThreshold || function.uncompilable.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    std::unique_ptr<CompiledFunction> compiled = AstCompiler::compile(function);
+    if (compiled == nullptr) {
+        function.uncompilable.store(true, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return install(function.compiled, std::move(compiled));
+}
+
+// Pops a value. Only references need clearing; a stale number or boolean
+// above the stack top keeps nothing alive.
+static inline void drop(Value& value) {
+    if (value.isObject() || value.isString()) value = Value();
+}
+
+// Quickening rewrites instructions while other isolates may be running the
+// same code, so the bytes it rewrites, opcodes and field caches, are read
+// and written as relaxed atomics. Every form of an instruction is correct
+// for any operands, so an isolate that still sees the old one only runs it
+// more slowly.
+static inline unsigned char load(const unsigned char* byte) {
+    return __atomic_load_n(byte, __ATOMIC_RELAXED);
+}
+
+static inline void rewrite(unsigned char* byte, unsigned char value) {
+    __atomic_store_n(byte, value, __ATOMIC_RELAXED);
+}
+
+static inline void quicken(unsigned char* op, OpCode form) {
+    rewrite(op, static_cast<unsigned char>(form));
+}
+
+// The _NUM and _GENERIC forms of the operators from OP_GREATER to
+// OP_DIVIDE are listed in the same order as the operators themselves.
+static_assert(static_cast<int>(OpCode::OP_DIVIDE) - static_cast<int>(OpCode::OP_GREATER) ==
+                  static_cast<int>(OpCode::OP_DIVIDE_NUM) - static_cast<int>(OpCode::OP_GREATER_NUM) &&
+              static_cast<int>(OpCode::OP_DIVIDE) - static_cast<int>(OpCode::OP_GREATER) ==
+                  static_cast<int>(OpCode::OP_DIVIDE_GENERIC) - static_cast<int>(OpCode::OP_GREATER_GENERIC),
+              "quickened operators out of order");
+
+static inline OpCode formOf(OpCode op, OpCode first) {
+    return static_cast<OpCode>(static_cast<int>(op) - static_cast<int>(OpCode::OP_GREATER) + static_cast<int>(first));
+}
+
+// Runs a function's bytecode in the frame callFunction set up for it.
+// Returns its result, or nil after leaving a tail call in tailCallee.
+Value Interpreter::run(CompiledFunction& code) {
+    if (code.maxStack > stack.data() + STACK_MAX - stackTop) {
+        throw LoxError("Stack overflow.");
+    }
+
+    unsigned char* start = code.chunk.getRewritableCode();
+    unsigned char* ip = start;
+    const Value* constants = code.chunk.getConstants().data();
+    Value* slots = frame;
+    Value* sp = stackTop;
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, static_cast<unsigned short>((ip[-2] << 8) | ip[-1]))
+// The token of the instruction just read, for errors and name lookups.
+#define SITE() (*code.tokens[ip - start - 1])
+// Locals and constants are read in place as operands `a` and `b`. The
+// result, left in `*result` by the body, replaces the lower operand on the
+// stack, or is pushed if neither was on the stack.
+#define BINARY(...)                                                         \
+    do {                                                                    \
+        [[maybe_unused]] unsigned char* op = ip - 1;                        \
+        int kinds = READ_BYTE();                                            \
+        const Value* a = operand(static_cast<OperandKind>(kinds >> 4));     \
+        const Value* b = operand(static_cast<OperandKind>(kinds & 0xf));    \
+        int stacked = (a == nullptr) + (b == nullptr);                      \
+        if (b == nullptr) b = &sp[-1];                                      \
+        if (a == nullptr) a = &sp[-stacked];                                \
+        Value* result = sp - stacked;                                       \
+        __VA_ARGS__                                                         \
+        if (stacked == 2) drop(sp[-1]);                                     \
+        sp = result + 1;                                                    \
+    } while (false)
+#define NUMBERS(number, other)                                              \
+    BINARY(                                                                 \
+        if (a->isNumber() && b->isNumber()) {                               \
+            double x = a->asNumber();                                       \
+            double y = b->asNumber();                                       \
+            *result = Value(number);                                        \
+        } else {                                                            \
+            other;                                                          \
+        })
+// A quickened operator, which goes generic the first time an operand
+// isn't a number.
+#define NUMBER_FORM(name, number)                                           \
+    case OpCode::name##_NUM:                                                \
+        NUMBERS(number, quicken(op, OpCode::name##_GENERIC); *result = binary(SITE(), *a, *b)); \
+        break;
+
+    auto operand = [&](OperandKind kind) -> const Value* {
+        switch (kind) {
+            case OperandKind::LOCAL: return &slots[READ_BYTE()];
+            case OperandKind::CONSTANT: return &constants[READ_BYTE()];
+            default: return nullptr;
+        }
+    };
+
+    try {
+        for (;;) {
+            OpCode instruction = static_cast<OpCode>(load(ip++));
+            switch (instruction) {
+                case OpCode::OP_CONSTANT: *sp++ = constants[READ_BYTE()]; break;
+                case OpCode::OP_NIL: *sp++ = Value(); break;
+                case OpCode::OP_TRUE: *sp++ = Value(true); break;
+                case OpCode::OP_FALSE: *sp++ = Value(false); break;
+                case OpCode::OP_POP: drop(*--sp); break;
+
+                case OpCode::OP_GET_LOCAL: *sp++ = slots[READ_BYTE()]; break;
+                case OpCode::OP_SET_LOCAL: slots[READ_BYTE()] = sp[-1]; break;
+                case OpCode::OP_STORE_LOCAL: slots[READ_BYTE()] = std::move(*--sp); break;
+                case OpCode::OP_GET_UPVALUE: *sp++ = *upvalues[READ_BYTE()]->location; break;
+                case OpCode::OP_SET_UPVALUE:
+                    writeBarrier(sp[-1]);
+                    *upvalues[READ_BYTE()]->location = sp[-1];
+                    break;
+                case OpCode::OP_GET_GLOBAL:
+                    ip++;  // the name constant; SITE() is its token
+                    *sp++ = environment->get(SITE());
+                    break;
+                case OpCode::OP_SET_GLOBAL:
+                    ip++;  // the name constant; SITE() is its token
+                    environment->assign(SITE(), sp[-1]);
+                    break;
+
+                // The first run caches where the instance keeps the field, if
+                // it is one, in the instruction's last byte.
+                case OpCode::OP_GET_PROPERTY: {
+                    unsigned char* op = ip - 1;
+                    ip += 2;  // the name constant and field cache; SITE() is their token
+                    size_t slot = SIZE_MAX;
+                    if (sp[-1].isObjType(ObjType::INSTANCE)) {
+                        slot = static_cast<LoxInstance*>(sp[-1].asObject().get())->fieldSlot(SITE());
+                    }
+                    if (slot <= UINT8_MAX) {
+                        rewrite(ip - 1, static_cast<unsigned char>(slot));
+                        quicken(op, OpCode::OP_GET_PROPERTY_CACHED);
+                    } else {
+                        quicken(op, OpCode::OP_GET_PROPERTY_GENERIC);
+                    }
+                    sp[-1] = getProperty(sp[-1], SITE());
+                    break;
+                }
+                case OpCode::OP_GET_PROPERTY_CACHED: {
+                    unsigned char* op = ip - 1;
+                    ip += 2;
+                    if (sp[-1].isObjType(ObjType::INSTANCE)) {
+                        const Value* field = static_cast<LoxInstance*>(sp[-1].asObject().get())
+                                                 ->cachedField(load(ip - 1), SITE());
+                        if (field != nullptr) {
+                            Value value = *field;  // before the instance can go
+                            sp[-1] = std::move(value);
+                            break;
+                        }
+                    }
+                    quicken(op, OpCode::OP_GET_PROPERTY_GENERIC);
+                    sp[-1] = getProperty(sp[-1], SITE());
+                    break;
+                }
+                case OpCode::OP_GET_PROPERTY_GENERIC:
+                    ip += 2;
+                    sp[-1] = getProperty(sp[-1], SITE());
+                    break;
+                case OpCode::OP_SET_PROPERTY: {
+                    ip++;  // the name constant; SITE() is its token
+                    if (!sp[-2].isObjType(ObjType::INSTANCE)) {
+                        throw RuntimeError(SITE(), "Only instances have fields.");
+                    }
+                    static_cast<LoxInstance*>(sp[-2].asObject().get())->set(SITE(), sp[-1]);
+                    sp[-2] = std::move(sp[-1]);
+                    *--sp = Value();
+                    break;
+                }
+                case OpCode::OP_GET_METHOD: {
+                    ip++;  // the name constant; SITE() is its token
+                    LoxFunction* method = nullptr;
+                    if (sp[-1].isObjType(ObjType::INSTANCE)) {
+                        method = static_cast<LoxInstance*>(sp[-1].asObject().get())->findMethod(SITE());
+                    }
+                    if (method != nullptr) {
+                        *sp = std::move(sp[-1]);
+                        sp[-1] = Value(method->shared_from_this());
+                    } else {
+                        sp[-1] = getProperty(sp[-1], SITE());
+                        *sp = Value();
+                    }
+                    sp++;
+                    break;
+                }
+                case OpCode::OP_GET_SUPER:
+                    ip++;  // the name constant; SITE() is its token
+                    sp[-2] = superMethod(sp[-2], sp[-1], SITE());
+                    *--sp = Value();
+                    break;
+
+                // An operator's first run picks its number form if both
+                // operands are numbers, and its generic form if not.
+                case OpCode::OP_ADD:
+                case OpCode::OP_SUBTRACT:
+                case OpCode::OP_MULTIPLY:
+                case OpCode::OP_DIVIDE:
+                case OpCode::OP_GREATER:
+                case OpCode::OP_GREATER_EQUAL:
+                case OpCode::OP_LESS:
+                case OpCode::OP_LESS_EQUAL:
+                    BINARY(
+                        bool numbers = a->isNumber() && b->isNumber();
+                        quicken(op, formOf(instruction, numbers ? OpCode::OP_GREATER_NUM : OpCode::OP_GREATER_GENERIC));
+                        *result = binary(SITE(), *a, *b);
+                    );
+                    break;
+                NUMBER_FORM(OP_ADD, x + y)
+                NUMBER_FORM(OP_SUBTRACT, x - y)
+                NUMBER_FORM(OP_MULTIPLY, x * y)
+                NUMBER_FORM(OP_DIVIDE, x / y)
+                NUMBER_FORM(OP_GREATER, x > y)
+                NUMBER_FORM(OP_GREATER_EQUAL, x >= y)
+                NUMBER_FORM(OP_LESS, x < y)
+                NUMBER_FORM(OP_LESS_EQUAL, x <= y)
+                case OpCode::OP_ADD_GENERIC:
+                case OpCode::OP_SUBTRACT_GENERIC:
+                case OpCode::OP_MULTIPLY_GENERIC:
+                case OpCode::OP_DIVIDE_GENERIC:
+                case OpCode::OP_GREATER_GENERIC:
+                case OpCode::OP_GREATER_EQUAL_GENERIC:
+                case OpCode::OP_LESS_GENERIC:
+                case OpCode::OP_LESS_EQUAL_GENERIC:
+                    BINARY(*result = binary(SITE(), *a, *b););
+                    break;
+                // Equality is defined for any two values, so it has no
+                // checks to skip and isn't quickened.
+                case OpCode::OP_EQUAL: NUMBERS(x == y, *result = Value(isEqual(*a, *b))); break;
+                case OpCode::OP_NOT: sp[-1] = Value(!isTruthy(sp[-1])); break;
+                case OpCode::OP_NEGATE:
+                    checkNumberOperand(SITE(), sp[-1]);
+                    sp[-1] = Value(-sp[-1].asNumber());
+                    break;
+
+                case OpCode::OP_PRINT:
+                    print(sp[-1]);
+                    *--sp = Value();
+                    break;
+                case OpCode::OP_JUMP: {
+                    unsigned short offset = READ_SHORT();
+                    ip += offset;
+                    break;
+                }
+                case OpCode::OP_JUMP_IF_FALSE: {
+                    unsigned short offset = READ_SHORT();
+                    if (!isTruthy(sp[-1])) ip += offset;
+                    break;
+                }
+                case OpCode::OP_POP_JUMP_IF_FALSE: {
+                    unsigned short offset = READ_SHORT();
+                    if (!isTruthy(*--sp)) ip += offset;
+                    drop(*sp);
+                    break;
+                }
+                case OpCode::OP_LOOP: {
+                    unsigned short offset = READ_SHORT();
+                    ip -= offset;
+                    gc.safepoint();
+                    break;
+                }
+
+                // The callee sits below its arguments, which become the
+                // parameters of its frame in place.
+                case OpCode::OP_CALL: {
+                    int argCount = READ_BYTE();
+                    Value* args = sp - argCount;
+                    stackTop = sp;
+                    Value result = callValue(args[-1], argCount, args, SITE());
+                    while (sp > args) {
+                        *--sp = Value();
+                    }
+                    sp[-1] = std::move(result);
+                    stackTop = sp;
+                    break;
+                }
+                case OpCode::OP_TAIL_CALL: {
+                    int argCount = READ_BYTE();
+                    Value* args = sp - argCount;
+                    stackTop = sp;
+                    if (!args[-1].isObjType(ObjType::FUNCTION) || args[-1].asCallable()->arity() != argCount) {
+                        Value result = callValue(args[-1], argCount, args, SITE());
+                        while (sp > args - 1) {
+                            *--sp = Value();
+                        }
+                        stackTop = sp;
+                        return result;
+                    }
+                    // As in returnCall: the arguments move down to the
+                    // base of this frame, and callFunction runs the callee.
+                    tailCallee = std::move(args[-1]);
+                    tailArgCount = argCount;
+                    closeUpvalues(slots);
+                    std::move(args, sp, slots);
+                    std::fill(slots + argCount, sp, Value());
+                    stackTop = slots + argCount;
+                    return Value();
+                }
+
+                // Like OP_CALL, with a receiver slot between the callee and
+                // its arguments: a method's receiver, or nil for any other
+                // callee.
+                case OpCode::OP_INVOKE: {
+                    int argCount = READ_BYTE();
+                    Value* args = sp - argCount;
+                    stackTop = sp;
+                    Value result = args[-1].isNil()
+                        ? callValue(args[-2], argCount, args, SITE())
+                        : invoke(*static_cast<LoxFunction*>(args[-2].asCallable()), argCount, args - 1, SITE());
+                    while (sp > args - 1) {
+                        *--sp = Value();
+                    }
+                    sp[-1] = std::move(result);
+                    stackTop = sp;
+                    break;
+                }
+                case OpCode::OP_TAIL_INVOKE: {
+                    int argCount = READ_BYTE();
+                    Value* args = sp - argCount;
+                    Value* callee = args - 2;
+                    if (args[-1].isNil()) {
+                        // Not a method: the arguments close up over the slot.
+                        std::move(args, sp, args - 1);
+                        *--sp = Value();
+                        args--;
+                    }
+                    stackTop = sp;
+                    if (!callee->isObjType(ObjType::FUNCTION) || callee->asCallable()->arity() != argCount) {
+                        Value result = args == callee + 1
+                            ? callValue(*callee, argCount, args, SITE())
+                            : invoke(*static_cast<LoxFunction*>(callee->asCallable()), argCount, args - 1, SITE());
+                        while (sp > callee) {
+                            *--sp = Value();
+                        }
+                        stackTop = sp;
+                        return result;
+                    }
+                    // A method's receiver goes along as its first argument.
+                    if (args != callee + 1) {
+                        args--;
+                        argCount++;
+                    }
+                    tailCallee = std::move(*callee);
+                    tailArgCount = argCount;
+                    closeUpvalues(slots);
+                    std::move(args, sp, slots);
+                    std::fill(slots + argCount, sp, Value());
+                    stackTop = slots + argCount;
+                    return Value();
+                }
+
+                case OpCode::OP_CLOSURE:
+                    *sp++ = Value(makeClosure(*code.functions[READ_BYTE()], false));
+                    break;
+                case OpCode::OP_CLOSE_UPVALUE: closeUpvalues(slots + READ_BYTE()); break;
+                case OpCode::OP_RETURN: {
+                    Value result = std::move(*--sp);
+                    *sp = Value();
+                    stackTop = sp;
+                    return result;
+                }
+
+                case OpCode::OP_BUILD_LIST: {
+                    int count = READ_BYTE();
+                    auto list = makePooled<LoxList>();
+                    list->elements.reserve(count);
+                    for (Value* element = sp - count; element < sp; element++) {
+                        list->elements.push_back(std::move(*element));
+                        *element = Value();
+                    }
+                    sp -= count;
+                    *sp++ = Value(std::static_pointer_cast<LoxObject>(list));
+                    break;
+                }
+                case OpCode::OP_BUILD_MAP: {
+                    int count = READ_BYTE();
+                    auto map = makePooled<LoxMap>();
+                    for (Value* entry = sp - 2 * count; entry < sp; entry += 2) {
+                        map->set(entry[0], entry[1]);
+                        entry[0] = Value();
+                        entry[1] = Value();
+                    }
+                    sp -= 2 * count;
+                    *sp++ = Value(std::static_pointer_cast<LoxObject>(map));
+                    break;
+                }
+                case OpCode::OP_GET_INDEX:
+                    sp[-2] = subscript(sp[-2], sp[-1], SITE());
+                    *--sp = Value();
+                    break;
+                case OpCode::OP_SET_INDEX:
+                    setSubscript(sp[-3], sp[-2], sp[-1], SITE());
+                    sp[-3] = std::move(sp[-1]);
+                    *--sp = Value();
+                    *--sp = Value();
+                    break;
+
+                default:
+                    throw LoxError("Unknown opcode.");  // Unreachable
+            }
+        }
+    } catch (...) {
+        // Let unwind() clear the operand stack as well.
+        if (sp > stackTop) stackTop = sp;
+        throw;
+    }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef SITE
+#undef BINARY
+#undef NUMBERS
+#undef NUMBER_FORM
+}
@@ -4,49 +4,42 @@
 #include "environment.h"
 #include "../common/error.h"
 
-LoxFunction::LoxFunction(FunctionStmt& declaration, std::shared_ptr<Environment> closure, bool isInitializer)
-    : declaration(&declaration), closure(closure), isInitializer(isInitializer) {}
+LoxFunction::LoxFunction(FunctionStmt& declaration, std::shared_ptr<Environment> globals,
+                         std::vector<std::shared_ptr<LoxUpvalue>> upvalues, bool isInitializer)
+    : LoxCallable(ObjType::FUNCTION), declaration(&declaration), globals(std::move(globals)),
+      upvalues(std::move(upvalues)), isInitializer(isInitializer) {}
 
 int LoxFunction::arity() {
     return declaration->params.size();
 }
 
-Value LoxFunction::call(Interpreter& interpreter, std::vector<Value>& arguments) {
-    std::shared_ptr<Environment> environment = std::make_shared<Environment>(closure);
-    
-    for (size_t i = 0; i < declaration->params.size(); i++) {
-        environment->define(declaration->params[i].lexeme, arguments[i]);
-    }
-    
-    try {
-        interpreter.executeBlock(declaration->body, environment);
-    } catch (const ReturnException& returnValue) {
-        if (isInitializer) return closure->getAt(0, "this");
-        return returnValue.value;
-    }
-    
-    if (isInitializer) return closure->getAt(0, "this");
-    return Value();
+Value LoxFunction::call(Interpreter& interpreter, int argCount, Value* args) {
+    return interpreter.callFunction(*this, argCount, args);
 }
 
 std::string LoxFunction::toString() const {
     return "<fn " + declaration->name.lexeme + ">";
 }
 
-std::string LoxFunction::getType() const {
-    return "function";
-}
+LoxBoundMethod::LoxBoundMethod(std::shared_ptr<LoxObject> receiver, std::shared_ptr<LoxFunction> method)
+    : LoxCallable(ObjType::BOUND_METHOD), receiver(std::move(receiver)), method(std::move(method)) {}
 
-std::shared_ptr<LoxFunction> LoxFunction::bind(std::shared_ptr<LoxInstance> instance) {
-    std::shared_ptr<Environment> environment = std::make_shared<Environment>(closure);
-    environment->define("this", Value(instance));
-    return std::make_shared<LoxFunction>(*declaration, environment, isInitializer);
+Value LoxBoundMethod::call(Interpreter& interpreter, int argCount, Value* args) {
+    return interpreter.callMethod(*method, Value(receiver), argCount, args);
 }
 
-NativeFunction::NativeFunction(const std::string& name, int arity, Value (*function)(int, Value*))
-    : arity_(arity), function(function), name(name) {}
+NativeFunction::NativeFunction(const std::string& name, int arity, NativeFn function)
+    : LoxCallable(ObjType::NATIVE), arity_(arity), function(std::move(function)), name(name) {}
 
-Value NativeFunction::call(Interpreter& interpreter, std::vector<Value>& arguments) {
+Value NativeFunction::call(Interpreter& interpreter, int argCount, Value* args) {
     (void)interpreter; // Suppress unused parameter warning
-    return function(arguments.size(), arguments.data());
-}
\ No newline at end of file
+    return function(argCount, args);
+}
+
+BoundNative::BoundNative(std::shared_ptr<LoxObject> receiver, const char* name, int arity, NativeMethod method)
+    : LoxCallable(ObjType::BOUND_NATIVE), receiver(std::move(receiver)), name(name), arity_(arity), method(method) {}
+
+Value BoundNative::call(Interpreter& interpreter, int argCount, Value* args) {
+    (void)interpreter;
+    return method(receiver, argCount, args);
+}
@@ -1,44 +1,117 @@
 #pragma once
 
 #include "../common/value.h"
+#include <functional>
 #include <vector>
 
 class Interpreter;
 
+// Arguments are passed as a pointer into storage owned by the caller, so
+// calling doesn't need to build a container. An arity of -1 accepts any
+// number of arguments.
 class LoxCallable : public LoxObject {
 public:
+    using LoxObject::LoxObject;
+    
     virtual int arity() = 0;
-    virtual Value call(Interpreter& interpreter, std::vector<Value>& arguments) = 0;
+    virtual Value call(Interpreter& interpreter, int argCount, Value* args) = 0;
+};
+
+// A variable a closure captured. While the scope that declares it is live
+// the variable stays in its frame slot and `location` points there; when
+// the scope exits the interpreter closes the upvalue, moving the value into
+// `closed`, and every closure sharing the upvalue keeps seeing it.
+class LoxUpvalue : public GcNode, public std::enable_shared_from_this<LoxUpvalue> {
+public:
+    Value* location;
+    Value closed;
+    
+    explicit LoxUpvalue(Value* slot) : GcNode(Kind::UPVALUE), location(slot) {}
+    explicit LoxUpvalue(Value value) : GcNode(Kind::UPVALUE), location(&closed), closed(std::move(value)) {}
+    
+    void close() {
+        writeBarrier(*location);
+        closed = std::move(*location);
+        location = &closed;
+    }
 };
 
 class LoxFunction : public LoxCallable {
+    friend class Interpreter;
+    friend class GarbageCollector;
+    friend class Snapshot;
+    
 private:
     class FunctionStmt* declaration;
-    std::shared_ptr<class Environment> closure;
+    std::shared_ptr<class Environment> globals;  // of the module that declared it
+    std::vector<std::shared_ptr<LoxUpvalue>> upvalues;
     bool isInitializer;
 
 public:
-    LoxFunction(class FunctionStmt& declaration, std::shared_ptr<class Environment> closure, bool isInitializer = false);
+    LoxFunction(class FunctionStmt& declaration, std::shared_ptr<class Environment> globals,
+                std::vector<std::shared_ptr<LoxUpvalue>> upvalues, bool isInitializer = false);
     
     int arity() override;
-    Value call(Interpreter& interpreter, std::vector<Value>& arguments) override;
+    Value call(Interpreter& interpreter, int argCount, Value* args) override;
     std::string toString() const override;
-    std::string getType() const override;
+};
+
+// A method taken off an instance as a value (`var f = object.method;`). A
+// method called right away (`object.method()`) gets its receiver directly
+// and needs none of these.
+class LoxBoundMethod : public LoxCallable {
+    friend class GarbageCollector;
+    friend class Snapshot;
+    
+private:
+    std::shared_ptr<LoxObject> receiver;
+    std::shared_ptr<LoxFunction> method;
+
+public:
+    LoxBoundMethod(std::shared_ptr<LoxObject> receiver, std::shared_ptr<LoxFunction> method);
     
-    std::shared_ptr<LoxFunction> bind(std::shared_ptr<class LoxInstance> instance);
+    int arity() override { return method->arity(); }
+    Value call(Interpreter& interpreter, int argCount, Value* args) override;
+    std::string toString() const override { return method->toString(); }
 };
 
+// Natives may capture state, and report failures by throwing LoxError,
+// which the interpreter turns into a runtime error at the call site.
+using NativeFn = std::function<Value(int argCount, Value* args)>;
+
 class NativeFunction : public LoxCallable {
+    friend class Snapshot;
+    
 private:
     int arity_;
-    Value (*function)(int argCount, Value* args);
+    NativeFn function;
     std::string name;
 
 public:
-    NativeFunction(const std::string& name, int arity, Value (*function)(int, Value*));
+    NativeFunction(const std::string& name, int arity, NativeFn function);
     
     int arity() override { return arity_; }
-    Value call(Interpreter& interpreter, std::vector<Value>& arguments) override;
+    Value call(Interpreter& interpreter, int argCount, Value* args) override;
     std::string toString() const override { return "<native fn " + name + ">"; }
-    std::string getType() const override { return "function"; }
-};
\ No newline at end of file
+};
+
+// A method of a built-in object type. It gets the receiver's owning pointer
+// so that it can return the receiver for chaining.
+using NativeMethod = Value (*)(const std::shared_ptr<LoxObject>& receiver, int argCount, Value* args);
+
+class BoundNative : public LoxCallable {
+    friend class GarbageCollector;
+    
+private:
+    std::shared_ptr<LoxObject> receiver;
+    const char* name;
+    int arity_;
+    NativeMethod method;
+
+public:
+    BoundNative(std::shared_ptr<LoxObject> receiver, const char* name, int arity, NativeMethod method);
+    
+    int arity() override { return arity_; }
+    Value call(Interpreter& interpreter, int argCount, Value* args) override;
+    std::string toString() const override { return std::string("<native fn ") + name + ">"; }
+};
@@ -0,0 +1,760 @@
+#include "closure_compiler.h"
+#include "interpreter.h"
+#include "../common/collections.h"
+#include "../common/error.h"
+
+// Returns a function's closures, compiling them if this is its first call
+// in closure mode.
+ClosureCode& Interpreter::closureCode(FunctionStmt& function) {
+    ClosureCode* code = function.closures.load(std::memory_order_acquire);
+    if (code != nullptr) return *code;
+
+    return *install(function.closures, ClosureCompiler::compile(function));
+}
+
+std::unique_ptr<ClosureCode> ClosureCompiler::compile(FunctionStmt& function) {
+    auto code = std::make_unique<ClosureCode>();
+    NumberInference speculative(function, true);
+    code->body = compileBody(function, speculative);
+    code->guards = speculative.guards();
+    if (!code->guards.empty()) {
+        NumberInference types(function, false);
+        code->generic = compileBody(function, types);
+    }
+    return code;
+}
+
+std::vector<StmtCode> ClosureCompiler::compileBody(FunctionStmt& function, NumberInference& types) {
+    ClosureCompiler compiler(types);
+    std::vector<StmtCode> body;
+    body.reserve(function.body.size());
+    for (auto& statement : function.body) {
+        body.push_back(compiler.compile(*statement));
+    }
+    return body;
+}
+
+ExprCode ClosureCompiler::compile(Expr& expr) {
+    expr.accept(*this);
+    return std::move(expression);
+}
+
+StmtCode ClosureCompiler::compile(Stmt& stmt) {
+    stmt.accept(*this);
+    return std::move(statement);
+}
+
+std::vector<ExprCode> ClosureCompiler::compileAll(const std::vector<std::unique_ptr<Expr>>& exprs) {
+    std::vector<ExprCode> code;
+    code.reserve(exprs.size());
+    for (auto& expr : exprs) {
+        code.push_back(compile(*expr));
+    }
+    return code;
+}
+
+namespace {
+
+// What a binary operator does with operands that aren't both numbers:
+// comparisons and arithmetic fail, equality compares the values, and +
+// also concatenates strings.
+enum class Fallback { NUMBERS, EQUALITY, ADDITION };
+
+struct Add {
+    static constexpr Fallback fallback = Fallback::ADDITION;
+    static double apply(double a, double b) { return a + b; }
+};
+struct Subtract {
+    static constexpr Fallback fallback = Fallback::NUMBERS;
+    static double apply(double a, double b) { return a - b; }
+};
+struct Multiply {
+    static constexpr Fallback fallback = Fallback::NUMBERS;
+    static double apply(double a, double b) { return a * b; }
+};
+struct Divide {
+    static constexpr Fallback fallback = Fallback::NUMBERS;
+    static double apply(double a, double b) { return a / b; }
+};
+struct Greater {
+    static constexpr Fallback fallback = Fallback::NUMBERS;
+    static bool apply(double a, double b) { return a > b; }
+};
+struct GreaterEqual {
+    static constexpr Fallback fallback = Fallback::NUMBERS;
+    static bool apply(double a, double b) { return a >= b; }
+};
+struct Less {
+    static constexpr Fallback fallback = Fallback::NUMBERS;
+    static bool apply(double a, double b) { return a < b; }
+};
+struct LessEqual {
+    static constexpr Fallback fallback = Fallback::NUMBERS;
+    static bool apply(double a, double b) { return a <= b; }
+};
+struct Equal {
+    static constexpr Fallback fallback = Fallback::EQUALITY;
+    static bool apply(double a, double b) { return a == b; }
+    static Value values(const Value& a, const Value& b) { return Value(a.isEqual(b)); }
+};
+struct NotEqual {
+    static constexpr Fallback fallback = Fallback::EQUALITY;
+    static bool apply(double a, double b) { return a != b; }
+    static Value values(const Value& a, const Value& b) { return Value(!a.isEqual(b)); }
+};
+
+}  // namespace
+
+// Both operands proven numbers: locals and literals are read in place and
+// nothing is checked. A left local is read before the right operand runs,
+// which may assign it.
+template <typename Operator>
+auto ClosureCompiler::numbers(BinaryExpr& expr) {
+    using Code = std::function<decltype(Operator::apply(0.0, 0.0))(Interpreter&)>;
+    int leftSlot = expr.leftSlot;
+    int rightSlot = expr.rightSlot;
+    bool rightConstant = expr.rightConstant != nullptr;
+    double constant = rightConstant ? expr.rightConstant->asNumber() : 0;
+
+    if (leftSlot >= 0 && rightSlot >= 0) {
+        return Code([leftSlot, rightSlot](Interpreter& interpreter) {
+            return Operator::apply(interpreter.frame[leftSlot].unboxedNumber(),
+                                   interpreter.frame[rightSlot].unboxedNumber());
+        });
+    }
+    if (leftSlot >= 0 && rightConstant) {
+        return Code([leftSlot, constant](Interpreter& interpreter) {
+            return Operator::apply(interpreter.frame[leftSlot].unboxedNumber(), constant);
+        });
+    }
+    if (leftSlot >= 0) {
+        NumberCode right = number(*expr.right);
+        return Code([leftSlot, right](Interpreter& interpreter) {
+            double x = interpreter.frame[leftSlot].unboxedNumber();
+            return Operator::apply(x, right(interpreter));
+        });
+    }
+
+    NumberCode left = number(*expr.left);
+    if (rightSlot >= 0) {
+        return Code([left, rightSlot](Interpreter& interpreter) {
+            double x = left(interpreter);
+            return Operator::apply(x, interpreter.frame[rightSlot].unboxedNumber());
+        });
+    }
+    if (rightConstant) {
+        return Code([left, constant](Interpreter& interpreter) {
+            return Operator::apply(left(interpreter), constant);
+        });
+    }
+    NumberCode right = number(*expr.right);
+    return Code([left, right](Interpreter& interpreter) {
+        double x = left(interpreter);
+        return Operator::apply(x, right(interpreter));
+    });
+}
+
+// Otherwise locals and number literals are still read in place, as the
+// tree-walker's quickened path reads them, and two numbers go straight to
+// the operator.
+template <typename Operator>
+ExprCode ClosureCompiler::binary(BinaryExpr& expr) {
+    if (types.isNumber(*expr.left) && types.isNumber(*expr.right)) {
+        auto code = numbers<Operator>(expr);
+        return [code](Interpreter& interpreter) -> Value { return Value(code(interpreter)); };
+    }
+
+    const Token* op = &expr.operator_;
+    auto other = [op](Interpreter& interpreter, const Value& left, const Value& right) -> Value {
+        if constexpr (Operator::fallback == Fallback::EQUALITY) {
+            return Operator::values(left, right);
+        } else if constexpr (Operator::fallback == Fallback::ADDITION) {
+            return interpreter.binary(*op, left, right);
+        } else {
+            throw RuntimeError(*op, "Operands must be numbers.");
+        }
+    };
+    int leftSlot = expr.leftSlot;
+    int rightSlot = expr.rightSlot;
+    bool rightNumber = expr.rightConstant != nullptr && expr.rightConstant->isNumber();
+    double constant = rightNumber ? expr.rightConstant->asNumber() : 0;
+
+    if (leftSlot >= 0 && rightSlot >= 0) {
+        return [other, leftSlot, rightSlot](Interpreter& interpreter) -> Value {
+            const Value& left = interpreter.frame[leftSlot];
+            const Value& right = interpreter.frame[rightSlot];
+            if (left.isNumber() && right.isNumber()) {
+                return Value(Operator::apply(left.asNumber(), right.asNumber()));
+            }
+            return other(interpreter, left, right);
+        };
+    }
+    if (leftSlot >= 0 && rightNumber) {
+        return [other, leftSlot, constant](Interpreter& interpreter) -> Value {
+            const Value& left = interpreter.frame[leftSlot];
+            if (left.isNumber()) return Value(Operator::apply(left.asNumber(), constant));
+            return other(interpreter, left, Value(constant));
+        };
+    }
+    if (leftSlot >= 0) {
+        ExprCode right = compile(*expr.right);
+        return [other, leftSlot, right](Interpreter& interpreter) -> Value {
+            const Value& left = interpreter.frame[leftSlot];
+            if (left.isNumber()) {
+                double x = left.asNumber();
+                Value y = right(interpreter);
+                if (y.isNumber()) return Value(Operator::apply(x, y.asNumber()));
+                return other(interpreter, Value(x), y);
+            }
+            Value leftValue = left;
+            return other(interpreter, leftValue, right(interpreter));
+        };
+    }
+
+    ExprCode left = compile(*expr.left);
+    if (rightSlot >= 0) {
+        return [other, left, rightSlot](Interpreter& interpreter) -> Value {
+            Value x = left(interpreter);
+            const Value& y = interpreter.frame[rightSlot];
+            if (x.isNumber() && y.isNumber()) return Value(Operator::apply(x.asNumber(), y.asNumber()));
+            return other(interpreter, x, y);
+        };
+    }
+    if (rightNumber) {
+        return [other, left, constant](Interpreter& interpreter) -> Value {
+            Value x = left(interpreter);
+            if (x.isNumber()) return Value(Operator::apply(x.asNumber(), constant));
+            return other(interpreter, x, Value(constant));
+        };
+    }
+    ExprCode right = compile(*expr.right);
+    return [other, left, right](Interpreter& interpreter) -> Value {
+        Value x = left(interpreter);
+        Value y = right(interpreter);
+        if (x.isNumber() && y.isNumber()) return Value(Operator::apply(x.asNumber(), y.asNumber()));
+        return other(interpreter, x, y);
+    };
+}
+
+// Compiles an expression NumberInference proved to be a number. Those it
+// can't take apart further are compiled as usual and unboxed.
+NumberCode ClosureCompiler::number(Expr& expr) {
+    if (auto* literal = dynamic_cast<LiteralExpr*>(&expr)) {
+        double value = literal->value.asNumber();
+        return [value](Interpreter&) { return value; };
+    }
+    if (auto* grouping = dynamic_cast<GroupingExpr*>(&expr)) {
+        return number(*grouping->expression);
+    }
+    if (auto* variable = dynamic_cast<VariableExpr*>(&expr)) {
+        int slot = variable->resolution.slot;
+        return [slot](Interpreter& interpreter) { return interpreter.frame[slot].unboxedNumber(); };
+    }
+    auto* assign = dynamic_cast<AssignExpr*>(&expr);
+    if (assign != nullptr && assign->resolution.kind == Resolution::Kind::LOCAL) {
+        NumberCode value = number(*assign->value);
+        int slot = assign->resolution.slot;
+        return [value, slot](Interpreter& interpreter) {
+            double result = value(interpreter);
+            interpreter.frame[slot].setNumber(result);
+            return result;
+        };
+    }
+    auto* unary = dynamic_cast<UnaryExpr*>(&expr);
+    if (unary != nullptr && types.isNumber(*unary->right)) {
+        NumberCode right = number(*unary->right);
+        return [right](Interpreter& interpreter) { return -right(interpreter); };
+    }
+    auto* binary = dynamic_cast<BinaryExpr*>(&expr);
+    if (binary != nullptr && types.isNumber(*binary->left) && types.isNumber(*binary->right)) {
+        switch (binary->operator_.type) {
+            case TokenType::PLUS: return numbers<Add>(*binary);
+            case TokenType::MINUS: return numbers<Subtract>(*binary);
+            case TokenType::STAR: return numbers<Multiply>(*binary);
+            case TokenType::SLASH: return numbers<Divide>(*binary);
+            default: break;
+        }
+    }
+
+    ExprCode code = compile(expr);
+    return [code](Interpreter& interpreter) { return code(interpreter).unboxedNumber(); };
+}
+
+// Compiles a condition; comparisons of numbers produce the bool directly.
+TestCode ClosureCompiler::test(Expr& expr) {
+    auto* binary = dynamic_cast<BinaryExpr*>(&expr);
+    if (binary != nullptr && types.isNumber(*binary->left) && types.isNumber(*binary->right)) {
+        switch (binary->operator_.type) {
+            case TokenType::GREATER: return numbers<Greater>(*binary);
+            case TokenType::GREATER_EQUAL: return numbers<GreaterEqual>(*binary);
+            case TokenType::LESS: return numbers<Less>(*binary);
+            case TokenType::LESS_EQUAL: return numbers<LessEqual>(*binary);
+            case TokenType::EQUAL_EQUAL: return numbers<Equal>(*binary);
+            case TokenType::BANG_EQUAL: return numbers<NotEqual>(*binary);
+            default: break;
+        }
+    }
+
+    ExprCode condition = compile(expr);
+    return [condition](Interpreter& interpreter) { return condition(interpreter).isTruthy(); };
+}
+
+Value ClosureCompiler::visitBinaryExpr(BinaryExpr& expr) {
+    switch (expr.operator_.type) {
+        case TokenType::PLUS: expression = binary<Add>(expr); break;
+        case TokenType::MINUS: expression = binary<Subtract>(expr); break;
+        case TokenType::STAR: expression = binary<Multiply>(expr); break;
+        case TokenType::SLASH: expression = binary<Divide>(expr); break;
+        case TokenType::GREATER: expression = binary<Greater>(expr); break;
+        case TokenType::GREATER_EQUAL: expression = binary<GreaterEqual>(expr); break;
+        case TokenType::LESS: expression = binary<Less>(expr); break;
+        case TokenType::LESS_EQUAL: expression = binary<LessEqual>(expr); break;
+        case TokenType::EQUAL_EQUAL: expression = binary<Equal>(expr); break;
+        case TokenType::BANG_EQUAL: expression = binary<NotEqual>(expr); break;
+        default: break; // Unreachable
+    }
+    return Value();
+}
+
+Value ClosureCompiler::visitGroupingExpr(GroupingExpr& expr) {
+    expression = compile(*expr.expression);
+    return Value();
+}
+
+Value ClosureCompiler::visitLiteralExpr(LiteralExpr& expr) {
+    Value value = expr.value;
+    expression = [value](Interpreter&) -> Value { return value; };
+    return Value();
+}
+
+Value ClosureCompiler::visitUnaryExpr(UnaryExpr& expr) {
+    if (expr.operator_.type == TokenType::MINUS && types.isNumber(*expr.right)) {
+        NumberCode right = number(*expr.right);
+        expression = [right](Interpreter& interpreter) -> Value { return Value(-right(interpreter)); };
+        return Value();
+    }
+
+    ExprCode right = compile(*expr.right);
+    const Token* op = &expr.operator_;
+    if (expr.operator_.type == TokenType::MINUS) {
+        expression = [right, op](Interpreter& interpreter) -> Value {
+            Value value = right(interpreter);
+            interpreter.checkNumberOperand(*op, value);
+            return Value(-value.asNumber());
+        };
+    } else {
+        expression = [right](Interpreter& interpreter) -> Value { return Value(!right(interpreter).isTruthy()); };
+    }
+    return Value();
+}
+
+ExprCode ClosureCompiler::load(const Token& name, const Resolution& resolution) {
+    int slot = resolution.slot;
+    switch (resolution.kind) {
+        case Resolution::Kind::LOCAL:
+            return [slot](Interpreter& interpreter) -> Value { return interpreter.frame[slot]; };
+        case Resolution::Kind::UPVALUE:
+            return [slot](Interpreter& interpreter) -> Value { return *interpreter.upvalues[slot]->location; };
+        default: {
+            const Token* token = &name;
+            return [token](Interpreter& interpreter) -> Value { return interpreter.environment->get(*token); };
+        }
+    }
+}
+
+Value ClosureCompiler::visitVariableExpr(VariableExpr& expr) {
+    expression = load(expr.name, expr.resolution);
+    return Value();
+}
+
+Value ClosureCompiler::visitAssignExpr(AssignExpr& expr) {
+    int slot = expr.resolution.slot;
+    if (expr.resolution.kind == Resolution::Kind::LOCAL && types.isNumber(*expr.value)) {
+        NumberCode value = number(*expr.value);
+        expression = [value, slot](Interpreter& interpreter) -> Value {
+            double result = value(interpreter);
+            interpreter.frame[slot].setNumber(result);
+            return Value(result);
+        };
+        return Value();
+    }
+
+    ExprCode value = compile(*expr.value);
+    switch (expr.resolution.kind) {
+        case Resolution::Kind::LOCAL:
+            expression = [value, slot](Interpreter& interpreter) -> Value {
+                Value result = value(interpreter);
+                interpreter.frame[slot] = result;
+                return result;
+            };
+            break;
+        case Resolution::Kind::UPVALUE:
+            expression = [value, slot](Interpreter& interpreter) -> Value {
+                Value result = value(interpreter);
+                writeBarrier(result);
+                *interpreter.upvalues[slot]->location = result;
+                return result;
+            };
+            break;
+        default: {
+            const Token* name = &expr.name;
+            expression = [value, name](Interpreter& interpreter) -> Value {
+                Value result = value(interpreter);
+                interpreter.environment->assign(*name, result);
+                return result;
+            };
+            break;
+        }
+    }
+    return Value();
+}
+
+Value ClosureCompiler::visitLogicalExpr(LogicalExpr& expr) {
+    ExprCode left = compile(*expr.left);
+    ExprCode right = compile(*expr.right);
+    if (expr.operator_.type == TokenType::OR) {
+        expression = [left, right](Interpreter& interpreter) -> Value {
+            Value value = left(interpreter);
+            if (value.isTruthy()) return value;
+            return right(interpreter);
+        };
+    } else {
+        expression = [left, right](Interpreter& interpreter) -> Value {
+            Value value = left(interpreter);
+            if (!value.isTruthy()) return value;
+            return right(interpreter);
+        };
+    }
+    return Value();
+}
+
+// As Interpreter::pushArguments: where the callee's frame will start.
+Value* ClosureCompiler::pushArguments(Interpreter& interpreter, const std::vector<ExprCode>& arguments,
+                                      const Token& paren) {
+    if (static_cast<int>(arguments.size()) > interpreter.stack.data() + Interpreter::STACK_MAX - interpreter.stackTop) {
+        throw RuntimeError(paren, "Stack overflow.");
+    }
+
+    Value* args = interpreter.stackTop;
+    for (const ExprCode& argument : arguments) {
+        Value value = argument(interpreter);
+        *interpreter.stackTop++ = std::move(value);
+    }
+    return args;
+}
+
+Value ClosureCompiler::visitCallExpr(CallExpr& expr) {
+    std::vector<ExprCode> arguments = compileAll(expr.arguments);
+    int argCount = static_cast<int>(expr.arguments.size());
+    const Token* paren = &expr.paren;
+    if (expr.method != nullptr) {
+        ExprCode object = compile(*expr.method->object);
+        const Token* name = &expr.method->name;
+        expression = [object, arguments, argCount, name, paren](Interpreter& interpreter) -> Value {
+            Value callee;
+            Value* base = interpreter.stackTop;
+            LoxFunction* method = interpreter.pushReceiver(object(interpreter), *name, callee);
+            Value* args = pushArguments(interpreter, arguments, *paren);
+            Value result = method != nullptr ? interpreter.invoke(*method, argCount, base, *paren)
+                                             : interpreter.callValue(callee, argCount, args, *paren);
+            while (interpreter.stackTop > base) {
+                *--interpreter.stackTop = Value();
+            }
+            return result;
+        };
+        return Value();
+    }
+
+    ExprCode callee = compile(*expr.callee);
+    expression = [callee, arguments, argCount, paren](Interpreter& interpreter) -> Value {
+        Value* base = interpreter.stackTop;
+        Value function = callee(interpreter);
+        Value* args = pushArguments(interpreter, arguments, *paren);
+        Value result = interpreter.callValue(function, argCount, args, *paren);
+        while (interpreter.stackTop > base) {
+            *--interpreter.stackTop = Value();
+        }
+        return result;
+    };
+    return Value();
+}
+
+Value ClosureCompiler::visitGetExpr(GetExpr& expr) {
+    ExprCode object = compile(*expr.object);
+    const Token* name = &expr.name;
+    expression = [object, name](Interpreter& interpreter) -> Value {
+        return interpreter.getProperty(object(interpreter), *name);
+    };
+    return Value();
+}
+
+Value ClosureCompiler::visitSetExpr(SetExpr& expr) {
+    ExprCode object = compile(*expr.object);
+    ExprCode value = compile(*expr.value);
+    const Token* name = &expr.name;
+    expression = [object, value, name](Interpreter& interpreter) -> Value {
+        Value target = object(interpreter);
+        if (!target.isObjType(ObjType::INSTANCE)) {
+            throw RuntimeError(*name, "Only instances have fields.");
+        }
+
+        Value result = value(interpreter);
+        static_cast<LoxInstance*>(target.asObject().get())->set(*name, result);
+        return result;
+    };
+    return Value();
+}
+
+Value ClosureCompiler::visitThisExpr(ThisExpr& expr) {
+    expression = load(expr.keyword, expr.resolution);
+    return Value();
+}
+
+Value ClosureCompiler::visitSuperExpr(SuperExpr& expr) {
+    ExprCode superclass = load(expr.keyword, expr.resolution);
+    ExprCode object = load(expr.keyword, expr.thisResolution);
+    const Token* method = &expr.method;
+    expression = [superclass, object, method](Interpreter& interpreter) -> Value {
+        Value klass = superclass(interpreter);
+        return interpreter.superMethod(klass, object(interpreter), *method);
+    };
+    return Value();
+}
+
+Value ClosureCompiler::visitListExpr(ListExpr& expr) {
+    std::vector<ExprCode> elements = compileAll(expr.elements);
+    expression = [elements](Interpreter& interpreter) -> Value {
+        auto list = makePooled<LoxList>();
+        list->elements.reserve(elements.size());
+        for (const ExprCode& element : elements) {
+            list->elements.push_back(element(interpreter));
+        }
+        return Value(std::static_pointer_cast<LoxObject>(list));
+    };
+    return Value();
+}
+
+Value ClosureCompiler::visitMapExpr(MapExpr& expr) {
+    std::vector<ExprCode> keys = compileAll(expr.keys);
+    std::vector<ExprCode> values = compileAll(expr.values);
+    expression = [keys, values](Interpreter& interpreter) -> Value {
+        auto map = makePooled<LoxMap>();
+        for (size_t i = 0; i < keys.size(); i++) {
+            Value key = keys[i](interpreter);
+            map->set(key, values[i](interpreter));
+        }
+        return Value(std::static_pointer_cast<LoxObject>(map));
+    };
+    return Value();
+}
+
+Value ClosureCompiler::visitSubscriptExpr(SubscriptExpr& expr) {
+    ExprCode object = compile(*expr.object);
+    ExprCode index = compile(*expr.index);
+    const Token* bracket = &expr.bracket;
+    expression = [object, index, bracket](Interpreter& interpreter) -> Value {
+        Value target = object(interpreter);
+        return interpreter.subscript(target, index(interpreter), *bracket);
+    };
+    return Value();
+}
+
+Value ClosureCompiler::visitSubscriptSetExpr(SubscriptSetExpr& expr) {
+    ExprCode object = compile(*expr.object);
+    ExprCode index = compile(*expr.index);
+    ExprCode value = compile(*expr.value);
+    const Token* bracket = &expr.bracket;
+    expression = [object, index, value, bracket](Interpreter& interpreter) -> Value {
+        Value target = object(interpreter);
+        Value key = index(interpreter);
+        Value result = value(interpreter);
+        interpreter.setSubscript(target, key, result, *bracket);
+        return result;
+    };
+    return Value();
+}
+
+void ClosureCompiler::visitExpressionStmt(ExpressionStmt& stmt) {
+    // A number stored to a local needn't be boxed for a result no one uses.
+    auto* assign = dynamic_cast<AssignExpr*>(stmt.expression.get());
+    if (assign != nullptr && assign->resolution.kind == Resolution::Kind::LOCAL && types.isNumber(*assign->value)) {
+        NumberCode value = number(*assign->value);
+        int slot = assign->resolution.slot;
+        statement = [value, slot](Interpreter& interpreter) { interpreter.frame[slot].setNumber(value(interpreter)); };
+        return;
+    }
+
+    ExprCode expr = compile(*stmt.expression);
+    statement = [expr](Interpreter& interpreter) { expr(interpreter); };
+}
+
+void ClosureCompiler::visitPrintStmt(PrintStmt& stmt) {
+    ExprCode expr = compile(*stmt.expression);
+    statement = [expr](Interpreter& interpreter) { interpreter.print(expr(interpreter)); };
+}
+
+void ClosureCompiler::visitVarStmt(VarStmt& stmt) {
+    if (stmt.resolution.kind == Resolution::Kind::LOCAL && stmt.initializer != nullptr &&
+        types.isNumber(*stmt.initializer)) {
+        NumberCode initializer = number(*stmt.initializer);
+        int slot = stmt.resolution.slot;
+        statement = [initializer, slot](Interpreter& interpreter) {
+            interpreter.frame[slot].setNumber(initializer(interpreter));
+        };
+        return;
+    }
+
+    ExprCode initializer = stmt.initializer != nullptr ? compile(*stmt.initializer) : nullptr;
+    if (stmt.resolution.kind == Resolution::Kind::LOCAL) {
+        int slot = stmt.resolution.slot;
+        if (initializer == nullptr) {
+            statement = [slot](Interpreter& interpreter) { interpreter.frame[slot] = Value(); };
+        } else {
+            statement = [initializer, slot](Interpreter& interpreter) {
+                Value value = initializer(interpreter);
+                interpreter.frame[slot] = std::move(value);
+            };
+        }
+        return;
+    }
+
+    const std::string* name = &stmt.name.lexeme;
+    statement = [initializer, name](Interpreter& interpreter) {
+        Value value = initializer != nullptr ? initializer(interpreter) : Value();
+        interpreter.environment->define(*name, value);
+    };
+}
+
+void ClosureCompiler::visitBlockStmt(BlockStmt& stmt) {
+    std::vector<StmtCode> statements;
+    statements.reserve(stmt.statements.size());
+    for (auto& inner : stmt.statements) {
+        statements.push_back(compile(*inner));
+    }
+
+    int capturedFrom = stmt.capturedFrom;
+    if (capturedFrom < 0) {
+        statement = [statements](Interpreter& interpreter) {
+            for (const StmtCode& inner : statements) {
+                inner(interpreter);
+                if (interpreter.returning) return;
+            }
+        };
+        return;
+    }
+    // Closures made in the block keep its variables; the frame slots are
+    // about to be reused.
+    statement = [statements, capturedFrom](Interpreter& interpreter) {
+        for (const StmtCode& inner : statements) {
+            inner(interpreter);
+            if (interpreter.returning) break;
+        }
+        interpreter.closeUpvalues(interpreter.frame + capturedFrom);
+    };
+}
+
+void ClosureCompiler::visitIfStmt(IfStmt& stmt) {
+    TestCode condition = test(*stmt.condition);
+    StmtCode thenBranch = compile(*stmt.thenBranch);
+    if (stmt.elseBranch == nullptr) {
+        statement = [condition, thenBranch](Interpreter& interpreter) {
+            if (condition(interpreter)) thenBranch(interpreter);
+        };
+        return;
+    }
+
+    StmtCode elseBranch = compile(*stmt.elseBranch);
+    statement = [condition, thenBranch, elseBranch](Interpreter& interpreter) {
+        if (condition(interpreter)) {
+            thenBranch(interpreter);
+        } else {
+            elseBranch(interpreter);
+        }
+    };
+}
+
+void ClosureCompiler::visitWhileStmt(WhileStmt& stmt) {
+    TestCode condition = test(*stmt.condition);
+    StmtCode body = compile(*stmt.body);
+    FunctionStmt* function = stmt.function;
+    statement = [condition, body, function](Interpreter& interpreter) {
+        // In tiered mode iterations make the function hot, as they do
+        // when it is tree-walked.
+        FunctionStmt* hot = interpreter.tierUpThreshold > 0 ? function : nullptr;
+        while (condition(interpreter)) {
+            body(interpreter);
+            if (interpreter.returning) return;
+            interpreter.gc.safepoint();
+            if (hot != nullptr) {
+                hot->hotness.store(hot->hotness.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+    };
+}
+
+void ClosureCompiler::visitFunctionStmt(FunctionStmt& stmt) {
+    FunctionStmt* function = &stmt;
+    statement = [function](Interpreter& interpreter) {
+        interpreter.define(function->name.lexeme, function->resolution,
+                           Value(interpreter.makeClosure(*function, false)));
+    };
+}
+
+void ClosureCompiler::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.tailCall != nullptr) {
+        statement = tailCall(*stmt.tailCall);
+        return;
+    }
+
+    if (stmt.value == nullptr) {
+        statement = [](Interpreter& interpreter) {
+            interpreter.returnValue = Value();
+            interpreter.returning = true;
+        };
+        return;
+    }
+    ExprCode value = compile(*stmt.value);
+    statement = [value](Interpreter& interpreter) {
+        interpreter.returnValue = value(interpreter);
+        interpreter.returning = true;
+    };
+}
+
+// `return f(...)`: the callee and arguments are pushed as for a call, and
+// Interpreter::returnCall reuses the frame as the tree-walker does.
+StmtCode ClosureCompiler::tailCall(CallExpr& call) {
+    std::vector<ExprCode> arguments = compileAll(call.arguments);
+    int argCount = static_cast<int>(call.arguments.size());
+    const Token* paren = &call.paren;
+    if (call.method != nullptr) {
+        ExprCode object = compile(*call.method->object);
+        const Token* name = &call.method->name;
+        return [object, arguments, argCount, name, paren](Interpreter& interpreter) {
+            Value callee;
+            Value* base = interpreter.stackTop;
+            LoxFunction* method = interpreter.pushReceiver(object(interpreter), *name, callee);
+            Value* args = pushArguments(interpreter, arguments, *paren);
+            interpreter.returnCall(callee, method, base, args, argCount, *paren);
+        };
+    }
+
+    ExprCode callee = compile(*call.callee);
+    return [callee, arguments, argCount, paren](Interpreter& interpreter) {
+        Value* base = interpreter.stackTop;
+        Value function = callee(interpreter);
+        Value* args = pushArguments(interpreter, arguments, *paren);
+        interpreter.returnCall(function, nullptr, base, args, argCount, *paren);
+    };
+}
+
+// Class declarations and imports run once per execution at most, so the
+// tree-walker handles them; the methods they declare run as closures.
+void ClosureCompiler::visitClassStmt(ClassStmt& stmt) {
+    Stmt* node = &stmt;
+    statement = [node](Interpreter& interpreter) { interpreter.execute(*node); };
+}
+
+void ClosureCompiler::visitImportStmt(ImportStmt& stmt) {
+    Stmt* node = &stmt;
+    statement = [node](Interpreter& interpreter) { interpreter.execute(*node); };
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "number_inference.h"
+#include "../parser/ast.h"
+
+class Interpreter;
+
+// A node of a function body compiled to closures (lox --closures). Each
+// is a functor holding its children's code and everything the resolver
+// decided about it (slots, operators, tokens for errors), and runs
+// against the interpreter's frames, upvalues and objects as they are.
+using ExprCode = std::function<Value(Interpreter&)>;
+using StmtCode = std::function<void(Interpreter&)>;
+// Expressions proven to be numbers, unboxed, and conditions comparing them
+using NumberCode = std::function<double(Interpreter&)>;
+using TestCode = std::function<bool(Interpreter&)>;
+
+struct ClosureCode {
+    std::vector<StmtCode> body;
+    // Parameters `body` assumes are numbers. A call passing anything else
+    // for one of them runs `generic`, compiled without the assumption.
+    std::vector<int> guards;
+    std::vector<StmtCode> generic;
+
+    const std::vector<StmtCode>& select(const Value* frame) const {
+        for (int slot : guards) {
+            if (!frame[slot].isNumber()) return generic;
+        }
+        return body;
+    }
+};
+
+// Compiles a resolved function body to closures, once; the code captures
+// only AST nodes and constants, so every isolate can run it. Nested
+// functions are compiled when they are first called. Class declarations
+// and imports are left to the tree-walker, which the code calls for them.
+//
+// Where NumberInference proves operands are numbers, arithmetic and
+// comparisons compile to NumberCode and TestCode on plain doubles, with
+// no type checks.
+class ClosureCompiler : public ExprVisitor, public StmtVisitor {
+public:
+    static std::unique_ptr<ClosureCode> compile(FunctionStmt& function);
+
+    Value visitBinaryExpr(BinaryExpr& expr) override;
+    Value visitGroupingExpr(GroupingExpr& expr) override;
+    Value visitLiteralExpr(LiteralExpr& expr) override;
+    Value visitUnaryExpr(UnaryExpr& expr) override;
+    Value visitVariableExpr(VariableExpr& expr) override;
+    Value visitAssignExpr(AssignExpr& expr) override;
+    Value visitLogicalExpr(LogicalExpr& expr) override;
+    Value visitCallExpr(CallExpr& expr) override;
+    Value visitGetExpr(GetExpr& expr) override;
+    Value visitSetExpr(SetExpr& expr) override;
+    Value visitThisExpr(ThisExpr& expr) override;
+    Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSubscriptExpr(SubscriptExpr& expr) override;
+    Value visitSubscriptSetExpr(SubscriptSetExpr& expr) override;
+
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitImportStmt(ImportStmt& stmt) override;
+
+private:
+    NumberInference& types;
+    // The visitors leave the code of the node they visited here.
+    ExprCode expression;
+    StmtCode statement;
+
+    explicit ClosureCompiler(NumberInference& types) : types(types) {}
+
+    static std::vector<StmtCode> compileBody(FunctionStmt& function, NumberInference& types);
+    ExprCode compile(Expr& expr);
+    StmtCode compile(Stmt& stmt);
+    std::vector<ExprCode> compileAll(const std::vector<std::unique_ptr<Expr>>& exprs);
+    NumberCode number(Expr& expr);
+    TestCode test(Expr& expr);
+
+    ExprCode load(const Token& name, const Resolution& resolution);
+    template <typename Operator>
+    ExprCode binary(BinaryExpr& expr);
+    template <typename Operator>
+    auto numbers(BinaryExpr& expr);
+    StmtCode tailCall(CallExpr& call);
+    static Value* pushArguments(Interpreter& interpreter, const std::vector<ExprCode>& arguments,
+                                const Token& paren);
+};
@@ -1,37 +1,39 @@
 #include "environment.h"
 #include "../common/error.h"
 
-Environment::Environment() : enclosing(nullptr) {}
+Environment::Environment() : GcNode(Kind::ENVIRONMENT), enclosing(nullptr) {}
 
-Environment::Environment(std::shared_ptr<Environment> enclosing) : enclosing(enclosing) {}
+Environment::Environment(std::shared_ptr<Environment> enclosing)
+    : GcNode(Kind::ENVIRONMENT), enclosing(std::move(enclosing)) {}
 
 void Environment::define(const std::string& name, const Value& value) {
+    writeBarrier(value);
     values[name] = value;
 }
 
+bool Environment::isDefined(const std::string& name) const {
+    return values.contains(name);
+}
+
 Value Environment::get(const Token& name) {
-    auto it = values.find(name.lexeme);
-    if (it != values.end()) {
-        return it->second;
-    }
-    
-    if (enclosing != nullptr) {
-        return enclosing->get(name);
+    for (Environment* environment = this; environment != nullptr; environment = environment->enclosing.get()) {
+        if (environment->values.empty()) continue;
+        const Value* value = environment->values.find(name.lexeme, name.hash);
+        if (value != nullptr) return *value;
     }
     
     throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
 }
 
 void Environment::assign(const Token& name, const Value& value) {
-    auto it = values.find(name.lexeme);
-    if (it != values.end()) {
-        it->second = value;
-        return;
-    }
-    
-    if (enclosing != nullptr) {
-        enclosing->assign(name, value);
-        return;
+    for (Environment* environment = this; environment != nullptr; environment = environment->enclosing.get()) {
+        if (environment->values.empty()) continue;
+        Value* slot = environment->values.find(name.lexeme, name.hash);
+        if (slot != nullptr) {
+            writeBarrier(value);
+            *slot = value;
+            return;
+        }
     }
     
     throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
@@ -41,14 +43,10 @@ Value Environment::getAt(int distance, const std::string& name) {
     return ancestor(distance)->values[name];
 }
 
-void Environment::assignAt(int distance, const Token& name, const Value& value) {
-    ancestor(distance)->values[name.lexeme] = value;
-}
-
-std::shared_ptr<Environment> Environment::ancestor(int distance) {
-    std::shared_ptr<Environment> environment = shared_from_this();
+Environment* Environment::ancestor(int distance) {
+    Environment* environment = this;
     for (int i = 0; i < distance; i++) {
-        environment = environment->enclosing;
+        environment = environment->enclosing.get();
     }
     return environment;
 }
\ No newline at end of file
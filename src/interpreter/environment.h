@@ -1,24 +1,29 @@
 #pragma once
 
-#include <unordered_map>
 #include <memory>
 #include "../common/value.h"
 #include "../common/token.h"
+#include "../common/flat_hash_map.h"
 
-class Environment : public std::enable_shared_from_this<Environment> {
+// Globals, kept by name: a module's namespace, enclosed by the natives.
+// Locals never live here; they are in call frames and closures' upvalues.
+class Environment : public GcNode, public std::enable_shared_from_this<Environment> {
+    friend class GarbageCollector;
+    friend class Snapshot;
+    
 private:
     std::shared_ptr<Environment> enclosing;
-    std::unordered_map<std::string, Value> values;
+    FlatHashMap<std::string, Value> values;
+
+    Environment* ancestor(int distance);
 
 public:
     Environment();
     explicit Environment(std::shared_ptr<Environment> enclosing);
     
     void define(const std::string& name, const Value& value);
+    bool isDefined(const std::string& name) const;
     Value get(const Token& name);
     void assign(const Token& name, const Value& value);
     Value getAt(int distance, const std::string& name);
-    void assignAt(int distance, const Token& name, const Value& value);
-    
-    std::shared_ptr<Environment> ancestor(int distance);
-};
\ No newline at end of file
+};
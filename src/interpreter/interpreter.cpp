@@ -1,20 +1,108 @@
 #include "interpreter.h"
+#include "builtins.h"
+#include "closure_compiler.h"
+#include "../common/collections.h"
 #include "../common/error.h"
-#include <iostream>
+#include "../common/number.h"
+#include "../module/module.h"
+#include <algorithm>
 
-Interpreter::Interpreter() {
-    globals = std::make_shared<Environment>();
+Interpreter::Interpreter(ErrorReporter& reporter, OutputBuffer& out)
+    : reporter(reporter), out(out), stack(STACK_MAX) {
+    GarbageCollector::Scope scope(gc);
+    builtins = makePooled<Environment>();
+    globals = makePooled<Environment>(builtins);
     environment = globals;
+    frame = stack.data();
+    stackTop = stack.data();
+    defineBuiltins(*this);
 }
 
-void Interpreter::interpret(std::vector<std::unique_ptr<Stmt>>& statements) {
+void Interpreter::defineNative(const std::string& name, int arity, NativeFn function) {
+    auto native = makePooled<NativeFunction>(name, arity, std::move(function));
+    builtins->define(name, Value(std::static_pointer_cast<LoxObject>(native)));
+}
+
+void Interpreter::reset() {
+    GarbageCollector::Scope scope(gc);
+    globals = makePooled<Environment>(builtins);
+    environment = globals;
+    modules.clear();
+    // The old globals' functions refer back to them; only the collector
+    // can free that.
+    gc.collect();
+    scripts.clear();
+    callDepth = 0;
+}
+
+void Interpreter::interpretModule(const std::shared_ptr<Module>& module, bool isMain) {
+    GarbageCollector::Scope scope(gc);
+    if (isMain) {
+        retain(module);
+        executeModule(module->statements, module->frameSize, globals);
+        return;
+    }
+    
+    // An unchanged module that was already imported keeps its namespace.
+    auto existing = modules.find(module->path);
+    if (existing != modules.end() && existing->second->getSource() == module) return;
+    
+    std::shared_ptr<Environment> namespace_ = makePooled<Environment>(builtins);
+    std::string name = std::filesystem::path(module->path).stem().string();
+    modules[module->path] = std::make_shared<LoxModule>(name, namespace_, module);
+    executeModule(module->statements, module->frameSize, namespace_);
+}
+
+// Functions keep pointers into the AST, so it lives as long as we do.
+void Interpreter::retain(const std::shared_ptr<Module>& module) {
+    if (std::find(scripts.begin(), scripts.end(), module) == scripts.end()) {
+        scripts.push_back(module);
+    }
+}
+
+void Interpreter::executeModule(std::vector<std::unique_ptr<Stmt>>& statements, int frameSize,
+                                std::shared_ptr<Environment> scope) {
+    Value* base = stackTop;
+    Value* previousFrame = frame;
+    std::shared_ptr<LoxUpvalue>* previousUpvalues = upvalues;
+    std::shared_ptr<Environment> previous = std::move(environment);
+    int previousDepth = callDepth;
+    
     try {
+        if (frameSize > stack.data() + STACK_MAX - base) {
+            throw RuntimeError(Token(TokenType::TOKEN_EOF, "", "", 0), "Stack overflow.");
+        }
+        frame = base;
+        stackTop = base + frameSize;
+        upvalues = nullptr;
+        environment = std::move(scope);
         for (auto& statement : statements) {
             execute(*statement);
         }
     } catch (const RuntimeError& error) {
-        ErrorReporter::runtimeError(error);
+        out.flush();
+        reporter.runtimeError(error);
+    } catch (const LoxError& error) {
+        // Running out of heap outside any call
+        out.flush();
+        reporter.runtimeError(RuntimeError(Token(TokenType::TOKEN_EOF, "", "", 0), error.what()));
     }
+    
+    unwind(base);
+    frame = previousFrame;
+    upvalues = previousUpvalues;
+    environment = std::move(previous);
+    callDepth = previousDepth;
+}
+
+// Clears everything pushed above `base`, which an error may have left behind.
+void Interpreter::unwind(Value* base) {
+    closeUpvalues(base);
+    std::fill(base, stackTop, Value());
+    stackTop = base;
+    returning = false;
+    returnValue = Value();
+    tailCallee = Value();
 }
 
 Value Interpreter::evaluate(Expr& expr) {
@@ -48,55 +136,118 @@ Value Interpreter::visitUnaryExpr(UnaryExpr& expr) {
 }
 
 Value Interpreter::visitBinaryExpr(BinaryExpr& expr) {
+    // Quickened: numbers assumed, operands read in place where possible.
+    if (expr.quickening.load(std::memory_order_relaxed) == BinaryExpr::Quickening::NUMBERS) {
+        const Value* a = inPlace(expr.leftSlot, expr.leftConstant);
+        Value left = a != nullptr ? Value() : evaluate(*expr.left);
+        if (a == nullptr) a = &left;
+        if (a->isNumber()) {
+            double x = a->asNumber();
+            const Value* b = inPlace(expr.rightSlot, expr.rightConstant);
+            Value right = b != nullptr ? Value() : evaluate(*expr.right);
+            if (b == nullptr) b = &right;
+            if (b->isNumber()) return numberBinary(expr.operator_.type, x, b->asNumber());
+            expr.quickening.store(BinaryExpr::Quickening::GENERIC, std::memory_order_relaxed);
+            return binary(expr.operator_, Value(x), *b);
+        }
+        // Deoptimize: the left operand wasn't a number after all.
+        expr.quickening.store(BinaryExpr::Quickening::GENERIC, std::memory_order_relaxed);
+        Value leftValue = *a;
+        return binary(expr.operator_, leftValue, evaluate(*expr.right));
+    }
+    
     Value left = evaluate(*expr.left);
     Value right = evaluate(*expr.right);
-    
-    switch (expr.operator_.type) {
+    if (expr.quickening.load(std::memory_order_relaxed) == BinaryExpr::Quickening::UNSEEN) {
+        bool numbers = left.isNumber() && right.isNumber();
+        expr.quickening.store(numbers ? BinaryExpr::Quickening::NUMBERS : BinaryExpr::Quickening::GENERIC,
+                              std::memory_order_relaxed);
+    }
+    return binary(expr.operator_, left, right);
+}
+
+Value Interpreter::binary(const Token& operator_, const Value& left, const Value& right) {
+    switch (operator_.type) {
         case TokenType::GREATER:
-            checkNumberOperands(expr.operator_, left, right);
+            checkNumberOperands(operator_, left, right);
             return Value(left.asNumber() > right.asNumber());
         case TokenType::GREATER_EQUAL:
-            checkNumberOperands(expr.operator_, left, right);
+            checkNumberOperands(operator_, left, right);
             return Value(left.asNumber() >= right.asNumber());
         case TokenType::LESS:
-            checkNumberOperands(expr.operator_, left, right);
+            checkNumberOperands(operator_, left, right);
             return Value(left.asNumber() < right.asNumber());
         case TokenType::LESS_EQUAL:
-            checkNumberOperands(expr.operator_, left, right);
+            checkNumberOperands(operator_, left, right);
             return Value(left.asNumber() <= right.asNumber());
         case TokenType::BANG_EQUAL:
             return Value(!isEqual(left, right));
         case TokenType::EQUAL_EQUAL:
             return Value(isEqual(left, right));
         case TokenType::MINUS:
-            checkNumberOperands(expr.operator_, left, right);
+            checkNumberOperands(operator_, left, right);
             return Value(left.asNumber() - right.asNumber());
         case TokenType::PLUS:
             if (left.isNumber() && right.isNumber()) {
                 return Value(left.asNumber() + right.asNumber());
             }
             if (left.isString() || right.isString()) {
-                return Value(stringify(left) + stringify(right));
+                // A string operand is shared, not copied; long results are ropes.
+                std::shared_ptr<LoxString> a = left.isString() ? left.asLoxString()
+                                                               : makePooled<LoxString>(stringify(left));
+                std::shared_ptr<LoxString> b = right.isString() ? right.asLoxString()
+                                                                : makePooled<LoxString>(stringify(right));
+                return Value(LoxString::concat(a, b));
             }
-            throw RuntimeError(expr.operator_, "Operands must be two numbers or two strings.");
+            throw RuntimeError(operator_, "Operands must be two numbers or two strings.");
         case TokenType::SLASH:
-            checkNumberOperands(expr.operator_, left, right);
+            checkNumberOperands(operator_, left, right);
             return Value(left.asNumber() / right.asNumber());
         case TokenType::STAR:
-            checkNumberOperands(expr.operator_, left, right);
+            checkNumberOperands(operator_, left, right);
             return Value(left.asNumber() * right.asNumber());
         default:
             return Value(); // Unreachable
     }
 }
 
+// The quickened form of a binary expression whose operands have been
+// numbers: no per-operator type checks, no string or equality dispatch.
+Value Interpreter::numberBinary(TokenType operator_, double left, double right) {
+    switch (operator_) {
+        case TokenType::PLUS: return Value(left + right);
+        case TokenType::MINUS: return Value(left - right);
+        case TokenType::STAR: return Value(left * right);
+        case TokenType::SLASH: return Value(left / right);
+        case TokenType::GREATER: return Value(left > right);
+        case TokenType::GREATER_EQUAL: return Value(left >= right);
+        case TokenType::LESS: return Value(left < right);
+        case TokenType::LESS_EQUAL: return Value(left <= right);
+        case TokenType::EQUAL_EQUAL: return Value(left == right);
+        case TokenType::BANG_EQUAL: return Value(left != right);
+        default: return Value(); // Unreachable
+    }
+}
+
 void Interpreter::visitExpressionStmt(ExpressionStmt& stmt) {
     evaluate(*stmt.expression);
 }
 
 void Interpreter::visitPrintStmt(PrintStmt& stmt) {
-    Value value = evaluate(*stmt.expression);
-    std::cout << stringify(value) << std::endl;
+    print(evaluate(*stmt.expression));
+}
+
+void Interpreter::print(const Value& value) {
+    if (value.isString()) {
+        out.writeLine(value.asString());
+    } else if (value.isNumber()) {
+        char text[NUMBER_MAX_CHARS + 1];
+        size_t length = formatNumber(value.asNumber(), text);
+        text[length++] = '\n';
+        out.write(text, length);
+    } else {
+        out.writeLine(stringify(value));
+    }
 }
 
 bool Interpreter::isTruthy(const Value& value) {
@@ -123,13 +274,40 @@ std::string Interpreter::stringify(const Value& value) {
     return value.toString();
 }
 
+Value Interpreter::lookUp(const Token& name, const Resolution& resolution) {
+    switch (resolution.kind) {
+        case Resolution::Kind::LOCAL: return frame[resolution.slot];
+        case Resolution::Kind::UPVALUE: return *upvalues[resolution.slot]->location;
+        default: return environment->get(name);
+    }
+}
+
+void Interpreter::assign(const Token& name, const Resolution& resolution, const Value& value) {
+    switch (resolution.kind) {
+        case Resolution::Kind::LOCAL: frame[resolution.slot] = value; break;
+        case Resolution::Kind::UPVALUE:
+            writeBarrier(value);
+            *upvalues[resolution.slot]->location = value;
+            break;
+        default: environment->assign(name, value); break;
+    }
+}
+
+void Interpreter::define(const std::string& name, const Resolution& resolution, const Value& value) {
+    if (resolution.kind == Resolution::Kind::LOCAL) {
+        frame[resolution.slot] = value;
+    } else {
+        environment->define(name, value);
+    }
+}
+
 Value Interpreter::visitVariableExpr(VariableExpr& expr) {
-    return environment->get(expr.name);
+    return lookUp(expr.name, expr.resolution);
 }
 
 Value Interpreter::visitAssignExpr(AssignExpr& expr) {
     Value value = evaluate(*expr.value);
-    environment->assign(expr.name, value);
+    assign(expr.name, expr.resolution, value);
     return value;
 }
 Value Interpreter::visitLogicalExpr(LogicalExpr& expr) {
@@ -144,40 +322,339 @@ Value Interpreter::visitLogicalExpr(LogicalExpr& expr) {
     return evaluate(*expr.right);
 }
 Value Interpreter::visitCallExpr(CallExpr& expr) {
-    Value callee = evaluate(*expr.callee);
+    Value callee;
+    Value* base = stackTop;
+    LoxFunction* method = nullptr;
+    if (expr.method != nullptr) {
+        method = pushReceiver(evaluate(*expr.method->object), expr.method->name, callee);
+    } else {
+        callee = evaluate(*expr.callee);
+    }
+    Value* args = pushArguments(expr);
+    int argCount = static_cast<int>(expr.arguments.size());
+    Value result = method != nullptr ? invoke(*method, argCount, base, expr.paren)
+                                     : callValue(callee, argCount, args, expr.paren);
+    while (stackTop > base) {
+        *--stackTop = Value();
+    }
+    return result;
+}
+
+// Arguments are pushed where the callee's frame will start, so they become
+// its parameter slots without being copied.
+Value* Interpreter::pushArguments(CallExpr& expr) {
+    if (static_cast<int>(expr.arguments.size()) > stack.data() + STACK_MAX - stackTop) {
+        throw RuntimeError(expr.paren, "Stack overflow.");
+    }
     
-    std::vector<Value> arguments;
+    Value* args = stackTop;
     for (auto& argument : expr.arguments) {
-        arguments.push_back(evaluate(*argument));
+        Value value = evaluate(*argument);
+        *stackTop++ = std::move(value);
+    }
+    return args;
+}
+
+// Takes the object of a call `object.name(...)`. If `name` is a method of
+// the object's class, the object is pushed to become its receiver and
+// the method is returned, so that no bound method is made; otherwise the
+// property is looked up into `callee`.
+LoxFunction* Interpreter::pushReceiver(Value object, const Token& name, Value& callee) {
+    if (object.isObjType(ObjType::INSTANCE)) {
+        LoxFunction* method = static_cast<LoxInstance*>(object.asObject().get())->findMethod(name);
+        if (method != nullptr) {
+            if (stackTop == stack.data() + STACK_MAX) {
+                throw RuntimeError(name, "Stack overflow.");
+            }
+            *stackTop++ = std::move(object);
+            return method;
+        }
     }
+    callee = getProperty(object, name);
+    return nullptr;
+}
+
+Value Interpreter::call(const Value& callee, int argCount, Value* args, const Token& paren) {
+    GarbageCollector::Scope scope(gc);
+    Value* base = stackTop;
+    Value* previousFrame = frame;
+    std::shared_ptr<LoxUpvalue>* previousUpvalues = upvalues;
+    std::shared_ptr<Environment> previous = environment;
+    int previousDepth = callDepth;
     
+    if (argCount > stack.data() + STACK_MAX - base) {
+        throw RuntimeError(paren, "Stack overflow.");
+    }
+    for (int i = 0; i < argCount; i++) {
+        *stackTop++ = args[i];
+    }
+    
+    try {
+        Value result = callValue(callee, argCount, base, paren);
+        unwind(base);
+        return result;
+    } catch (...) {
+        unwind(base);
+        frame = previousFrame;
+        upvalues = previousUpvalues;
+        environment = std::move(previous);
+        callDepth = previousDepth;
+        throw;
+    }
+}
+
+void Interpreter::checkCall(LoxCallable& function, int argCount, const Token& paren) {
+    int arity = function.arity();
+    if (arity != -1 && argCount != arity) {
+        throw RuntimeError(paren, "Expected " + std::to_string(arity) + 
+                          " arguments but got " + std::to_string(argCount) + ".");
+    }
+    if (callDepth == CALL_DEPTH_MAX) {
+        throw RuntimeError(paren, "Stack overflow.");
+    }
+}
+
+Value Interpreter::callValue(const Value& callee, int argCount, Value* args, const Token& paren) {
     if (!callee.isCallable()) {
-        throw RuntimeError(expr.paren, "Can only call functions and classes.");
+        throw RuntimeError(paren, "Can only call functions and classes.");
+    }
+    
+    LoxCallable* function = callee.asCallable();
+    checkCall(*function, argCount, paren);
+    CallDepth depth(callDepth);
+    try {
+        return function->call(*this, argCount, args);
+    } catch (const RuntimeError&) {
+        throw;
+    } catch (const LoxError& error) {
+        throw RuntimeError(paren, error.what());
+    }
+}
+
+// Calls a method with its receiver and arguments already pushed.
+Value Interpreter::invoke(LoxFunction& method, int argCount, Value* receiver, const Token& paren) {
+    checkCall(method, argCount, paren);
+    CallDepth depth(callDepth);
+    try {
+        return callFunction(method, argCount + 1, receiver);
+    } catch (const RuntimeError&) {
+        throw;
+    } catch (const LoxError& error) {
+        throw RuntimeError(paren, error.what());
+    }
+}
+
+Value Interpreter::callMethod(LoxFunction& method, const Value& receiver, int argCount, Value* args) {
+    if (args + argCount == stack.data() + STACK_MAX) {
+        throw LoxError("Stack overflow.");
+    }
+    std::move_backward(args, args + argCount, args + argCount + 1);
+    *args = receiver;
+    stackTop = args + argCount + 1;
+    return callFunction(method, argCount + 1, args);
+}
+
+Value Interpreter::callFunction(LoxFunction& callee, int argCount, Value* args) {
+    Value* previousFrame = frame;
+    std::shared_ptr<LoxUpvalue>* previousUpvalues = upvalues;
+    std::shared_ptr<Environment> previous = std::move(environment);
+    
+    // Tail calls loop here instead of recursing, so they reuse this frame
+    // and a chain of them runs in constant C++ stack.
+    Value current;
+    LoxFunction* function = &callee;
+    Value result;
+    for (;;) {
+        FunctionStmt& declaration = *function->declaration;
+        int frameSize = std::max(declaration.frameSize, argCount);
+        if (frameSize > stack.data() + STACK_MAX - args) {
+            throw LoxError("Stack overflow.");
+        }
+        
+        environment = function->globals;
+        upvalues = function->upvalues.data();
+        frame = args;
+        stackTop = args + frameSize;
+        gc.safepoint();
+        
+        CompiledFunction* code = tierUpThreshold > 0 ? tierUp(declaration) : nullptr;
+        if (code != nullptr) {
+            result = run(*code);
+        } else {
+            if (closureCompilation) {
+                for (const StmtCode& statement : closureCode(declaration).select(frame)) {
+                    statement(*this);
+                    if (returning) break;
+                }
+            } else {
+                for (auto& statement : declaration.body) {
+                    execute(*statement);
+                    if (returning) break;
+                }
+            }
+            returning = false;
+            result = std::move(returnValue);
+            returnValue = Value();
+        }
+        
+        if (tailCallee.isNil()) break;
+        current = std::move(tailCallee);
+        tailCallee = Value();
+        function = static_cast<LoxFunction*>(current.asCallable());
+        argCount = tailArgCount;
+    }
+    
+    // The caller pops the arguments; the rest of the frame is ours.
+    closeUpvalues(args);
+    while (stackTop > args + argCount) {
+        *--stackTop = Value();
+    }
+    frame = previousFrame;
+    upvalues = previousUpvalues;
+    environment = std::move(previous);
+    
+    if (function->isInitializer) return args[0];
+    return result;
+}
+
+Value Interpreter::visitGetExpr(GetExpr& expr) {
+    return getProperty(evaluate(*expr.object), expr.name);
+}
+
+Value Interpreter::getProperty(const Value& object, const Token& name) {
+    if (object.isObjType(ObjType::INSTANCE)) {
+        return static_cast<LoxInstance*>(object.asObject().get())->get(name);
+    }
+    if (object.isObjType(ObjType::MODULE)) {
+        return static_cast<LoxModule*>(object.asObject().get())->get(name);
+    }
+    if (object.isObjType(ObjType::STRING_BUILDER)) {
+        return LoxStringBuilder::get(object.asObject(), name);
+    }
+    if (object.isObjType(ObjType::LIST) || object.isObjType(ObjType::MAP)) {
+        return collectionMethod(object.asObject(), name);
+    }
+    
+    throw RuntimeError(name, "Only instances have properties.");
+}
+
+Value Interpreter::visitSetExpr(SetExpr& expr) {
+    Value object = evaluate(*expr.object);
+    if (!object.isObjType(ObjType::INSTANCE)) {
+        throw RuntimeError(expr.name, "Only instances have fields.");
+    }
+    
+    Value value = evaluate(*expr.value);
+    static_cast<LoxInstance*>(object.asObject().get())->set(expr.name, value);
+    return value;
+}
+
+Value Interpreter::visitThisExpr(ThisExpr& expr) {
+    return lookUp(expr.keyword, expr.resolution);
+}
+
+Value Interpreter::visitSuperExpr(SuperExpr& expr) {
+    Value superclass = lookUp(expr.keyword, expr.resolution);
+    return superMethod(superclass, lookUp(expr.keyword, expr.thisResolution), expr.method);
+}
+
+Value Interpreter::superMethod(const Value& superclass, const Value& object, const Token& method) {
+    LoxFunction* found = static_cast<LoxClass*>(superclass.asObject().get())->findMethod(method);
+    if (found == nullptr) {
+        throw RuntimeError(method, "Undefined property '" + method.lexeme + "'.");
+    }
+    auto function = std::static_pointer_cast<LoxFunction>(found->shared_from_this());
+    return Value(std::static_pointer_cast<LoxObject>(makePooled<LoxBoundMethod>(object.asObject(), std::move(function))));
+}
+
+Value Interpreter::visitListExpr(ListExpr& expr) {
+    auto list = makePooled<LoxList>();
+    list->elements.reserve(expr.elements.size());
+    for (auto& element : expr.elements) {
+        list->elements.push_back(evaluate(*element));
+    }
+    return Value(std::static_pointer_cast<LoxObject>(list));
+}
+
+Value Interpreter::visitMapExpr(MapExpr& expr) {
+    auto map = makePooled<LoxMap>();
+    for (size_t i = 0; i < expr.keys.size(); i++) {
+        Value key = evaluate(*expr.keys[i]);
+        map->set(key, evaluate(*expr.values[i]));
+    }
+    return Value(std::static_pointer_cast<LoxObject>(map));
+}
+
+Value Interpreter::visitSubscriptExpr(SubscriptExpr& expr) {
+    Value object = evaluate(*expr.object);
+    return subscript(object, evaluate(*expr.index), expr.bracket);
+}
+
+Value Interpreter::subscript(const Value& object, const Value& index, const Token& bracket) {
+    try {
+        if (object.isObjType(ObjType::LIST)) {
+            const std::vector<Value>& elements = static_cast<LoxList*>(object.asObject().get())->elements;
+            return elements[LoxList::checkIndex(index, elements.size())];
+        }
+        if (object.isObjType(ObjType::MAP)) {
+            const Value* value = static_cast<LoxMap*>(object.asObject().get())->get(index);
+            return value != nullptr ? *value : Value();
+        }
+        if (object.isString()) {
+            const std::string& text = object.asString();
+            return Value(std::string(1, text[LoxList::checkIndex(index, text.size())]));
+        }
+    } catch (const LoxError& error) {
+        throw RuntimeError(bracket, error.what());
     }
     
-    std::shared_ptr<LoxCallable> function = callee.asCallable();
-    if (arguments.size() != function->arity()) {
-        throw RuntimeError(expr.paren, "Expected " + std::to_string(function->arity()) + 
-                          " arguments but got " + std::to_string(arguments.size()) + ".");
+    throw RuntimeError(bracket, "Only lists, maps and strings can be subscripted.");
+}
+
+Value Interpreter::visitSubscriptSetExpr(SubscriptSetExpr& expr) {
+    Value object = evaluate(*expr.object);
+    Value index = evaluate(*expr.index);
+    Value value = evaluate(*expr.value);
+    setSubscript(object, index, value, expr.bracket);
+    return value;
+}
+
+void Interpreter::setSubscript(const Value& object, const Value& index, const Value& value, const Token& bracket) {
+    if (object.isObjType(ObjType::LIST)) {
+        std::vector<Value>& elements = static_cast<LoxList*>(object.asObject().get())->elements;
+        try {
+            Value& element = elements[LoxList::checkIndex(index, elements.size())];
+            writeBarrier(value);
+            element = value;
+        } catch (const LoxError& error) {
+            throw RuntimeError(bracket, error.what());
+        }
+        return;
+    }
+    if (object.isObjType(ObjType::MAP)) {
+        static_cast<LoxMap*>(object.asObject().get())->set(index, value);
+        return;
     }
     
-    return function->call(*this, arguments);
+    throw RuntimeError(bracket, "Only lists and maps support subscript assignment.");
 }
-Value Interpreter::visitGetExpr(GetExpr& expr) { return Value(); }
-Value Interpreter::visitSetExpr(SetExpr& expr) { return Value(); }
-Value Interpreter::visitThisExpr(ThisExpr& expr) { return Value(); }
-Value Interpreter::visitSuperExpr(SuperExpr& expr) { return Value(); }
 
 void Interpreter::visitVarStmt(VarStmt& stmt) {
     Value value;
     if (stmt.initializer != nullptr) {
         value = evaluate(*stmt.initializer);
     }
-    environment->define(stmt.name.lexeme, value);
+    define(stmt.name.lexeme, stmt.resolution, value);
 }
 
 void Interpreter::visitBlockStmt(BlockStmt& stmt) {
-    executeBlock(stmt.statements, std::make_shared<Environment>(environment));
+    for (auto& statement : stmt.statements) {
+        execute(*statement);
+        if (returning) break;
+    }
+    // Closures made in the block keep its variables; the frame slots are
+    // about to be reused.
+    if (stmt.capturedFrom >= 0) closeUpvalues(frame + stmt.capturedFrom);
 }
 
 void Interpreter::visitIfStmt(IfStmt& stmt) {
@@ -189,35 +666,214 @@ void Interpreter::visitIfStmt(IfStmt& stmt) {
 }
 
 void Interpreter::visitWhileStmt(WhileStmt& stmt) {
+    // Iterations make the enclosing function hot as well, and it runs as
+    // bytecode from its next call.
+    FunctionStmt* function = tierUpThreshold > 0 ? stmt.function : nullptr;
     while (isTruthy(evaluate(*stmt.condition))) {
         execute(*stmt.body);
+        if (returning) return;
+        gc.safepoint();
+        if (function != nullptr) {
+            function->hotness.store(function->hotness.load(std::memory_order_relaxed) + 1,
+                                    std::memory_order_relaxed);
+        }
     }
 }
 void Interpreter::visitFunctionStmt(FunctionStmt& stmt) {
-    std::shared_ptr<LoxFunction> function = std::make_shared<LoxFunction>(stmt, environment, false);
-    environment->define(stmt.name.lexeme, Value(function));
+    define(stmt.name.lexeme, stmt.resolution, Value(makeClosure(stmt, false)));
+}
+
+std::shared_ptr<LoxFunction> Interpreter::makeClosure(FunctionStmt& declaration, bool isInitializer) {
+    std::vector<std::shared_ptr<LoxUpvalue>> captured;
+    captured.reserve(declaration.captures.size());
+    for (const Capture& capture : declaration.captures) {
+        switch (capture.kind) {
+            case Capture::Kind::LOCAL: captured.push_back(captureUpvalue(frame + capture.index)); break;
+            case Capture::Kind::UPVALUE: captured.push_back(upvalues[capture.index]); break;
+        }
+    }
+    return makePooled<LoxFunction>(declaration, environment, std::move(captured), isInitializer);
+}
+
+// Closures capturing the same variable share one upvalue.
+std::shared_ptr<LoxUpvalue> Interpreter::captureUpvalue(Value* slot) {
+    auto it = openUpvalues.end();
+    while (it != openUpvalues.begin() && (*(it - 1))->location >= slot) {
+        --it;
+        if ((*it)->location == slot) return *it;
+    }
+    return *openUpvalues.insert(it, makePooled<LoxUpvalue>(slot));
+}
+
+void Interpreter::closeUpvalues(Value* last) {
+    while (!openUpvalues.empty() && openUpvalues.back()->location >= last) {
+        openUpvalues.back()->close();
+        openUpvalues.pop_back();
+    }
 }
 
 void Interpreter::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.tailCall != nullptr) {
+        returnTailCall(*stmt.tailCall);
+        return;
+    }
+    
     Value value;
     if (stmt.value != nullptr) {
         value = evaluate(*stmt.value);
     }
-    throw ReturnException(value);
+    returnValue = std::move(value);
+    returning = true;
 }
-void Interpreter::visitClassStmt(ClassStmt& stmt) {}
-void Interpreter::resolve(Expr& expr, int depth) {}
 
-void Interpreter::executeBlock(std::vector<std::unique_ptr<Stmt>>& statements, std::shared_ptr<Environment> environment) {
-    std::shared_ptr<Environment> previous = this->environment;
-    try {
-        this->environment = environment;
-        for (auto& statement : statements) {
-            execute(*statement);
+void Interpreter::returnTailCall(CallExpr& expr) {
+    Value callee;
+    Value* base = stackTop;
+    LoxFunction* method = nullptr;
+    if (expr.method != nullptr) {
+        method = pushReceiver(evaluate(*expr.method->object), expr.method->name, callee);
+    } else {
+        callee = evaluate(*expr.callee);
+    }
+    Value* args = pushArguments(expr);
+    returnCall(callee, method, base, args, static_cast<int>(expr.arguments.size()), expr.paren);
+}
+
+// Finishes a call in tail position whose callee (or method, with its
+// receiver at `base`) and arguments have been pushed.
+void Interpreter::returnCall(Value& callee, LoxFunction* method, Value* base, Value* args, int argCount,
+                             const Token& paren) {
+    // A method's receiver goes along as its first argument.
+    if (method != nullptr && method->arity() == argCount) {
+        callee = Value(method->shared_from_this());
+        args = base;
+        argCount++;
+    } else if (method != nullptr ||
+               !callee.isObjType(ObjType::FUNCTION) || callee.asCallable()->arity() != argCount) {
+        // Anything but a Lox function of the right arity takes the ordinary
+        // path, which also reports the errors.
+        returnValue = method != nullptr ? invoke(*method, argCount, base, paren)
+                                        : callValue(callee, argCount, args, paren);
+        while (stackTop > base) {
+            *--stackTop = Value();
         }
-    } catch (...) {
-        this->environment = previous;
-        throw;
+        returning = true;
+        return;
+    }
+    
+    // Nothing in the returning frame is needed any more, so the arguments
+    // move down to become the callee's parameters.
+    closeUpvalues(frame);
+    std::move(args, stackTop, frame);
+    std::fill(frame + argCount, stackTop, Value());
+    stackTop = frame + argCount;
+    tailCallee = std::move(callee);
+    tailArgCount = argCount;
+    returning = true;
+}
+
+void Interpreter::visitClassStmt(ClassStmt& stmt) {
+    std::shared_ptr<LoxClass> superclass;
+    if (stmt.superclass != nullptr) {
+        Value value = evaluate(*stmt.superclass);
+        if (!value.isObjType(ObjType::CLASS)) {
+            throw RuntimeError(stmt.superclass->name, "Superclass must be a class.");
+        }
+        superclass = std::static_pointer_cast<LoxClass>(value.asObject());
+    }
+    
+    define(stmt.name.lexeme, stmt.resolution, Value());
+    
+    if (superclass != nullptr) {
+        frame[stmt.superclassSlot] = Value(std::static_pointer_cast<LoxObject>(superclass));
+    }
+    
+    MethodTable methods;
+    for (auto& method : stmt.methods) {
+        bool isInitializer = method->name.lexeme == "init";
+        methods.insert(method->name.lexeme, method->name.hash) = makeClosure(*method, isInitializer);
+    }
+    
+    if (superclass != nullptr) {
+        closeUpvalues(frame + stmt.superclassSlot);
+        frame[stmt.superclassSlot] = Value();
+    }
+    auto klass = makePooled<LoxClass>(stmt.name.lexeme, superclass, std::move(methods));
+    define(stmt.name.lexeme, stmt.resolution, Value(std::static_pointer_cast<LoxObject>(klass)));
+}
+
+void Interpreter::visitImportStmt(ImportStmt& stmt) {
+    auto module = modules.find(stmt.resolvedPath);
+    if (module == modules.end()) {
+        throw RuntimeError(stmt.path, "Module '" + stmt.path.literal + "' is not loaded.");
+    }
+    environment->define(stmt.name, Value(std::static_pointer_cast<LoxObject>(module->second)));
+}
+// Inherited methods are copied down into the class's own table, so that
+// looking one up is a single probe however deep the hierarchy.
+LoxClass::LoxClass(const std::string& name, std::shared_ptr<LoxClass> superclass, MethodTable methods)
+    : LoxCallable(ObjType::CLASS), name(name), superclass(std::move(superclass)), methods(std::move(methods)) {
+    if (this->superclass != nullptr) {
+        for (const auto& method : this->superclass->methods) {
+            size_t hash = MethodTable::hashOf(method.key);
+            if (this->methods.find(method.key, hash) == nullptr) this->methods.insert(method.key, hash) = method.value;
+        }
+    }
+    initializer = findMethod("init", MethodTable::hashOf("init"));
+}
+
+int LoxClass::arity() {
+    return initializer == nullptr ? 0 : initializer->arity();
+}
+
+Value LoxClass::call(Interpreter& interpreter, int argCount, Value* args) {
+    auto instance = makePooled<LoxInstance>(std::static_pointer_cast<LoxClass>(shared_from_this()));
+    if (initializer != nullptr) {
+        interpreter.callMethod(*initializer, Value(std::static_pointer_cast<LoxObject>(instance)), argCount, args);
+    }
+    return Value(std::static_pointer_cast<LoxObject>(instance));
+}
+
+std::string LoxClass::toString() const {
+    return name;
+}
+
+LoxInstance::LoxInstance(std::shared_ptr<LoxClass> klass)
+    : LoxObject(ObjType::INSTANCE), klass(std::move(klass)) {}
+
+std::string LoxInstance::toString() const {
+    return klass->getName() + " instance";
+}
+
+Value LoxInstance::get(const Token& name) {
+    const Value* field = fields.find(name.lexeme, name.hash);
+    if (field != nullptr) return *field;
+    
+    LoxFunction* method = klass->findMethod(name);
+    if (method != nullptr) {
+        auto function = std::static_pointer_cast<LoxFunction>(method->shared_from_this());
+        return Value(std::static_pointer_cast<LoxObject>(makePooled<LoxBoundMethod>(shared_from_this(), std::move(function))));
+    }
+    
+    throw RuntimeError(name, "Undefined property '" + name.lexeme + "'.");
+}
+
+void LoxInstance::set(const Token& name, const Value& value) {
+    writeBarrier(value);
+    fields.insert(name.lexeme, name.hash) = value;
+}
+
+LoxModule::LoxModule(const std::string& name, std::shared_ptr<Environment> environment,
+                     std::shared_ptr<Module> source)
+    : LoxObject(ObjType::MODULE), name(name), environment(environment), source(source) {}
+
+std::string LoxModule::toString() const {
+    return "<module " + name + ">";
+}
+
+Value LoxModule::get(const Token& name) {
+    if (!environment->isDefined(name.lexeme)) {
+        throw RuntimeError(name, "Undefined property '" + name.lexeme + "' in module '" + this->name + "'.");
     }
-    this->environment = previous;
+    return environment->getAt(0, name.lexeme);
 }
\ No newline at end of file
@@ -1,45 +1,147 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <unordered_map>
 #include "../parser/ast.h"
+#include "../common/flat_hash_map.h"
+#include "../common/output.h"
 #include "../common/value.h"
+#include "../gc/gc.h"
 #include "environment.h"
-
-class ReturnException : public std::runtime_error {
-public:
-    Value value;
-    
-    ReturnException(const Value& value) 
-        : std::runtime_error("return"), value(value) {}
-};
+#include "callable.h"
 
 // Forward declarations
 class LoxCallable;
 class LoxFunction;
 class LoxClass;
 class LoxInstance;
+class LoxModule;
+class ErrorReporter;
+struct Module;
+struct ClosureCode;
 
+// One interpreter is one isolate: it owns all of its runtime state and
+// shares nothing mutable with other interpreters, so several can run on
+// different threads at once.
 class Interpreter : public ExprVisitor, public StmtVisitor {
+    friend class ClosureCompiler;
+    
 private:
+    GarbageCollector gc;  // first in, last out: it collects what the rest leave behind
+    ErrorReporter& reporter;
+    OutputBuffer& out;
+    std::shared_ptr<Environment> builtins;  // natives; survive reset()
     std::shared_ptr<Environment> globals;
-    std::shared_ptr<Environment> environment;
-    std::unordered_map<Expr*, int> locals;
+    std::shared_ptr<Environment> environment;  // globals of the running code's module
+    std::unordered_map<std::string, std::shared_ptr<LoxModule>> modules;
+    std::vector<std::shared_ptr<Module>> scripts;
+    
+    // Arguments and locals live on this stack, one frame per call, so
+    // calling a function allocates nothing. It is sized once: frames and
+    // open upvalues point into it.
+    static constexpr int STACK_MAX = 64 * 1024;
+    static constexpr int CALL_DEPTH_MAX = 2048;
+    std::vector<Value> stack;
+    Value* frame;
+    Value* stackTop;
+    int callDepth = 0;
+    // Counts a call in callDepth while it runs, however it ends.
+    struct CallDepth {
+        int& depth;
+        explicit CallDepth(int& depth) : depth(depth) { depth++; }
+        ~CallDepth() { depth--; }
+    };
+    
+    // The running closure's upvalues, and the upvalues still pointing into
+    // the stack, ordered by the slot they point at.
+    std::shared_ptr<LoxUpvalue>* upvalues = nullptr;
+    std::vector<std::shared_ptr<LoxUpvalue>> openUpvalues;
+    
+    // A return statement sets these; statement lists stop executing until
+    // the function call that is returning picks up the value.
+    bool returning = false;
+    Value returnValue;
+    // A return in tail position that calls a Lox function leaves the
+    // callee here, with its arguments already at the base of the returning
+    // frame, and callFunction runs it in place of the function that returned.
+    Value tailCallee;
+    int tailArgCount = 0;
+    
+    // Tiered mode: a function is compiled to bytecode once its calls and
+    // loop iterations reach this many, and runs as bytecode from then on.
+    // 0 keeps every function in the tree-walker.
+    unsigned tierUpThreshold = 0;
+    // Closure mode: function bodies are compiled to closures on their first
+    // call and run as those instead of being walked.
+    bool closureCompilation = false;
 
     void checkNumberOperand(const Token& operator_, const Value& operand);
     void checkNumberOperands(const Token& operator_, const Value& left, const Value& right);
+    const Value* inPlace(int slot, const Value* constant) { return slot >= 0 ? &frame[slot] : constant; }
+    Value binary(const Token& operator_, const Value& left, const Value& right);
+    Value numberBinary(TokenType operator_, double left, double right);
+    void print(const Value& value);
+    Value getProperty(const Value& object, const Token& name);
+    Value superMethod(const Value& superclass, const Value& object, const Token& method);
+    Value subscript(const Value& object, const Value& index, const Token& bracket);
+    void setSubscript(const Value& object, const Value& index, const Value& value, const Token& bracket);
     bool isTruthy(const Value& value);
     bool isEqual(const Value& a, const Value& b);
     std::string stringify(const Value& value);
     Value evaluate(Expr& expr);
     void execute(Stmt& stmt);
-    void resolve(Expr& expr, int depth);
+    void executeModule(std::vector<std::unique_ptr<Stmt>>& statements, int frameSize,
+                       std::shared_ptr<Environment> scope);
+    Value* pushArguments(CallExpr& expr);
+    LoxFunction* pushReceiver(Value object, const Token& name, Value& callee);
+    void returnTailCall(CallExpr& expr);
+    void returnCall(Value& callee, LoxFunction* method, Value* base, Value* args, int argCount,
+                    const Token& paren);
+    void checkCall(LoxCallable& function, int argCount, const Token& paren);
+    Value callValue(const Value& callee, int argCount, Value* args, const Token& paren);
+    Value invoke(LoxFunction& method, int argCount, Value* receiver, const Token& paren);
+    void unwind(Value* base);
+    std::shared_ptr<LoxFunction> makeClosure(FunctionStmt& declaration, bool isInitializer);
+    std::shared_ptr<LoxUpvalue> captureUpvalue(Value* slot);
+    void closeUpvalues(Value* last);
+    CompiledFunction* tierUp(FunctionStmt& function);
+    Value run(CompiledFunction& code);
+    ClosureCode& closureCode(FunctionStmt& function);
+    // Stores code just compiled for a function in one of its slots and
+    // returns it, unless another isolate compiled it at the same time; its
+    // code wins, and is returned instead.
+    template <typename Code>
+    static Code* install(std::atomic<Code*>& slot, std::unique_ptr<Code> compiled) {
+        Code* code = nullptr;
+        if (slot.compare_exchange_strong(code, compiled.get(), std::memory_order_acq_rel)) {
+            return compiled.release();
+        }
+        return code;
+    }
+    
+    Value lookUp(const Token& name, const Resolution& resolution);
+    void assign(const Token& name, const Resolution& resolution, const Value& value);
+    void define(const std::string& name, const Resolution& resolution, const Value& value);
 
 public:
-    Interpreter();
+    Interpreter(ErrorReporter& reporter, OutputBuffer& out);
     
-    void interpret(std::vector<std::unique_ptr<Stmt>>& statements);
-    void executeBlock(std::vector<std::unique_ptr<Stmt>>& statements, std::shared_ptr<Environment> environment);
+    void interpretModule(const std::shared_ptr<Module>& module, bool isMain);
+    // Keeps a module's AST alive as long as the isolate, for functions made
+    // from it without running it, as restoring a snapshot does.
+    void retain(const std::shared_ptr<Module>& module);
+    
+    // Calls any callable value from outside the interpreter; `paren`
+    // locates errors. If the call fails, the stack is unwound before the
+    // error propagates to the host.
+    Value call(const Value& callee, int argCount, Value* args, const Token& paren);
+    // Runs a Lox function whose arguments are already on the value stack.
+    // A method's receiver is its first argument.
+    Value callFunction(LoxFunction& function, int argCount, Value* args);
+    // Runs a method with `receiver` as 'this'. The arguments are on top of
+    // the value stack, and move up a slot to make room for it.
+    Value callMethod(LoxFunction& method, const Value& receiver, int argCount, Value* args);
     
     // Expression visitors
     Value visitBinaryExpr(BinaryExpr& expr) override;
@@ -54,6 +156,10 @@ public:
     Value visitSetExpr(SetExpr& expr) override;
     Value visitThisExpr(ThisExpr& expr) override;
     Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSubscriptExpr(SubscriptExpr& expr) override;
+    Value visitSubscriptSetExpr(SubscriptSetExpr& expr) override;
     
     // Statement visitors
     void visitExpressionStmt(ExpressionStmt& stmt) override;
@@ -65,46 +171,94 @@ public:
     void visitFunctionStmt(FunctionStmt& stmt) override;
     void visitReturnStmt(ReturnStmt& stmt) override;
     void visitClassStmt(ClassStmt& stmt) override;
-    
-    // Resolver support
+    void visitImportStmt(ImportStmt& stmt) override;
     
     // Global environment access
     std::shared_ptr<Environment> getGlobals() { return globals; }
+    OutputBuffer& getOutput() { return out; }
+    void defineNative(const std::string& name, int arity, NativeFn function);
+    static constexpr unsigned TIER_UP_THRESHOLD = 1000;
+    void setTierUpThreshold(unsigned threshold) { tierUpThreshold = threshold; }
+    void setClosureCompilation(bool enabled) { closureCompilation = enabled; }
+    GarbageCollector& getCollector() { return gc; }
+    // Drops every global, module and script, keeping only the natives.
+    void reset();
 };
 
 
 
+using MethodTable = FlatHashMap<std::string, std::shared_ptr<LoxFunction>>;
+
 // Class object
 class LoxClass : public LoxCallable {
+    friend class GarbageCollector;
+    friend class Snapshot;
+    
 private:
     std::string name;
     std::shared_ptr<LoxClass> superclass;
-    std::unordered_map<std::string, std::shared_ptr<LoxFunction>> methods;
+    MethodTable methods;  // inherited ones included
+    LoxFunction* initializer;  // looked up once, not per call
 
 public:
-    LoxClass(const std::string& name, std::shared_ptr<LoxClass> superclass, 
-             std::unordered_map<std::string, std::shared_ptr<LoxFunction>> methods);
+    LoxClass(const std::string& name, std::shared_ptr<LoxClass> superclass, MethodTable methods);
     
     int arity() override;
-    Value call(Interpreter& interpreter, std::vector<Value>& arguments) override;
+    Value call(Interpreter& interpreter, int argCount, Value* args) override;
     std::string toString() const override;
-    std::string getType() const override;
     
-    std::shared_ptr<LoxFunction> findMethod(const std::string& name);
+    const std::string& getName() const { return name; }
+    LoxFunction* findMethod(const std::string& name, size_t hash) {
+        const std::shared_ptr<LoxFunction>* method = methods.find(name, hash);
+        return method != nullptr ? method->get() : nullptr;
+    }
+    LoxFunction* findMethod(const Token& name) { return findMethod(name.lexeme, name.hash); }
 };
 
 // Instance object
 class LoxInstance : public LoxObject {
+    friend class GarbageCollector;
+    friend class Snapshot;
+    
 private:
     std::shared_ptr<LoxClass> klass;
-    std::unordered_map<std::string, Value> fields;
+    FlatHashMap<std::string, Value> fields;
 
 public:
     explicit LoxInstance(std::shared_ptr<LoxClass> klass);
     
     std::string toString() const override;
-    std::string getType() const override;
     
     Value get(const Token& name);
     void set(const Token& name, const Value& value);
+    // Where a field is in the field table, for the bytecode's property
+    // caches: SIZE_MAX if there's no such field. cachedField() returns the
+    // field if it is in that slot of this instance's table.
+    size_t fieldSlot(const Token& name) const { return fields.slotOf(name.lexeme, name.hash); }
+    const Value* cachedField(size_t slot, const Token& name) const {
+        return fields.findAt(slot, name.lexeme, name.hash);
+    }
+    // The method `object.name()` calls, unless a field of that name hides it.
+    LoxFunction* findMethod(const Token& name) {
+        return fields.find(name.lexeme, name.hash) == nullptr ? klass->findMethod(name) : nullptr;
+    }
+};
+
+// Module namespace object, bound by an import statement
+class LoxModule : public LoxObject {
+    friend class GarbageCollector;
+    
+private:
+    std::string name;
+    std::shared_ptr<Environment> environment;
+    std::shared_ptr<Module> source;
+
+public:
+    LoxModule(const std::string& name, std::shared_ptr<Environment> environment,
+              std::shared_ptr<Module> source);
+    
+    std::string toString() const override;
+    
+    Value get(const Token& name);
+    const std::shared_ptr<Module>& getSource() const { return source; }
 };
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "number_inference.h"
+
+NumberInference::NumberInference(FunctionStmt& function, bool speculate) : numbers(function.frameSize, true) {
+    // The receiver is an instance; parameters are whatever the caller
+    // passes unless we speculate.
+    int params = static_cast<int>(function.params.size());
+    for (int slot = 0; slot < function.firstParam + params; slot++) {
+        numbers[slot] = speculate && slot >= function.firstParam;
+    }
+
+    do {
+        changed = false;
+        for (auto& statement : function.body) {
+            statement->accept(*this);
+        }
+    } while (changed);
+
+    for (int slot = function.firstParam; slot < function.firstParam + params; slot++) {
+        if (numbers[slot]) guarded.push_back(slot);
+    }
+}
+
+void NumberInference::store(const Resolution& resolution, bool number) {
+    if (resolution.kind == Resolution::Kind::LOCAL && !number && numbers[resolution.slot]) {
+        numbers[resolution.slot] = false;
+        changed = true;
+    }
+}
+
+// Locals a nested function captures can change behind our back.
+void NumberInference::capture(const FunctionStmt& function) {
+    for (const Capture& captured : function.captures) {
+        if (captured.kind == Capture::Kind::LOCAL) {
+            store(Resolution{Resolution::Kind::LOCAL, captured.index}, false);
+        }
+    }
+}
+
+void NumberInference::visitAll(const std::vector<std::unique_ptr<Expr>>& exprs) {
+    for (auto& expr : exprs) {
+        expr->accept(*this);
+    }
+}
+
+// Every operand is visited, not just enough of them to decide, so that
+// each pass sees every store.
+Value NumberInference::visitBinaryExpr(BinaryExpr& expr) {
+    bool left = isNumber(*expr.left);
+    bool right = isNumber(*expr.right);
+    switch (expr.operator_.type) {
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+            return Value(true);  // or an error
+        case TokenType::PLUS:
+            return Value(left && right);
+        default:
+            return Value(false);
+    }
+}
+
+Value NumberInference::visitGroupingExpr(GroupingExpr& expr) {
+    return Value(isNumber(*expr.expression));
+}
+
+Value NumberInference::visitLiteralExpr(LiteralExpr& expr) {
+    return Value(expr.value.isNumber());
+}
+
+Value NumberInference::visitUnaryExpr(UnaryExpr& expr) {
+    expr.right->accept(*this);
+    return Value(expr.operator_.type == TokenType::MINUS);
+}
+
+Value NumberInference::visitVariableExpr(VariableExpr& expr) {
+    return Value(expr.resolution.kind == Resolution::Kind::LOCAL && numbers[expr.resolution.slot]);
+}
+
+Value NumberInference::visitAssignExpr(AssignExpr& expr) {
+    bool number = isNumber(*expr.value);
+    store(expr.resolution, number);
+    return Value(number);
+}
+
+Value NumberInference::visitLogicalExpr(LogicalExpr& expr) {
+    bool left = isNumber(*expr.left);
+    bool right = isNumber(*expr.right);
+    return Value(left && right);
+}
+
+Value NumberInference::visitCallExpr(CallExpr& expr) {
+    expr.callee->accept(*this);
+    visitAll(expr.arguments);
+    return Value(false);
+}
+
+Value NumberInference::visitGetExpr(GetExpr& expr) {
+    expr.object->accept(*this);
+    return Value(false);
+}
+
+Value NumberInference::visitSetExpr(SetExpr& expr) {
+    expr.object->accept(*this);
+    expr.value->accept(*this);
+    return Value(false);
+}
+
+Value NumberInference::visitThisExpr(ThisExpr&) {
+    return Value(false);
+}
+
+Value NumberInference::visitSuperExpr(SuperExpr&) {
+    return Value(false);
+}
+
+Value NumberInference::visitListExpr(ListExpr& expr) {
+    visitAll(expr.elements);
+    return Value(false);
+}
+
+Value NumberInference::visitMapExpr(MapExpr& expr) {
+    visitAll(expr.keys);
+    visitAll(expr.values);
+    return Value(false);
+}
+
+Value NumberInference::visitSubscriptExpr(SubscriptExpr& expr) {
+    expr.object->accept(*this);
+    expr.index->accept(*this);
+    return Value(false);
+}
+
+Value NumberInference::visitSubscriptSetExpr(SubscriptSetExpr& expr) {
+    expr.object->accept(*this);
+    expr.index->accept(*this);
+    expr.value->accept(*this);
+    return Value(false);
+}
+
+void NumberInference::visitExpressionStmt(ExpressionStmt& stmt) {
+    stmt.expression->accept(*this);
+}
+
+void NumberInference::visitPrintStmt(PrintStmt& stmt) {
+    stmt.expression->accept(*this);
+}
+
+void NumberInference::visitVarStmt(VarStmt& stmt) {
+    store(stmt.resolution, stmt.initializer != nullptr && isNumber(*stmt.initializer));
+}
+
+void NumberInference::visitBlockStmt(BlockStmt& stmt) {
+    for (auto& statement : stmt.statements) {
+        statement->accept(*this);
+    }
+}
+
+void NumberInference::visitIfStmt(IfStmt& stmt) {
+    stmt.condition->accept(*this);
+    stmt.thenBranch->accept(*this);
+    if (stmt.elseBranch != nullptr) stmt.elseBranch->accept(*this);
+}
+
+void NumberInference::visitWhileStmt(WhileStmt& stmt) {
+    stmt.condition->accept(*this);
+    stmt.body->accept(*this);
+}
+
+// Nested functions get their own inference when they are compiled.
+void NumberInference::visitFunctionStmt(FunctionStmt& stmt) {
+    store(stmt.resolution, false);
+    capture(stmt);
+}
+
+void NumberInference::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.value != nullptr) stmt.value->accept(*this);
+}
+
+void NumberInference::visitClassStmt(ClassStmt& stmt) {
+    store(stmt.resolution, false);
+    if (stmt.superclass != nullptr) {
+        stmt.superclass->accept(*this);
+        store(Resolution{Resolution::Kind::LOCAL, stmt.superclassSlot}, false);
+    }
+    for (auto& method : stmt.methods) {
+        capture(*method);
+    }
+}
+
+void NumberInference::visitImportStmt(ImportStmt&) {}
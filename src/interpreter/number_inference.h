@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include "../parser/ast.h"
+
+// Proves which frame slots of a function only ever hold numbers, and so
+// which expressions always produce one, for the closure compiler to keep
+// them unboxed. A slot holds numbers if every store to it does: each
+// variable initializer and assignment to it is itself a number, and no
+// closure captures it, since the closure could store anything. Starting
+// from every slot and dropping those with a store that isn't a number
+// until none is left reaches the largest such set.
+//
+// Parameters are stored by the caller. With `speculate` they count as
+// numbers too, and guards() lists those the result depends on: the code
+// may only run while they hold numbers.
+class NumberInference : public ExprVisitor, public StmtVisitor {
+public:
+    NumberInference(FunctionStmt& function, bool speculate);
+
+    // Whether the expression's value, if it produces one, is a number.
+    bool isNumber(Expr& expr) { return expr.accept(*this).asBool(); }
+    bool isNumberSlot(int slot) const { return numbers[slot]; }
+    const std::vector<int>& guards() const { return guarded; }
+
+    Value visitBinaryExpr(BinaryExpr& expr) override;
+    Value visitGroupingExpr(GroupingExpr& expr) override;
+    Value visitLiteralExpr(LiteralExpr& expr) override;
+    Value visitUnaryExpr(UnaryExpr& expr) override;
+    Value visitVariableExpr(VariableExpr& expr) override;
+    Value visitAssignExpr(AssignExpr& expr) override;
+    Value visitLogicalExpr(LogicalExpr& expr) override;
+    Value visitCallExpr(CallExpr& expr) override;
+    Value visitGetExpr(GetExpr& expr) override;
+    Value visitSetExpr(SetExpr& expr) override;
+    Value visitThisExpr(ThisExpr& expr) override;
+    Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSubscriptExpr(SubscriptExpr& expr) override;
+    Value visitSubscriptSetExpr(SubscriptSetExpr& expr) override;
+
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitImportStmt(ImportStmt& stmt) override;
+
+private:
+    std::vector<bool> numbers;  // by frame slot
+    std::vector<int> guarded;
+    bool changed = false;
+
+    void store(const Resolution& resolution, bool number);
+    void capture(const FunctionStmt& function);
+    void visitAll(const std::vector<std::unique_ptr<Expr>>& exprs);
+};
@@ -0,0 +1,359 @@
+#include "resolver.h"
+#include "../common/error.h"
+#include <algorithm>
+
+Resolver::Resolver(ErrorReporter& reporter) : reporter(reporter) {}
+
+int Resolver::resolveModule(std::vector<std::unique_ptr<Stmt>>& statements) {
+    functions.push_back(Function{FunctionType::NONE, nullptr, 0, 0});
+    resolve(statements);
+    int frameSize = functions.back().frameSize;
+    functions.pop_back();
+    return frameSize;
+}
+
+void Resolver::resolve(std::vector<std::unique_ptr<Stmt>>& statements) {
+    for (auto& statement : statements) {
+        resolve(*statement);
+    }
+}
+
+void Resolver::resolve(Stmt& stmt) {
+    stmt.accept(*this);
+}
+
+void Resolver::resolve(Expr& expr) {
+    expr.accept(*this);
+}
+
+void Resolver::resolveFunction(FunctionStmt& function, FunctionType type) {
+    functions.push_back(Function{type, &function, 0, 0});
+    function.captures.clear();
+
+    beginScope();
+    // A method's receiver comes before its parameters, in slot 0.
+    if (type == FunctionType::METHOD || type == FunctionType::INITIALIZER) {
+        Token receiver(TokenType::THIS, "this", "", function.name.line);
+        declare(receiver);
+        define(receiver);
+        function.firstParam = 1;
+    }
+    for (const Token& param : function.params) {
+        declare(param);
+        define(param);
+    }
+    resolve(function.body);
+    endScope();
+
+    function.frameSize = functions.back().frameSize;
+    functions.pop_back();
+}
+
+Resolution Resolver::resolveLocal(const Token& name) {
+    int function = static_cast<int>(functions.size()) - 1;
+    for (int i = static_cast<int>(scopes.size()) - 1; i >= 0 && scopes[i].function == function; i--) {
+        auto found = scopes[i].variables.find(name.lexeme);
+        if (found != scopes[i].variables.end()) {
+            return Resolution{Resolution::Kind::LOCAL, found->second.slot};
+        }
+    }
+
+    int upvalue = resolveUpvalue(function, name.lexeme);
+    if (upvalue != -1) return Resolution{Resolution::Kind::UPVALUE, upvalue};
+    return Resolution{};
+}
+
+// Finds `name` in the functions enclosing `function` and threads it down
+// as an upvalue through every function in between. Returns the upvalue's
+// index in `function`, or -1 if the name is global.
+int Resolver::resolveUpvalue(int function, const std::string& name) {
+    if (function == 0) return -1;
+
+    for (int i = static_cast<int>(scopes.size()) - 1; i >= 0 && scopes[i].function >= function - 1; i--) {
+        if (scopes[i].function != function - 1) continue;
+        auto found = scopes[i].variables.find(name);
+        if (found == scopes[i].variables.end()) continue;
+
+        found->second.captured = true;
+        return addUpvalue(function, Capture{Capture::Kind::LOCAL, found->second.slot});
+    }
+
+    int enclosing = resolveUpvalue(function - 1, name);
+    if (enclosing == -1) return -1;
+    return addUpvalue(function, Capture{Capture::Kind::UPVALUE, enclosing});
+}
+
+int Resolver::addUpvalue(int function, Capture capture) {
+    std::vector<Capture>& captures = functions[function].declaration->captures;
+    for (size_t i = 0; i < captures.size(); i++) {
+        if (captures[i].kind == capture.kind && captures[i].index == capture.index) return static_cast<int>(i);
+    }
+    captures.push_back(capture);
+    return static_cast<int>(captures.size()) - 1;
+}
+
+void Resolver::beginScope() {
+    scopes.push_back(Scope{{}, static_cast<int>(functions.size()) - 1});
+}
+
+// Returns the lowest frame slot of the scope that a closure captured, which
+// the interpreter must close when the scope exits, or -1.
+int Resolver::endScope() {
+    int capturedFrom = -1;
+    int size = 0;
+    for (const auto& entry : scopes.back().variables) {
+        const Variable& variable = entry.second;
+        size++;
+        if (variable.captured && (capturedFrom == -1 || variable.slot < capturedFrom)) {
+            capturedFrom = variable.slot;
+        }
+    }
+    functions.back().frameSlots -= size;
+    scopes.pop_back();
+    return capturedFrom;
+}
+
+Resolution Resolver::declare(const Token& name) {
+    if (scopes.empty()) return Resolution{};
+
+    Scope& scope = scopes.back();
+    auto existing = scope.variables.find(name.lexeme);
+    if (existing != scope.variables.end()) {
+        reporter.error(name, "Already a variable with this name in this scope.");
+        return Resolution{Resolution::Kind::LOCAL, existing->second.slot};
+    }
+
+    Function& function = functions.back();
+    int slot = function.frameSlots++;
+    function.frameSize = std::max(function.frameSize, function.frameSlots);
+    scope.variables[name.lexeme] = Variable{slot, false};
+    return Resolution{Resolution::Kind::LOCAL, slot};
+}
+
+void Resolver::define(const Token& name) {
+    if (scopes.empty()) return;
+    scopes.back().variables[name.lexeme].defined = true;
+}
+
+Value Resolver::visitBinaryExpr(BinaryExpr& expr) {
+    resolve(*expr.left);
+    resolve(*expr.right);
+    expr.leftSlot = frameSlot(*expr.left);
+    expr.rightSlot = frameSlot(*expr.right);
+    expr.leftConstant = constant(*expr.left);
+    expr.rightConstant = constant(*expr.right);
+    return Value();
+}
+
+int Resolver::frameSlot(Expr& expr) {
+    auto* variable = dynamic_cast<VariableExpr*>(&expr);
+    if (variable == nullptr || variable->resolution.kind != Resolution::Kind::LOCAL) return -1;
+    return variable->resolution.slot;
+}
+
+const Value* Resolver::constant(Expr& expr) {
+    auto* literal = dynamic_cast<LiteralExpr*>(&expr);
+    return literal != nullptr ? &literal->value : nullptr;
+}
+
+Value Resolver::visitGroupingExpr(GroupingExpr& expr) {
+    resolve(*expr.expression);
+    return Value();
+}
+
+Value Resolver::visitLiteralExpr(LiteralExpr& expr) {
+    (void)expr;
+    return Value();
+}
+
+Value Resolver::visitUnaryExpr(UnaryExpr& expr) {
+    resolve(*expr.right);
+    return Value();
+}
+
+Value Resolver::visitVariableExpr(VariableExpr& expr) {
+    if (!scopes.empty()) {
+        auto found = scopes.back().variables.find(expr.name.lexeme);
+        if (found != scopes.back().variables.end() && !found->second.defined) {
+            reporter.error(expr.name, "Can't read local variable in its own initializer.");
+        }
+    }
+
+    expr.resolution = resolveLocal(expr.name);
+    return Value();
+}
+
+Value Resolver::visitAssignExpr(AssignExpr& expr) {
+    resolve(*expr.value);
+    expr.resolution = resolveLocal(expr.name);
+    return Value();
+}
+
+Value Resolver::visitLogicalExpr(LogicalExpr& expr) {
+    resolve(*expr.left);
+    resolve(*expr.right);
+    return Value();
+}
+
+Value Resolver::visitCallExpr(CallExpr& expr) {
+    resolve(*expr.callee);
+    for (auto& argument : expr.arguments) {
+        resolve(*argument);
+    }
+    expr.method = dynamic_cast<GetExpr*>(expr.callee.get());
+    return Value();
+}
+
+Value Resolver::visitGetExpr(GetExpr& expr) {
+    resolve(*expr.object);
+    return Value();
+}
+
+Value Resolver::visitSetExpr(SetExpr& expr) {
+    resolve(*expr.value);
+    resolve(*expr.object);
+    return Value();
+}
+
+Value Resolver::visitThisExpr(ThisExpr& expr) {
+    if (currentClass == ClassType::NONE) {
+        reporter.error(expr.keyword, "Can't use 'this' outside of a class.");
+        return Value();
+    }
+
+    expr.resolution = resolveLocal(expr.keyword);
+    return Value();
+}
+
+Value Resolver::visitSuperExpr(SuperExpr& expr) {
+    if (currentClass == ClassType::NONE) {
+        reporter.error(expr.keyword, "Can't use 'super' outside of a class.");
+        return Value();
+    }
+    if (currentClass != ClassType::SUBCLASS) {
+        reporter.error(expr.keyword, "Can't use 'super' in a class with no superclass.");
+        return Value();
+    }
+
+    expr.resolution = resolveLocal(expr.keyword);
+    expr.thisResolution = resolveLocal(Token(TokenType::THIS, "this", "", expr.keyword.line));
+    return Value();
+}
+
+Value Resolver::visitListExpr(ListExpr& expr) {
+    for (auto& element : expr.elements) {
+        resolve(*element);
+    }
+    return Value();
+}
+
+Value Resolver::visitMapExpr(MapExpr& expr) {
+    for (size_t i = 0; i < expr.keys.size(); i++) {
+        resolve(*expr.keys[i]);
+        resolve(*expr.values[i]);
+    }
+    return Value();
+}
+
+Value Resolver::visitSubscriptExpr(SubscriptExpr& expr) {
+    resolve(*expr.object);
+    resolve(*expr.index);
+    return Value();
+}
+
+Value Resolver::visitSubscriptSetExpr(SubscriptSetExpr& expr) {
+    resolve(*expr.object);
+    resolve(*expr.index);
+    resolve(*expr.value);
+    return Value();
+}
+
+void Resolver::visitExpressionStmt(ExpressionStmt& stmt) {
+    resolve(*stmt.expression);
+}
+
+void Resolver::visitPrintStmt(PrintStmt& stmt) {
+    resolve(*stmt.expression);
+}
+
+void Resolver::visitVarStmt(VarStmt& stmt) {
+    stmt.resolution = declare(stmt.name);
+    if (stmt.initializer != nullptr) {
+        resolve(*stmt.initializer);
+    }
+    define(stmt.name);
+}
+
+void Resolver::visitBlockStmt(BlockStmt& stmt) {
+    beginScope();
+    resolve(stmt.statements);
+    stmt.capturedFrom = endScope();
+}
+
+void Resolver::visitIfStmt(IfStmt& stmt) {
+    resolve(*stmt.condition);
+    resolve(*stmt.thenBranch);
+    if (stmt.elseBranch != nullptr) resolve(*stmt.elseBranch);
+}
+
+void Resolver::visitWhileStmt(WhileStmt& stmt) {
+    stmt.function = functions.back().declaration;
+    resolve(*stmt.condition);
+    resolve(*stmt.body);
+}
+
+void Resolver::visitFunctionStmt(FunctionStmt& stmt) {
+    stmt.resolution = declare(stmt.name);
+    define(stmt.name);
+    resolveFunction(stmt, FunctionType::FUNCTION);
+}
+
+void Resolver::visitReturnStmt(ReturnStmt& stmt) {
+    if (functions.back().type == FunctionType::NONE) {
+        reporter.error(stmt.keyword, "Can't return from top-level code.");
+    }
+
+    if (stmt.value != nullptr) {
+        if (functions.back().type == FunctionType::INITIALIZER) {
+            reporter.error(stmt.keyword, "Can't return a value from an initializer.");
+        }
+        resolve(*stmt.value);
+        stmt.tailCall = dynamic_cast<CallExpr*>(stmt.value.get());
+    }
+}
+
+void Resolver::visitClassStmt(ClassStmt& stmt) {
+    ClassType enclosingClass = currentClass;
+    currentClass = ClassType::CLASS;
+
+    stmt.resolution = declare(stmt.name);
+    define(stmt.name);
+
+    if (stmt.superclass != nullptr) {
+        if (stmt.superclass->name.lexeme == stmt.name.lexeme) {
+            reporter.error(stmt.superclass->name, "A class can't inherit from itself.");
+        }
+        currentClass = ClassType::SUBCLASS;
+        resolve(*stmt.superclass);
+
+        // The superclass sits in a frame slot while the methods that
+        // capture it as 'super' are created.
+        beginScope();
+        Token super(TokenType::SUPER, "super", "", stmt.name.line);
+        stmt.superclassSlot = declare(super).slot;
+        define(super);
+    }
+
+    for (auto& method : stmt.methods) {
+        FunctionType type = method->name.lexeme == "init" ? FunctionType::INITIALIZER : FunctionType::METHOD;
+        resolveFunction(*method, type);
+    }
+
+    if (stmt.superclass != nullptr) endScope();
+
+    currentClass = enclosingClass;
+}
+
+void Resolver::visitImportStmt(ImportStmt& stmt) {
+    (void)stmt;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../parser/ast.h"
+
+class ErrorReporter;
+
+// Static pass that runs once per module, before any of it executes, and
+// records on the AST where each variable lives. Every local gets a slot in
+// its function's call frame on the interpreter's value stack. A function
+// that uses variables of enclosing functions gets one upvalue per variable
+// it uses, found by free-variable analysis here, so its closures hold only
+// what they capture rather than whole scope chains. Because the results
+// live on the AST, every isolate running the module shares them.
+class Resolver : public ExprVisitor, public StmtVisitor {
+private:
+    enum class FunctionType { NONE, FUNCTION, INITIALIZER, METHOD };
+    enum class ClassType { NONE, CLASS, SUBCLASS };
+
+    struct Variable {
+        int slot;
+        bool defined;
+        bool captured = false;
+    };
+
+    struct Scope {
+        std::unordered_map<std::string, Variable> variables;
+        int function;  // index into functions of the function it belongs to
+    };
+
+    struct Function {
+        FunctionType type;
+        FunctionStmt* declaration;  // null for a module's top level
+        int frameSlots;  // frame slots in use at this point
+        int frameSize;   // most frame slots ever in use
+    };
+
+    ErrorReporter& reporter;
+    std::vector<Scope> scopes;
+    std::vector<Function> functions;
+    ClassType currentClass = ClassType::NONE;
+
+    void resolve(std::vector<std::unique_ptr<Stmt>>& statements);
+    void resolve(Stmt& stmt);
+    void resolve(Expr& expr);
+    void resolveFunction(FunctionStmt& function, FunctionType type);
+    Resolution resolveLocal(const Token& name);
+    int resolveUpvalue(int function, const std::string& name);
+    int addUpvalue(int function, Capture capture);
+
+    void beginScope();
+    int endScope();
+    Resolution declare(const Token& name);
+    void define(const Token& name);
+    static int frameSlot(Expr& expr);
+    static const Value* constant(Expr& expr);
+
+public:
+    explicit Resolver(ErrorReporter& reporter);
+
+    // Resolves a module's top level and returns how many frame slots its
+    // blocks need.
+    int resolveModule(std::vector<std::unique_ptr<Stmt>>& statements);
+
+    // Expression visitors
+    Value visitBinaryExpr(BinaryExpr& expr) override;
+    Value visitGroupingExpr(GroupingExpr& expr) override;
+    Value visitLiteralExpr(LiteralExpr& expr) override;
+    Value visitUnaryExpr(UnaryExpr& expr) override;
+    Value visitVariableExpr(VariableExpr& expr) override;
+    Value visitAssignExpr(AssignExpr& expr) override;
+    Value visitLogicalExpr(LogicalExpr& expr) override;
+    Value visitCallExpr(CallExpr& expr) override;
+    Value visitGetExpr(GetExpr& expr) override;
+    Value visitSetExpr(SetExpr& expr) override;
+    Value visitThisExpr(ThisExpr& expr) override;
+    Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSubscriptExpr(SubscriptExpr& expr) override;
+    Value visitSubscriptSetExpr(SubscriptSetExpr& expr) override;
+
+    // Statement visitors
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitImportStmt(ImportStmt& stmt) override;
+};
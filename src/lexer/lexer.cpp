@@ -2,7 +2,7 @@
 #include "../common/error.h"
 #include <cctype>
 
-std::unordered_map<std::string, TokenType> TokenUtils::keywords = {
+const FlatHashMap<std::string, TokenType> TokenUtils::keywords = {
     {"and",    TokenType::AND},
     {"class",  TokenType::CLASS},
     {"else",   TokenType::ELSE},
@@ -10,6 +10,7 @@ std::unordered_map<std::string, TokenType> TokenUtils::keywords = {
     {"for",    TokenType::FOR},
     {"fun",    TokenType::FUN},
     {"if",     TokenType::IF},
+    {"import", TokenType::IMPORT},
     {"nil",    TokenType::NIL},
     {"or",     TokenType::OR},
     {"print",  TokenType::PRINT},
@@ -22,14 +23,12 @@ std::unordered_map<std::string, TokenType> TokenUtils::keywords = {
 };
 
 TokenType TokenUtils::getKeywordType(const std::string& text) {
-    auto it = keywords.find(text);
-    if (it != keywords.end()) {
-        return it->second;
-    }
-    return TokenType::IDENTIFIER;
+    const TokenType* type = keywords.find(text);
+    return type != nullptr ? *type : TokenType::IDENTIFIER;
 }
 
-Lexer::Lexer(const std::string& source) : source(source) {}
+Lexer::Lexer(const std::string& source, ErrorReporter& reporter)
+    : source(source), reporter(reporter) {}
 
 std::vector<Token> Lexer::scanTokens() {
     while (!isAtEnd()) {
@@ -53,10 +52,13 @@ void Lexer::scanToken() {
         case ')': addToken(TokenType::RIGHT_PAREN); break;
         case '{': addToken(TokenType::LEFT_BRACE); break;
         case '}': addToken(TokenType::RIGHT_BRACE); break;
+        case '[': addToken(TokenType::LEFT_BRACKET); break;
+        case ']': addToken(TokenType::RIGHT_BRACKET); break;
         case ',': addToken(TokenType::COMMA); break;
         case '.': addToken(TokenType::DOT); break;
         case '-': addToken(TokenType::MINUS); break;
         case '+': addToken(TokenType::PLUS); break;
+        case ':': addToken(TokenType::COLON); break;
         case ';': addToken(TokenType::SEMICOLON); break;
         case '*': addToken(TokenType::STAR); break;
         
@@ -100,7 +102,7 @@ void Lexer::scanToken() {
             } else if (isAlpha(c)) {
                 identifier();
             } else {
-                ErrorReporter::error(line, "Unexpected character.");
+                reporter.error(line, "Unexpected character.");
             }
             break;
     }
@@ -144,7 +146,7 @@ void Lexer::string() {
     }
     
     if (isAtEnd()) {
-        ErrorReporter::error(line, "Unterminated string.");
+        reporter.error(line, "Unterminated string.");
         return;
     }
     
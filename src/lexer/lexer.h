@@ -4,9 +4,12 @@
 #include <vector>
 #include "../common/token.h"
 
+class ErrorReporter;
+
 class Lexer {
 private:
     std::string source;
+    ErrorReporter& reporter;
     std::vector<Token> tokens;
     int start = 0;
     int current = 0;
@@ -27,7 +30,7 @@ private:
     bool isAlphaNumeric(char c) const;
 
 public:
-    explicit Lexer(const std::string& source);
+    Lexer(const std::string& source, ErrorReporter& reporter);
     std::vector<Token> scanTokens();
     void scanToken();
 };
\ No newline at end of file
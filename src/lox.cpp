@@ -0,0 +1,241 @@
+#include "lox.h"
+#include "interpreter/interpreter.h"
+#include "module/module.h"
+#include "module/module_loader.h"
+#include "snapshot/snapshot.h"
+#include <fstream>
+#include <sstream>
+
+struct Lox::State {
+    std::shared_ptr<GcLog> gcLog;  // outlives the interpreter's last collection
+    std::ostream& err;
+    OutputBuffer output;
+    ErrorReporter reporter;
+    Interpreter interpreter;
+    ModuleLoader& loader;
+    
+    State(std::ostream& out, std::ostream& err, ModuleLoader& loader)
+        : err(err), output(out), reporter(err), interpreter(reporter, output), loader(loader) {}
+};
+
+// Call sites in host code have no source location.
+static const Token hostCall(TokenType::IDENTIFIER, "<host>", "", 0);
+
+Lox::Lox(std::ostream& out, std::ostream& err)
+    : state(std::make_unique<State>(out, err, ModuleLoader::shared())) {}
+
+Lox::Lox(std::ostream& out, std::ostream& err, ModuleLoader& loader)
+    : state(std::make_unique<State>(out, err, loader)) {}
+
+Lox::~Lox() = default;
+
+int Lox::runFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        state->err << "Could not open file: " << path << std::endl;
+        return 74;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string source = buffer.str();
+    
+    run(source, path);
+    
+    if (hadError()) return 65;
+    if (hadRuntimeError()) return 70;
+    return 0;
+}
+
+int Lox::snapshotFile(const std::string& path, const std::string& output) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        state->err << "Could not open file: " << path << std::endl;
+        return 74;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string source = buffer.str();
+    
+    std::shared_ptr<Script> script = compile(source, path);
+    if (!script) return 65;
+    if (script->modules.size() != 1) {
+        state->err << "A snapshot's prelude can't import modules." << std::endl;
+        return 65;
+    }
+    if (!run(*script)) return 70;
+    
+    std::string data;
+    try {
+        data = Snapshot::save(path, source, *script->modules.back(), *state->interpreter.getGlobals());
+    } catch (const LoxError& e) {
+        state->err << "Could not snapshot " << path << ": " << e.what() << std::endl;
+        return 65;
+    }
+    
+    std::ofstream out(output, std::ios::binary);
+    if (!out.is_open() || !out.write(data.data(), data.size())) {
+        state->err << "Could not write file: " << output << std::endl;
+        return 74;
+    }
+    return 0;
+}
+
+int Lox::loadSnapshot(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        state->err << "Could not open file: " << path << std::endl;
+        return 74;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    
+    GarbageCollector::Scope scope(state->interpreter.getCollector());
+    try {
+        Snapshot snapshot = Snapshot::load(buffer.str());
+        std::shared_ptr<Script> script = compile(snapshot.source, snapshot.path);
+        if (!script) return 65;
+        if (script->modules.size() != 1) throw LoxError("Snapshot doesn't match its prelude's source.");
+        snapshot.restore(*script->modules.back(), state->interpreter.getGlobals());
+        state->interpreter.retain(script->modules.back());
+    } catch (const LoxError& e) {
+        state->err << "Could not load snapshot " << path << ": " << e.what() << std::endl;
+        return 65;
+    }
+    return 0;
+}
+
+void Lox::runPrompt(std::istream& in) {
+    std::string line;
+    
+    std::cout << "Lox Interpreter v1.0" << std::endl;
+    std::cout << "Type 'exit' to quit." << std::endl;
+    
+    while (true) {
+        std::cout << "> ";
+        if (!std::getline(in, line)) break;
+        
+        if (line == "exit") break;
+        if (line.empty()) continue;
+        
+        run(line, "");
+        state->reporter.hadError = false;
+    }
+}
+
+void Lox::run(const std::string& source, const std::string& path) {
+    try {
+        std::shared_ptr<Script> script = compile(source, path);
+        if (script) run(*script);
+    } catch (const std::exception& e) {
+        state->output.flush();
+        state->err << "Error: " << e.what() << std::endl;
+        state->reporter.hadRuntimeError = true;
+    }
+}
+
+std::shared_ptr<Script> Lox::compile(const std::string& source, const std::string& path) {
+    ErrorReporter& reporter = state->reporter;
+    bool hadError = reporter.hadError;
+    reporter.hadError = false;
+    
+    auto script = std::make_shared<Script>();
+    script->modules = state->loader.load(source, path, reporter);
+    
+    bool failed = reporter.hadError;
+    reporter.hadError = hadError || failed;
+    return failed ? nullptr : script;
+}
+
+bool Lox::run(const Script& script) {
+    ErrorReporter& reporter = state->reporter;
+    bool hadRuntimeError = reporter.hadRuntimeError;
+    reporter.hadRuntimeError = false;
+    
+    for (auto& module : script.modules) {
+        state->interpreter.interpretModule(module, module == script.modules.back());
+        if (reporter.hadRuntimeError) break;
+    }
+    
+    state->output.flush();
+    
+    bool failed = reporter.hadRuntimeError;
+    reporter.hadRuntimeError = hadRuntimeError || failed;
+    return !failed;
+}
+
+Value Lox::getGlobal(const std::string& name) const {
+    std::shared_ptr<Environment> globals = state->interpreter.getGlobals();
+    if (!globals->isDefined(name)) return Value();
+    return globals->getAt(0, name);
+}
+
+void Lox::defineGlobal(const std::string& name, const Value& value) {
+    state->interpreter.getGlobals()->define(name, value);
+}
+
+void Lox::defineNative(const std::string& name, int arity, NativeFn function) {
+    state->interpreter.defineNative(name, arity, std::move(function));
+}
+
+void Lox::reset() {
+    state->interpreter.reset();
+    state->reporter.reset();
+}
+
+Value Lox::call(const Value& callee, int argCount, Value* args) {
+    try {
+        Value result = state->interpreter.call(callee, argCount, args, hostCall);
+        state->output.flush();
+        return result;
+    } catch (...) {
+        state->output.flush();
+        throw;
+    }
+}
+
+void Lox::setOutputBuffer(size_t bufferSize) {
+    state->output.setCapacity(bufferSize);
+}
+
+void Lox::setLineBuffered(bool lineBuffered) {
+    state->output.setLineBuffered(lineBuffered);
+}
+
+void Lox::setTiered(bool tiered) {
+    state->interpreter.setTierUpThreshold(tiered ? Interpreter::TIER_UP_THRESHOLD : 0);
+}
+
+void Lox::setTierUpThreshold(unsigned calls) {
+    state->interpreter.setTierUpThreshold(calls == 0 ? 1 : calls);
+}
+
+void Lox::setClosureCompilation(bool enabled) {
+    state->interpreter.setClosureCompilation(enabled);
+}
+
+void Lox::setGcPauseTarget(double milliseconds) {
+    auto target = std::chrono::duration<double, std::milli>(milliseconds);
+    state->interpreter.getCollector().setPauseTarget(std::chrono::duration_cast<std::chrono::microseconds>(target));
+}
+
+void Lox::setMaxHeap(size_t bytes) {
+    state->interpreter.getCollector().setMaxHeap(bytes);
+}
+
+void Lox::setGcLog(std::shared_ptr<GcLog> log) {
+    state->gcLog = std::move(log);
+    state->interpreter.getCollector().setLog(state->gcLog.get());
+}
+
+bool Lox::hadError() const {
+    return state->reporter.hadError;
+}
+
+bool Lox::hadRuntimeError() const {
+    return state->reporter.hadRuntimeError;
+}
+
+void Lox::resetErrors() {
+    state->reporter.reset();
+}
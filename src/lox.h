@@ -0,0 +1,126 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include "common/error.h"
+#include "common/value.h"
+#include "interpreter/callable.h"
+
+class ModuleLoader;
+struct Module;
+
+// A compiled script: the parsed modules of a script and everything it
+// imports. Scripts are immutable and may be run by any number of isolates.
+class Script {
+private:
+    friend class Lox;
+    std::vector<std::shared_ptr<Module>> modules;
+};
+
+// An isolated Lox runtime: its own globals, error state and output streams.
+// Isolates share nothing mutable, so each may run on its own thread. Parsed
+// modules come from a ModuleLoader, which may be shared between isolates.
+//
+// This is also the embedding API. A host compiles a script once, runs it to
+// define its globals, and then calls the functions it defined as often as it
+// likes:
+//
+//     Lox lox;
+//     lox.defineNative("log", 1, [](int, Value* args) { ...; return Value(); });
+//     std::shared_ptr<Script> script = lox.compile(source);
+//     if (!script || !lox.run(*script)) return;
+//     Value rule = lox.getGlobal("rule");
+//     Value verdict = lox.call(rule, Value(42.0), Value("request"));
+class Lox {
+private:
+    struct State;
+    std::unique_ptr<State> state;
+
+public:
+    explicit Lox(std::ostream& out = std::cout, std::ostream& err = std::cerr);
+    Lox(std::ostream& out, std::ostream& err, ModuleLoader& loader);
+    ~Lox();
+    
+    Lox(const Lox&) = delete;
+    Lox& operator=(const Lox&) = delete;
+    
+    // Runs a script, returning the process exit code it calls for:
+    // 0 on success, 65 for compile errors, 70 for runtime errors and
+    // 74 if the file can't be read.
+    int runFile(const std::string& path);
+    void runPrompt(std::istream& in);
+    void run(const std::string& source, const std::string& path);
+    
+    // Startup snapshots. snapshotFile runs a prelude script and saves the
+    // globals it defined to `output`; loadSnapshot defines them again in
+    // this isolate without running the prelude. Both return exit codes as
+    // runFile does; a file that isn't a usable snapshot is a data error (65).
+    int snapshotFile(const std::string& path, const std::string& output);
+    int loadSnapshot(const std::string& path);
+    
+    // Lexes and parses source and its imports. `path` is used to resolve
+    // relative imports. Returns null after reporting compile errors.
+    std::shared_ptr<Script> compile(const std::string& source, const std::string& path = "");
+    // Executes a compiled script's top level. Returns false after reporting
+    // a runtime error.
+    bool run(const Script& script);
+    
+    // Globals are nil until defined.
+    Value getGlobal(const std::string& name) const;
+    void defineGlobal(const std::string& name, const Value& value);
+    // Registers a host function visible to every module. Use an arity of
+    // -1 to accept any number of arguments. Throw LoxError to raise a
+    // runtime error. Natives survive reset().
+    void defineNative(const std::string& name, int arity, NativeFn function);
+    // Forgets all globals, modules and scripts so the isolate can be reused
+    // for unrelated code without leaking state between runs.
+    void reset();
+    
+    // Output from print is buffered and flushed whenever control returns to
+    // the host. By default the buffer is 64 KiB, line buffered only when
+    // writing to std::cout on a terminal.
+    void setOutputBuffer(size_t bufferSize);
+    void setLineBuffered(bool lineBuffered);
+    
+    // In tiered mode functions start out tree-walked and are compiled to
+    // bytecode once they have been called or looped in often enough, so
+    // short scripts pay no compile cost and long-running ones run faster.
+    void setTiered(bool tiered);
+    // Turns tiered mode on with functions compiled after `calls` calls or
+    // iterations instead of the default 1000, so tests can reach the
+    // bytecode tier with short scripts.
+    void setTierUpThreshold(unsigned calls);
+    // In closure mode each function is compiled on its first call to a tree
+    // of closures with its slots and operators resolved, which run without
+    // walking the AST. It combines with tiered mode: hot functions still
+    // move on to bytecode.
+    void setClosureCompilation(bool enabled);
+    
+    // Reference cycles are freed by a collector that by default runs to
+    // completion whenever it runs. A pause target in milliseconds makes it
+    // incremental: it works in slices of about that long between stretches
+    // of the program, so no single pause grows with the heap. 0 turns
+    // incremental collection off again.
+    void setGcPauseTarget(double milliseconds);
+    // Logs every collection of this isolate to `log`, which may be shared
+    // with other isolates.
+    void setGcLog(std::shared_ptr<GcLog> log);
+    // Caps the memory this isolate's objects may take up, in bytes; 0 lifts
+    // the cap. Collections start early as the heap nears it, and a script
+    // that still goes over it stops with an out-of-memory runtime error.
+    void setMaxHeap(size_t bytes);
+    
+    // Calls a Lox function, class or native with the given arguments.
+    // Runtime errors are thrown as RuntimeError, not reported.
+    Value call(const Value& callee, int argCount, Value* args);
+    template <typename... Args>
+    Value call(const Value& callee, Args&&... args) {
+        Value argv[sizeof...(Args) + 1] = {Value(std::forward<Args>(args))...};
+        return call(callee, static_cast<int>(sizeof...(Args)), argv);
+    }
+    
+    bool hadError() const;
+    bool hadRuntimeError() const;
+    void resetErrors();
+};
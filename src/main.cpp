@@ -1,82 +1,209 @@
+#include <cmath>
 #include <iostream>
-#include <fstream>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
-#include "lexer/lexer.h"
-#include "parser/parser.h"
-#include "interpreter/interpreter.h"
-#include "common/error.h"
+#include "common/output.h"
+#include "gc/allocator.h"
+#include "gc/gc_log.h"
+#include "lox.h"
+#include "serve/server.h"
 
-class Lox {
-private:
-    static Interpreter interpreter;
+// How every isolate the command line starts is set up.
+struct Options {
+    size_t outputBuffer = OutputBuffer::DEFAULT_CAPACITY;
+    bool tiered = false;
+    unsigned tierUp = 0;   // calls; 0 for the default
+    bool closures = false;
+    double gcPause = 0;    // milliseconds; 0 collects in one go
+    size_t maxHeap = 0;    // bytes; 0 for no cap
+    std::string snapshot;  // restored before the script runs
+    std::shared_ptr<GcLog> gcLog;
+};
 
-public:
-    static void runFile(const std::string& path) {
-        std::ifstream file(path);
-        if (!file.is_open()) {
-            std::cerr << "Could not open file: " << path << std::endl;
-            exit(74);
+// Parses the value of a command-line option, which must be a non-negative
+// number that fits in `value` with nothing after it. Returns false after
+// saying what is wrong with it otherwise.
+template <typename Number>
+static bool parseNumber(const std::string& option, const std::string& text, Number& value) {
+    try {
+        size_t end = 0;
+        if constexpr (std::is_floating_point<Number>::value) {
+            double number = std::stod(text, &end);
+            if (end == text.size() && std::isfinite(number) && number >= 0) {
+                value = static_cast<Number>(number);
+                return true;
+            }
+        } else if (!text.empty() && text[0] != '-') {
+            unsigned long long number = std::stoull(text, &end);
+            if (end == text.size() && number <= static_cast<unsigned long long>(std::numeric_limits<Number>::max())) {
+                value = static_cast<Number>(number);
+                return true;
+            }
         }
+    } catch (const std::invalid_argument&) {
+    } catch (const std::out_of_range&) {
+    }
+    std::cerr << "Invalid value for " << option << ": " << text << std::endl;
+    return false;
+}
 
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        std::string source = buffer.str();
-        
-        run(source);
-        
-        if (ErrorReporter::hadError) exit(65);
-        if (ErrorReporter::hadRuntimeError) exit(70);
+// Returns an exit code if the isolate can't be set up, or 0.
+static int configure(Lox& lox, const Options& options) {
+    lox.setOutputBuffer(options.outputBuffer);
+    lox.setTiered(options.tiered);
+    if (options.tierUp > 0) lox.setTierUpThreshold(options.tierUp);
+    lox.setClosureCompilation(options.closures);
+    lox.setGcPauseTarget(options.gcPause);
+    lox.setMaxHeap(options.maxHeap);
+    if (options.gcLog != nullptr) lox.setGcLog(options.gcLog);
+    return options.snapshot.empty() ? 0 : lox.loadSnapshot(options.snapshot);
+}
+
+// Runs each script in its own isolate on its own thread. Output is
+// collected per script and printed in argument order once all finish.
+static int runParallel(const std::vector<std::string>& paths, const Options& options) {
+    std::vector<std::ostringstream> outputs(paths.size());
+    std::vector<std::ostringstream> errors(paths.size());
+    std::vector<int> statuses(paths.size());
+    std::vector<std::thread> threads;
+    
+    for (size_t i = 0; i < paths.size(); i++) {
+        threads.emplace_back([&, i] {
+            Lox lox(outputs[i], errors[i]);
+            statuses[i] = configure(lox, options);
+            if (statuses[i] == 0) statuses[i] = lox.runFile(paths[i]);
+        });
     }
+    
+    int status = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        threads[i].join();
+        std::cout << outputs[i].str() << std::flush;
+        std::cerr << errors[i].str() << std::flush;
+        if (statuses[i] > status) status = statuses[i];
+    }
+    return status;
+}
 
-    static void runPrompt() {
-        std::string line;
-        
-        std::cout << "Lox Interpreter v1.0" << std::endl;
-        std::cout << "Type 'exit' to quit." << std::endl;
-        
-        while (true) {
-            std::cout << "> ";
-            if (!std::getline(std::cin, line)) break;
-            
-            if (line == "exit") break;
-            if (line.empty()) continue;
-            
-            run(line);
-            ErrorReporter::hadError = false;
-        }
+// Runs the scripts, or the REPL if there are none.
+static int run(const std::vector<std::string>& paths, const Options& options) {
+    if (paths.size() > 1) {
+        return runParallel(paths, options);
     }
+    
+    Lox lox;
+    int status = configure(lox, options);
+    if (status != 0) return status;
+    if (paths.size() == 1) {
+        return lox.runFile(paths[0]);
+    }
+    lox.runPrompt(std::cin);
+    return 0;
+}
 
-    static void run(const std::string& source) {
-        try {
-            Lexer lexer(source);
-            std::vector<Token> tokens = lexer.scanTokens();
-            
-            Parser parser(tokens);
-            std::vector<std::unique_ptr<Stmt>> statements = parser.parse();
-            
-            if (ErrorReporter::hadError) return;
-            
-            interpreter.interpret(statements);
-        } catch (const std::exception& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
+// lox serve [--host ADDRESS] [--port PORT] [--workers N]
+static int serve(int argc, char* argv[]) {
+    std::string host = "127.0.0.1";
+    int port = 8081;
+    size_t workers = 0;
+    
+    for (int i = 2; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << std::endl;
+            return 64;
+        }
+        std::string value = argv[++i];
+        if (option == "--host") {
+            host = value;
+        } else if (option == "--port") {
+            if (!parseNumber(option, value, port)) return 64;
+        } else if (option == "--workers") {
+            if (!parseNumber(option, value, workers)) return 64;
+        } else {
+            std::cerr << "Usage: lox serve [--host ADDRESS] [--port PORT] [--workers N]" << std::endl;
+            return 64;
         }
     }
-};
-
-Interpreter Lox::interpreter;
+    
+    Server server(host, port, workers);
+    return server.run();
+}
 
 int main(int argc, char* argv[]) {
-    if (argc > 2) {
-        std::cout << "Usage: lox [script]" << std::endl;
-        exit(64);
-    } else if (argc == 2) {
-        Lox::runFile(argv[1]);
-    } else {
-        Lox::runPrompt();
+    if (argc >= 2 && std::string(argv[1]) == "serve") {
+        return serve(argc, argv);
     }
     
-    return 0;
-}
\ No newline at end of file
+    // lox [--output-buffer BYTES] [--tiered] [--tier-up CALLS] [--closures] [--gc-pause MS]
+    //     [--gc-log FILE] [--max-heap BYTES] [--huge-pages] [--from-snapshot FILE] [script...]
+    // lox --snapshot PRELUDE -o FILE
+    Options options;
+    std::string gcLog;
+    std::string prelude;
+    std::string output;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--output-buffer" && i + 1 < argc) {
+            if (!parseNumber(arg, argv[++i], options.outputBuffer)) return 64;
+        } else if (arg == "--tiered") {
+            options.tiered = true;
+        } else if (arg == "--tier-up" && i + 1 < argc) {
+            if (!parseNumber(arg, argv[++i], options.tierUp)) return 64;
+        } else if (arg == "--closures") {
+            options.closures = true;
+        } else if (arg == "--gc-pause" && i + 1 < argc) {
+            if (!parseNumber(arg, argv[++i], options.gcPause)) return 64;
+        } else if (arg == "--gc-log" && i + 1 < argc) {
+            gcLog = argv[++i];
+        } else if (arg.compare(0, 9, "--gc-log=") == 0) {
+            gcLog = arg.substr(9);
+        } else if (arg == "--max-heap" && i + 1 < argc) {
+            if (!parseNumber(arg, argv[++i], options.maxHeap)) return 64;
+        } else if (arg == "--huge-pages") {
+            SlabAllocator::setHugePages(true);
+        } else if (arg == "--from-snapshot" && i + 1 < argc) {
+            options.snapshot = argv[++i];
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            prelude = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Usage: lox [--output-buffer BYTES] [--tiered] [--tier-up CALLS] [--closures]\n"
+                      << "           [--gc-pause MS] [--gc-log FILE] [--max-heap BYTES] [--huge-pages]\n"
+                      << "           [--from-snapshot FILE] [script...]\n"
+                      << "       lox --snapshot PRELUDE -o FILE" << std::endl;
+            return 64;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    
+    if (!prelude.empty() || !output.empty()) {
+        if (prelude.empty() || output.empty() || !paths.empty()) {
+            std::cerr << "Usage: lox --snapshot PRELUDE -o FILE" << std::endl;
+            return 64;
+        }
+        Lox lox;
+        return lox.snapshotFile(prelude, output);
+    }
+    
+    if (!gcLog.empty()) {
+        options.gcLog = std::make_shared<GcLog>(gcLog);
+        if (!options.gcLog->isOpen()) {
+            std::cerr << "Could not open file: " << gcLog << std::endl;
+            return 74;
+        }
+    }
+    
+    int status = run(paths, options);
+    if (options.gcLog != nullptr) std::cerr << options.gcLog->summarize() << std::endl;
+    return status;
+}
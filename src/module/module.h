@@ -0,0 +1,18 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../parser/ast.h"
+
+// A parsed source file. Once loaded, a module is never mutated, so the
+// interpreter can keep running it while the loader reuses it for later loads.
+struct Module {
+    std::string path;       // canonical path, or "<script>" for source text
+    std::filesystem::file_time_type modified;
+    std::vector<std::unique_ptr<Stmt>> statements;
+    std::vector<ImportStmt*> imports;
+    int frameSize = 0;      // frame slots used by top-level blocks
+    bool hadError = false;
+};
@@ -0,0 +1,153 @@
+#include "module_loader.h"
+#include "../common/error.h"
+#include "../common/thread_pool.h"
+#include "../interpreter/resolver.h"
+#include "../lexer/lexer.h"
+#include "../parser/parser.h"
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+ModuleLoader::ModuleLoader(size_t threads)
+    : threads(threads == 0 ? ThreadPool::defaultThreadCount() : threads) {}
+
+ModuleLoader& ModuleLoader::shared() {
+    static ModuleLoader loader;
+    return loader;
+}
+
+std::vector<std::shared_ptr<Module>> ModuleLoader::load(const std::string& source, const std::string& path,
+                                                        ErrorReporter& reporter) {
+    std::error_code ec;
+    fs::path script = path.empty() ? fs::path("<script>") : fs::weakly_canonical(path, ec);
+    fs::path directory = path.empty() ? fs::current_path(ec) : script.parent_path();
+    
+    std::shared_ptr<Module> root = parse(source, script.string(), directory.string(), reporter);
+    
+    ModuleGraph graph;
+    if (!root->imports.empty()) {
+        std::mutex graphMutex;
+        ThreadPool pool(threads);
+        discover(pool, root, graph, graphMutex, reporter);
+        pool.wait();
+    }
+    
+    bool ok = !root->hadError;
+    for (auto& entry : graph) {
+        if (entry.second == nullptr || entry.second->hadError) ok = false;
+    }
+    
+    std::vector<std::shared_ptr<Module>> ordered;
+    std::unordered_map<std::string, int> state;
+    if (!ok || !order(root, graph, state, ordered, reporter)) return {};
+    return ordered;
+}
+
+std::shared_ptr<Module> ModuleLoader::parse(const std::string& source, const std::string& path,
+                                            const std::string& directory, ErrorReporter& reporter) {
+    auto module = std::make_shared<Module>();
+    module->path = path;
+    
+    // Collect this module's errors on their own so they are printed
+    // together even when other modules are being parsed at the same time.
+    std::ostringstream messages;
+    ErrorReporter errors(messages);
+    
+    Lexer lexer(source, errors);
+    Parser parser(lexer.scanTokens(), errors);
+    module->statements = parser.parse();
+    if (!errors.hadError) {
+        Resolver resolver(errors);
+        module->frameSize = resolver.resolveModule(module->statements);
+    }
+    
+    for (auto& statement : module->statements) {
+        ImportStmt* import = dynamic_cast<ImportStmt*>(statement.get());
+        if (import == nullptr) continue;
+        
+        std::error_code ec;
+        fs::path target = fs::path(import->path.literal);
+        if (target.is_relative()) target = fs::path(directory) / target;
+        target = fs::weakly_canonical(target, ec);
+        
+        if (ec || !fs::is_regular_file(target, ec)) {
+            errors.error(import->path, "Could not open module '" + import->path.literal + "'.");
+            continue;
+        }
+        
+        import->resolvedPath = target.string();
+        module->imports.push_back(import);
+    }
+    
+    module->hadError = errors.hadError;
+    if (module->hadError) reporter.forward(messages.str());
+    return module;
+}
+
+std::shared_ptr<Module> ModuleLoader::loadFile(const std::string& path, ErrorReporter& reporter) {
+    std::error_code ec;
+    fs::file_time_type modified = fs::last_write_time(path, ec);
+    
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto cached = cache.find(path);
+        if (cached != cache.end() && !ec && cached->second->modified == modified) {
+            return cached->second;
+        }
+    }
+    
+    std::ifstream file(path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    
+    std::shared_ptr<Module> module = parse(buffer.str(), path, fs::path(path).parent_path().string(), reporter);
+    module->modified = modified;
+    
+    if (!module->hadError) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cache[path] = module;
+    }
+    return module;
+}
+
+void ModuleLoader::discover(ThreadPool& pool, const std::shared_ptr<Module>& module,
+                            ModuleGraph& graph, std::mutex& graphMutex, ErrorReporter& reporter) {
+    for (ImportStmt* import : module->imports) {
+        const std::string path = import->resolvedPath;
+        {
+            std::lock_guard<std::mutex> lock(graphMutex);
+            if (!graph.emplace(path, nullptr).second) continue;
+        }
+        
+        pool.submit([this, &pool, &graph, &graphMutex, &reporter, path] {
+            std::shared_ptr<Module> dependency = loadFile(path, reporter);
+            {
+                std::lock_guard<std::mutex> lock(graphMutex);
+                graph[path] = dependency;
+            }
+            discover(pool, dependency, graph, graphMutex, reporter);
+        });
+    }
+}
+
+bool ModuleLoader::order(const std::shared_ptr<Module>& module, ModuleGraph& graph,
+                         std::unordered_map<std::string, int>& state,
+                         std::vector<std::shared_ptr<Module>>& ordered, ErrorReporter& reporter) {
+    enum { VISITING = 1, DONE = 2 };
+    state[module->path] = VISITING;
+    
+    for (ImportStmt* import : module->imports) {
+        int& dependencyState = state[import->resolvedPath];
+        if (dependencyState == DONE) continue;
+        if (dependencyState == VISITING) {
+            reporter.error(import->path, "Import cycle through '" + import->path.literal + "'.");
+            return false;
+        }
+        if (!order(graph[import->resolvedPath], graph, state, ordered, reporter)) return false;
+    }
+    
+    state[module->path] = DONE;
+    ordered.push_back(module);
+    return true;
+}
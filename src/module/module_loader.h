@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "module.h"
+
+class ErrorReporter;
+class ThreadPool;
+
+// Discovers the import graph of a script and lexes/parses every module in
+// it on a thread pool. Parsed modules are cached by path and reused for as
+// long as the file on disk is unchanged. Modules are read-only once parsed,
+// so one loader can be shared by interpreters running on different threads.
+class ModuleLoader {
+private:
+    using ModuleGraph = std::unordered_map<std::string, std::shared_ptr<Module>>;
+
+    size_t threads;
+    std::mutex cacheMutex;
+    ModuleGraph cache;
+
+    std::shared_ptr<Module> parse(const std::string& source, const std::string& path,
+                                  const std::string& directory, ErrorReporter& reporter);
+    std::shared_ptr<Module> loadFile(const std::string& path, ErrorReporter& reporter);
+    void discover(ThreadPool& pool, const std::shared_ptr<Module>& module,
+                  ModuleGraph& graph, std::mutex& graphMutex, ErrorReporter& reporter);
+    bool order(const std::shared_ptr<Module>& module, ModuleGraph& graph,
+               std::unordered_map<std::string, int>& state,
+               std::vector<std::shared_ptr<Module>>& ordered, ErrorReporter& reporter);
+
+public:
+    explicit ModuleLoader(size_t threads = 0);
+    
+    // Parses a script and everything it imports. `path` names the script so
+    // relative imports can be resolved; pass "" for source typed at the REPL.
+    // Returns the modules in execution order: each module comes after the
+    // modules it imports and the script itself comes last. Returns an empty
+    // list if any module failed to load.
+    std::vector<std::shared_ptr<Module>> load(const std::string& source, const std::string& path,
+                                              ErrorReporter& reporter);
+    
+    // Process-wide loader, so isolates running the same files share ASTs.
+    static ModuleLoader& shared();
+};
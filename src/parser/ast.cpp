@@ -1,4 +1,6 @@
 #include "ast.h"
+#include "../interpreter/closure_compiler.h"
+#include "../vm/ast_compiler.h"
 
 // Expression accept methods
 Value BinaryExpr::accept(ExprVisitor& visitor) {
@@ -49,6 +51,22 @@ Value SuperExpr::accept(ExprVisitor& visitor) {
     return visitor.visitSuperExpr(*this);
 }
 
+Value ListExpr::accept(ExprVisitor& visitor) {
+    return visitor.visitListExpr(*this);
+}
+
+Value MapExpr::accept(ExprVisitor& visitor) {
+    return visitor.visitMapExpr(*this);
+}
+
+Value SubscriptExpr::accept(ExprVisitor& visitor) {
+    return visitor.visitSubscriptExpr(*this);
+}
+
+Value SubscriptSetExpr::accept(ExprVisitor& visitor) {
+    return visitor.visitSubscriptSetExpr(*this);
+}
+
 // Statement accept methods
 void ExpressionStmt::accept(StmtVisitor& visitor) {
     visitor.visitExpressionStmt(*this);
@@ -78,10 +96,19 @@ void FunctionStmt::accept(StmtVisitor& visitor) {
     visitor.visitFunctionStmt(*this);
 }
 
+FunctionStmt::~FunctionStmt() {
+    delete compiled.load();
+    delete closures.load();
+}
+
 void ReturnStmt::accept(StmtVisitor& visitor) {
     visitor.visitReturnStmt(*this);
 }
 
 void ClassStmt::accept(StmtVisitor& visitor) {
     visitor.visitClassStmt(*this);
+}
+
+void ImportStmt::accept(StmtVisitor& visitor) {
+    visitor.visitImportStmt(*this);
 }
\ No newline at end of file
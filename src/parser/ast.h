@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "../common/token.h"
@@ -8,6 +9,31 @@
 // Forward declarations
 class ExprVisitor;
 class StmtVisitor;
+class FunctionStmt;
+class GetExpr;
+struct CompiledFunction;
+struct ClosureCode;
+
+// Where the resolver found a variable. Globals are looked up by name at run
+// time. Locals live in a slot of the current call frame; variables of
+// enclosing functions are reached through one of the running closure's
+// upvalues, and `slot` is its index.
+struct Resolution {
+    enum class Kind : unsigned char { GLOBAL, LOCAL, UPVALUE };
+    
+    Kind kind = Kind::GLOBAL;
+    int slot = 0;
+};
+
+// Where a closure gets one of its upvalues when it is created: a local in
+// the enclosing function's frame, or one of the enclosing function's own
+// upvalues.
+struct Capture {
+    enum class Kind : unsigned char { LOCAL, UPVALUE };
+    
+    Kind kind;
+    int index;
+};
 
 // Base expression class
 class Expr {
@@ -29,6 +55,19 @@ public:
     std::unique_ptr<Expr> left;
     Token operator_;
     std::unique_ptr<Expr> right;
+    // Operands that can be read in place instead of evaluated: locals the
+    // resolver put in the frame (slot, else -1) and literals (their value).
+    int leftSlot = -1;
+    int rightSlot = -1;
+    const Value* leftConstant = nullptr;
+    const Value* rightConstant = nullptr;
+    // Quickening: the first evaluation marks the expression NUMBERS if both
+    // operands were numbers, so later ones take a number-only path, or else
+    // GENERIC. An operand of any other type under NUMBERS makes it GENERIC
+    // for good, so a site that sees both is written at most twice. Isolates
+    // share the AST, so this is only ever a hint.
+    enum class Quickening : unsigned char { UNSEEN, NUMBERS, GENERIC };
+    std::atomic<Quickening> quickening{Quickening::UNSEEN};
     
     BinaryExpr(std::unique_ptr<Expr> left, Token operator_, std::unique_ptr<Expr> right)
         : left(std::move(left)), operator_(operator_), right(std::move(right)) {}
@@ -69,6 +108,7 @@ public:
 class VariableExpr : public Expr {
 public:
     Token name;
+    Resolution resolution;
     
     explicit VariableExpr(Token name) : name(name) {}
     
@@ -79,6 +119,7 @@ class AssignExpr : public Expr {
 public:
     Token name;
     std::unique_ptr<Expr> value;
+    Resolution resolution;
     
     AssignExpr(Token name, std::unique_ptr<Expr> value)
         : name(name), value(std::move(value)) {}
@@ -103,6 +144,7 @@ public:
     std::unique_ptr<Expr> callee;
     Token paren;
     std::vector<std::unique_ptr<Expr>> arguments;
+    GetExpr* method = nullptr;  // the callee, if it is a property: it may be a method to invoke unbound
     
     CallExpr(std::unique_ptr<Expr> callee, Token paren, std::vector<std::unique_ptr<Expr>> arguments)
         : callee(std::move(callee)), paren(paren), arguments(std::move(arguments)) {}
@@ -136,6 +178,7 @@ public:
 class ThisExpr : public Expr {
 public:
     Token keyword;
+    Resolution resolution;
     
     explicit ThisExpr(Token keyword) : keyword(keyword) {}
     
@@ -146,12 +189,63 @@ class SuperExpr : public Expr {
 public:
     Token keyword;
     Token method;
+    Resolution resolution;      // of 'super'
+    Resolution thisResolution;  // of the receiver 'super' methods bind to
     
     SuperExpr(Token keyword, Token method) : keyword(keyword), method(method) {}
     
     Value accept(ExprVisitor& visitor) override;
 };
 
+class ListExpr : public Expr {
+public:
+    Token bracket;
+    std::vector<std::unique_ptr<Expr>> elements;
+    
+    ListExpr(Token bracket, std::vector<std::unique_ptr<Expr>> elements)
+        : bracket(bracket), elements(std::move(elements)) {}
+    
+    Value accept(ExprVisitor& visitor) override;
+};
+
+class MapExpr : public Expr {
+public:
+    Token brace;
+    std::vector<std::unique_ptr<Expr>> keys;
+    std::vector<std::unique_ptr<Expr>> values;
+    
+    MapExpr(Token brace, std::vector<std::unique_ptr<Expr>> keys, std::vector<std::unique_ptr<Expr>> values)
+        : brace(brace), keys(std::move(keys)), values(std::move(values)) {}
+    
+    Value accept(ExprVisitor& visitor) override;
+};
+
+class SubscriptExpr : public Expr {
+public:
+    std::unique_ptr<Expr> object;
+    Token bracket;
+    std::unique_ptr<Expr> index;
+    
+    SubscriptExpr(std::unique_ptr<Expr> object, Token bracket, std::unique_ptr<Expr> index)
+        : object(std::move(object)), bracket(bracket), index(std::move(index)) {}
+    
+    Value accept(ExprVisitor& visitor) override;
+};
+
+class SubscriptSetExpr : public Expr {
+public:
+    std::unique_ptr<Expr> object;
+    Token bracket;
+    std::unique_ptr<Expr> index;
+    std::unique_ptr<Expr> value;
+    
+    SubscriptSetExpr(std::unique_ptr<Expr> object, Token bracket, std::unique_ptr<Expr> index,
+                     std::unique_ptr<Expr> value)
+        : object(std::move(object)), bracket(bracket), index(std::move(index)), value(std::move(value)) {}
+    
+    Value accept(ExprVisitor& visitor) override;
+};
+
 // Statement types
 class ExpressionStmt : public Stmt {
 public:
@@ -177,6 +271,7 @@ class VarStmt : public Stmt {
 public:
     Token name;
     std::unique_ptr<Expr> initializer;
+    Resolution resolution;
     
     VarStmt(Token name, std::unique_ptr<Expr> initializer)
         : name(name), initializer(std::move(initializer)) {}
@@ -187,6 +282,7 @@ public:
 class BlockStmt : public Stmt {
 public:
     std::vector<std::unique_ptr<Stmt>> statements;
+    int capturedFrom = -1;  // lowest frame slot a closure captures, or -1
     
     explicit BlockStmt(std::vector<std::unique_ptr<Stmt>> statements)
         : statements(std::move(statements)) {}
@@ -210,6 +306,7 @@ class WhileStmt : public Stmt {
 public:
     std::unique_ptr<Expr> condition;
     std::unique_ptr<Stmt> body;
+    FunctionStmt* function = nullptr;  // whose hotness iterations count towards
     
     WhileStmt(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> body)
         : condition(std::move(condition)), body(std::move(body)) {}
@@ -222,9 +319,22 @@ public:
     Token name;
     std::vector<Token> params;
     std::vector<std::unique_ptr<Stmt>> body;
+    Resolution resolution;
+    int frameSize = 0;              // frame slots, starting with the parameters
+    int firstParam = 0;             // 1 in methods, whose receiver is slot 0
+    std::vector<Capture> captures;  // one per upvalue; methods have 'this' first
+    // Tiering: calls and loop iterations counted while the function is
+    // tree-walked, and the bytecode it is compiled to once that passes the
+    // threshold. Isolates share both; `compiled` is set at most once.
+    std::atomic<unsigned> hotness{0};
+    std::atomic<CompiledFunction*> compiled{nullptr};
+    std::atomic<bool> uncompilable{false};
+    // Its body compiled to closures, in closure mode; set at most once.
+    std::atomic<ClosureCode*> closures{nullptr};
     
     FunctionStmt(Token name, std::vector<Token> params, std::vector<std::unique_ptr<Stmt>> body)
         : name(name), params(std::move(params)), body(std::move(body)) {}
+    ~FunctionStmt() override;
     
     void accept(StmtVisitor& visitor) override;
 };
@@ -233,6 +343,7 @@ class ReturnStmt : public Stmt {
 public:
     Token keyword;
     std::unique_ptr<Expr> value;
+    CallExpr* tailCall = nullptr;  // the value, if it is a call the callee can replace us with
     
     ReturnStmt(Token keyword, std::unique_ptr<Expr> value)
         : keyword(keyword), value(std::move(value)) {}
@@ -245,6 +356,8 @@ public:
     Token name;
     std::unique_ptr<VariableExpr> superclass;
     std::vector<std::unique_ptr<FunctionStmt>> methods;
+    Resolution resolution;
+    int superclassSlot = -1;  // frame slot holding 'super' while methods are created
     
     ClassStmt(Token name, std::unique_ptr<VariableExpr> superclass, std::vector<std::unique_ptr<FunctionStmt>> methods)
         : name(name), superclass(std::move(superclass)), methods(std::move(methods)) {}
@@ -252,6 +365,19 @@ public:
     void accept(StmtVisitor& visitor) override;
 };
 
+class ImportStmt : public Stmt {
+public:
+    Token keyword;
+    Token path;
+    std::string name;          // namespace the module is bound to
+    std::string resolvedPath;  // filled in by ModuleLoader
+    
+    ImportStmt(Token keyword, Token path, std::string name)
+        : keyword(keyword), path(path), name(std::move(name)) {}
+    
+    void accept(StmtVisitor& visitor) override;
+};
+
 // Visitor interfaces
 class ExprVisitor {
 public:
@@ -268,6 +394,10 @@ public:
     virtual Value visitSetExpr(SetExpr& expr) = 0;
     virtual Value visitThisExpr(ThisExpr& expr) = 0;
     virtual Value visitSuperExpr(SuperExpr& expr) = 0;
+    virtual Value visitListExpr(ListExpr& expr) = 0;
+    virtual Value visitMapExpr(MapExpr& expr) = 0;
+    virtual Value visitSubscriptExpr(SubscriptExpr& expr) = 0;
+    virtual Value visitSubscriptSetExpr(SubscriptSetExpr& expr) = 0;
 };
 
 class StmtVisitor {
@@ -282,4 +412,5 @@ public:
     virtual void visitFunctionStmt(FunctionStmt& stmt) = 0;
     virtual void visitReturnStmt(ReturnStmt& stmt) = 0;
     virtual void visitClassStmt(ClassStmt& stmt) = 0;
+    virtual void visitImportStmt(ImportStmt& stmt) = 0;
 };
\ No newline at end of file
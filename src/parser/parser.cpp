@@ -1,19 +1,22 @@
 #include "parser.h"
 #include "../common/error.h"
+#include <cctype>
 #include <stdexcept>
 
-Parser::Parser(std::vector<Token> tokens) : tokens(std::move(tokens)) {}
+Parser::Parser(std::vector<Token> tokens, ErrorReporter& reporter)
+    : tokens(std::move(tokens)), reporter(reporter) {}
 
 std::vector<std::unique_ptr<Stmt>> Parser::parse() {
     std::vector<std::unique_ptr<Stmt>> statements;
     
     while (!isAtEnd()) {
         try {
-            auto stmt = declaration();
+            auto stmt = match({TokenType::IMPORT}) ? importStatement() : declaration();
             if (stmt) {
                 statements.push_back(std::move(stmt));
             }
         } catch (const ParseError& error) {
+            reporter.error(error.token, error.what());
             synchronize();
         }
     }
@@ -71,6 +74,7 @@ void Parser::synchronize() {
             case TokenType::VAR:
             case TokenType::FOR:
             case TokenType::IF:
+            case TokenType::IMPORT:
             case TokenType::WHILE:
             case TokenType::PRINT:
             case TokenType::RETURN:
@@ -88,14 +92,40 @@ std::unique_ptr<Stmt> Parser::declaration() {
         if (match({TokenType::CLASS})) return classDeclaration();
         if (match({TokenType::FUN})) return function("function");
         if (match({TokenType::VAR})) return varDeclaration();
+        if (match({TokenType::IMPORT})) throw ParseError(previous(), "Can only import at top level.");
         
         return statement();
     } catch (const ParseError& error) {
+        reporter.error(error.token, error.what());
         synchronize();
         return nullptr;
     }
 }
 
+std::unique_ptr<Stmt> Parser::importStatement() {
+    Token keyword = previous();
+    Token path = consume(TokenType::STRING, "Expect module path after 'import'.");
+    consume(TokenType::SEMICOLON, "Expect ';' after import.");
+    
+    // The module is bound to its file name without directory or extension,
+    // so "lib/math.lox" is accessed as math.
+    std::string name = path.literal;
+    size_t slash = name.find_last_of('/');
+    if (slash != std::string::npos) name = name.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) name = name.substr(0, dot);
+    
+    bool valid = !name.empty() && !std::isdigit(static_cast<unsigned char>(name[0]));
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') valid = false;
+    }
+    if (!valid || TokenUtils::getKeywordType(name) != TokenType::IDENTIFIER) {
+        reporter.error(path, "Module file name must be a valid identifier.");
+    }
+    
+    return std::make_unique<ImportStmt>(keyword, path, name);
+}
+
 std::unique_ptr<Stmt> Parser::classDeclaration() {
     Token name = consume(TokenType::IDENTIFIER, "Expect class name.");
     
@@ -128,7 +158,7 @@ std::unique_ptr<Stmt> Parser::function(const std::string& kind) {
     if (!check(TokenType::RIGHT_PAREN)) {
         do {
             if (parameters.size() >= 255) {
-                ErrorReporter::error(peek(), "Can't have more than 255 parameters.");
+                reporter.error(peek(), "Can't have more than 255 parameters.");
             }
             
             parameters.push_back(consume(TokenType::IDENTIFIER, "Expect parameter name."));
@@ -290,9 +320,12 @@ std::unique_ptr<Expr> Parser::assignment() {
             Token name = get->name;
             expr.release(); // Release ownership
             return std::make_unique<SetExpr>(std::move(object), name, std::move(value));
+        } else if (auto subscript = dynamic_cast<SubscriptExpr*>(expr.get())) {
+            return std::make_unique<SubscriptSetExpr>(std::move(subscript->object), subscript->bracket,
+                                                      std::move(subscript->index), std::move(value));
         }
         
-        ErrorReporter::error(equals, "Invalid assignment target.");
+        reporter.error(equals, "Invalid assignment target.");
     }
     
     return expr;
@@ -389,6 +422,10 @@ std::unique_ptr<Expr> Parser::call() {
         } else if (match({TokenType::DOT})) {
             Token name = consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
             expr = std::make_unique<GetExpr>(std::move(expr), name);
+        } else if (match({TokenType::LEFT_BRACKET})) {
+            std::unique_ptr<Expr> index = expression();
+            Token bracket = consume(TokenType::RIGHT_BRACKET, "Expect ']' after index.");
+            expr = std::make_unique<SubscriptExpr>(std::move(expr), bracket, std::move(index));
         } else {
             break;
         }
@@ -403,7 +440,7 @@ std::unique_ptr<Expr> Parser::finishCall(std::unique_ptr<Expr> callee) {
     if (!check(TokenType::RIGHT_PAREN)) {
         do {
             if (arguments.size() >= 255) {
-                ErrorReporter::error(peek(), "Can't have more than 255 arguments.");
+                reporter.error(peek(), "Can't have more than 255 arguments.");
             }
             arguments.push_back(expression());
         } while (match({TokenType::COMMA}));
@@ -449,5 +486,34 @@ std::unique_ptr<Expr> Parser::primary() {
         return std::make_unique<GroupingExpr>(std::move(expr));
     }
     
+    if (match({TokenType::LEFT_BRACKET})) {
+        Token bracket = previous();
+        std::vector<std::unique_ptr<Expr>> elements;
+        if (!check(TokenType::RIGHT_BRACKET)) {
+            do {
+                elements.push_back(expression());
+            } while (match({TokenType::COMMA}));
+        }
+        consume(TokenType::RIGHT_BRACKET, "Expect ']' after list elements.");
+        return std::make_unique<ListExpr>(bracket, std::move(elements));
+    }
+    
+    // A statement starting with '{' is a block, so map literals can only
+    // appear where an expression is expected.
+    if (match({TokenType::LEFT_BRACE})) {
+        Token brace = previous();
+        std::vector<std::unique_ptr<Expr>> keys;
+        std::vector<std::unique_ptr<Expr>> values;
+        if (!check(TokenType::RIGHT_BRACE)) {
+            do {
+                keys.push_back(expression());
+                consume(TokenType::COLON, "Expect ':' after map key.");
+                values.push_back(expression());
+            } while (match({TokenType::COMMA}));
+        }
+        consume(TokenType::RIGHT_BRACE, "Expect '}' after map entries.");
+        return std::make_unique<MapExpr>(brace, std::move(keys), std::move(values));
+    }
+    
     throw ParseError(peek(), "Expect expression.");
 }
\ No newline at end of file
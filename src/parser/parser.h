@@ -5,9 +5,12 @@
 #include "../common/token.h"
 #include "ast.h"
 
+class ErrorReporter;
+
 class Parser {
 private:
     std::vector<Token> tokens;
+    ErrorReporter& reporter;
     int current = 0;
 
     // Helper methods
@@ -41,6 +44,7 @@ private:
     std::unique_ptr<Stmt> varDeclaration();
     std::unique_ptr<Stmt> function(const std::string& kind);
     std::unique_ptr<Stmt> classDeclaration();
+    std::unique_ptr<Stmt> importStatement();
     std::unique_ptr<Stmt> ifStatement();
     std::unique_ptr<Stmt> whileStatement();
     std::unique_ptr<Stmt> forStatement();
@@ -48,6 +52,6 @@ private:
     std::vector<std::unique_ptr<Stmt>> block();
 
 public:
-    explicit Parser(std::vector<Token> tokens);
+    Parser(std::vector<Token> tokens, ErrorReporter& reporter);
     std::vector<std::unique_ptr<Stmt>> parse();
 };
\ No newline at end of file
@@ -0,0 +1,384 @@
+#include "server.h"
+#include "../common/thread_pool.h"
+#include "../lox.h"
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Reads one string value starting at body[pos] == '"'. Handles every JSON
+// escape, including surrogate pairs, and produces UTF-8.
+bool readJsonString(const std::string& body, size_t& pos, std::string& out) {
+    if (pos >= body.size() || body[pos] != '"') return false;
+    pos++;
+    
+    auto appendUtf8 = [&out](unsigned long code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    };
+    auto readHex = [&body](size_t at, unsigned long& code) {
+        if (at + 4 > body.size()) return false;
+        code = 0;
+        for (size_t i = at; i < at + 4; i++) {
+            char c = body[i];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    };
+    
+    while (pos < body.size()) {
+        char c = body[pos++];
+        if (c == '"') return true;
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (pos >= body.size()) return false;
+        
+        switch (body[pos++]) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned long code;
+                if (!readHex(pos, code)) return false;
+                pos += 4;
+                unsigned long low;
+                if (code >= 0xD800 && code <= 0xDBFF && body.compare(pos, 2, "\\u") == 0 &&
+                    readHex(pos + 2, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    pos += 6;
+                }
+                appendUtf8(code);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+void skipWhitespace(const std::string& body, size_t& pos) {
+    while (pos < body.size() && std::isspace(static_cast<unsigned char>(body[pos]))) pos++;
+}
+
+// Skips any JSON value without interpreting it.
+bool skipJsonValue(const std::string& body, size_t& pos) {
+    skipWhitespace(body, pos);
+    if (pos >= body.size()) return false;
+    
+    if (body[pos] == '"') {
+        std::string ignored;
+        return readJsonString(body, pos, ignored);
+    }
+    if (body[pos] == '{' || body[pos] == '[') {
+        char close = body[pos] == '{' ? '}' : ']';
+        pos++;
+        skipWhitespace(body, pos);
+        if (pos < body.size() && body[pos] == close) {
+            pos++;
+            return true;
+        }
+        while (true) {
+            if (close == '}') {
+                std::string key;
+                skipWhitespace(body, pos);
+                if (!readJsonString(body, pos, key)) return false;
+                skipWhitespace(body, pos);
+                if (pos >= body.size() || body[pos++] != ':') return false;
+            }
+            if (!skipJsonValue(body, pos)) return false;
+            skipWhitespace(body, pos);
+            if (pos >= body.size()) return false;
+            if (body[pos] == close) {
+                pos++;
+                return true;
+            }
+            if (body[pos++] != ',') return false;
+        }
+    }
+    
+    // Numbers, true, false and null.
+    size_t start = pos;
+    while (pos < body.size() && (std::isalnum(static_cast<unsigned char>(body[pos])) ||
+                                 body[pos] == '-' || body[pos] == '+' || body[pos] == '.')) {
+        pos++;
+    }
+    return pos > start;
+}
+
+// Extracts the "code" member from a JSON object.
+bool parseRunRequest(const std::string& body, std::string& code) {
+    size_t pos = 0;
+    skipWhitespace(body, pos);
+    if (pos >= body.size() || body[pos++] != '{') return false;
+    
+    bool found = false;
+    while (true) {
+        skipWhitespace(body, pos);
+        if (pos < body.size() && body[pos] == '}') return found;
+        
+        std::string key;
+        if (!readJsonString(body, pos, key)) return false;
+        skipWhitespace(body, pos);
+        if (pos >= body.size() || body[pos++] != ':') return false;
+        skipWhitespace(body, pos);
+        
+        if (key == "code") {
+            code.clear();
+            if (!readJsonString(body, pos, code)) return false;
+            found = true;
+        } else if (!skipJsonValue(body, pos)) {
+            return false;
+        }
+        
+        skipWhitespace(body, pos);
+        if (pos < body.size() && body[pos] == ',') pos++;
+    }
+}
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    out += escape;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, 0);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool sendResponse(int fd, int status, const std::string& reason, const std::string& body, bool keepAlive) {
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << " " << reason << "\r\n"
+             << "Content-Type: application/json\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n"
+             << body;
+    return sendAll(fd, response.str());
+}
+
+std::string lowercase(std::string text) {
+    for (char& c : text) c = std::tolower(static_cast<unsigned char>(c));
+    return text;
+}
+
+struct Request {
+    std::string method;
+    std::string path;
+    std::string body;
+    bool keepAlive = true;
+};
+
+// Reads one request from the connection. `buffer` carries bytes that arrived
+// after the previous request on a keep-alive connection.
+bool readRequest(int fd, std::string& buffer, Request& request) {
+    static const size_t MAX_HEADER = 64 * 1024;
+    static const size_t MAX_BODY = 16 * 1024 * 1024;
+    char chunk[16 * 1024];
+    
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (buffer.size() > MAX_HEADER) return false;
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+    
+    std::istringstream header(buffer.substr(0, headerEnd));
+    std::string version;
+    header >> request.method >> request.path >> version;
+    request.keepAlive = version == "HTTP/1.1";
+    
+    size_t contentLength = 0;
+    std::string line;
+    std::getline(header, line);
+    while (std::getline(header, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = lowercase(line.substr(0, colon));
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r") + 1);
+        
+        if (name == "content-length") {
+            contentLength = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (name == "connection") {
+            std::string option = lowercase(value);
+            if (option == "close") request.keepAlive = false;
+            if (option == "keep-alive") request.keepAlive = true;
+        }
+    }
+    if (contentLength > MAX_BODY) return false;
+    
+    size_t bodyStart = headerEnd + 4;
+    while (buffer.size() - bodyStart < contentLength) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+    
+    request.body = buffer.substr(bodyStart, contentLength);
+    buffer.erase(0, bodyStart + contentLength);
+    return true;
+}
+
+} // namespace
+
+Server::Server(const std::string& host, int port, size_t workers)
+    : host(host), port(port), workers(workers == 0 ? ThreadPool::defaultThreadCount() : workers) {}
+
+int Server::run() {
+    std::signal(SIGPIPE, SIG_IGN);
+    
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::perror("socket");
+        return 74;
+    }
+    int reuse = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+        std::cerr << "Invalid address: " << host << std::endl;
+        return 64;
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        ::listen(listener, SOMAXCONN) < 0) {
+        std::perror("bind");
+        ::close(listener);
+        return 74;
+    }
+    
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; i++) {
+        threads.emplace_back([this] { workerLoop(); });
+    }
+    std::cout << "Lox server running at http://" << host << ":" << port
+              << " with " << workers << " workers" << std::endl;
+    
+    while (true) {
+        int connection = ::accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR) continue;
+            std::perror("accept");
+            continue;
+        }
+        // Idle keep-alive clients must not hold a worker forever.
+        timeval timeout{30, 0};
+        ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connections.push_back(connection);
+        }
+        connectionReady.notify_one();
+    }
+}
+
+void Server::workerLoop() {
+    // The isolate is created once and reused for every request this
+    // worker handles; reset() clears state left by the previous request.
+    std::ostringstream output;
+    std::ostringstream errors;
+    Lox lox(output, errors);
+    
+    while (true) {
+        int connection;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            connectionReady.wait(lock, [this] { return !connections.empty(); });
+            connection = connections.front();
+            connections.pop_front();
+        }
+        
+        std::string buffer;
+        Request request;
+        while (readRequest(connection, buffer, request)) {
+            std::string code;
+            bool sent;
+            if (request.method != "POST" || request.path != "/run") {
+                sent = sendResponse(connection, 404, "Not Found",
+                                    "{\"success\": false, \"error\": \"Not found\"}", request.keepAlive);
+            } else if (!parseRunRequest(request.body, code)) {
+                sent = sendResponse(connection, 400, "Bad Request",
+                                    "{\"success\": false, \"error\": \"Expected a JSON object with a 'code' string\"}",
+                                    request.keepAlive);
+            } else {
+                output.str("");
+                errors.str("");
+                lox.reset();
+                lox.run(code, "");
+                
+                std::string body;
+                if (!lox.hadError() && !lox.hadRuntimeError()) {
+                    body = "{\"success\": true, \"output\": " + jsonString(output.str()) + "}";
+                } else {
+                    body = "{\"success\": false, \"error\": " + jsonString(errors.str()) + "}";
+                }
+                sent = sendResponse(connection, 200, "OK", body, request.keepAlive);
+            }
+            if (!sent || !request.keepAlive) break;
+        }
+        ::close(connection);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+// `lox serve`: a long-running HTTP daemon that executes Lox code posted to
+// /run. Each worker thread owns one warm isolate that is reset between
+// requests, so a request costs neither a process spawn nor interpreter
+// start-up. Requests and responses use the JSON shapes of web/server.py:
+//
+//     POST /run  {"code": "print 1;"}
+//     200        {"success": true, "output": "1\n"}
+//     200        {"success": false, "error": "[line 1] Error ..."}
+class Server {
+private:
+    std::string host;
+    int port;
+    size_t workers;
+    
+    std::mutex mutex;
+    std::condition_variable connectionReady;
+    std::deque<int> connections;
+
+    void workerLoop();
+
+public:
+    Server(const std::string& host, int port, size_t workers);
+    
+    // Listens until the process is killed. Returns an exit code if the
+    // socket can't be set up.
+    int run();
+};
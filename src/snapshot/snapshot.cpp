@@ -0,0 +1,573 @@
+#include "snapshot.h"
+#include "../common/collections.h"
+#include "../common/error.h"
+#include "../interpreter/builtins.h"
+#include "../interpreter/interpreter.h"
+#include "../module/module.h"
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+// The file starts with the magic and version, the prelude's path and
+// source follow, and the heap takes up the rest: the globals, then one
+// record per object and upvalue, each numbered in the order written, and
+// an END. Integers and numbers are in the writing machine's byte order.
+static const char MAGIC[] = "LOXSNAP";
+static constexpr uint32_t VERSION = 2;
+static constexpr uint32_t NONE = UINT32_MAX;  // no object or upvalue
+
+namespace {
+
+enum class Tag : unsigned char { NIL, FALSE, TRUE, NUMBER, STRING, OBJECT };
+
+enum class Kind : unsigned char {
+    END,
+    UPVALUE,         // value
+    FUNCTION,        // declaration number, isInitializer, upvalue ids
+    NATIVE,          // name, looked up among the natives on restore
+    CLASS,           // name, superclass id, (name, function id) per method not inherited
+    INSTANCE,        // class id, (name, value) per field
+    LIST,            // elements
+    MAP,             // (key, value) per entry
+    STRING_BUILDER,  // contents
+    BOUND_METHOD,    // receiver id, function id
+};
+
+void putRaw(std::string& out, const void* data, size_t size) {
+    out.append(static_cast<const char*>(data), size);
+}
+
+void putByte(std::string& out, unsigned char byte) {
+    out.push_back(static_cast<char>(byte));
+}
+
+void putU32(std::string& out, uint32_t value) {
+    putRaw(out, &value, sizeof value);
+}
+
+void putString(std::string& out, const std::string& string) {
+    putU32(out, static_cast<uint32_t>(string.size()));
+    out += string;
+}
+
+// Reads what the put functions wrote, throwing if the data runs out.
+class Input {
+private:
+    const std::string& data;
+    size_t position = 0;
+
+    const char* take(size_t size) {
+        if (size > data.size() - position) throw LoxError("Snapshot is truncated.");
+        const char* start = data.data() + position;
+        position += size;
+        return start;
+    }
+
+public:
+    explicit Input(const std::string& data, size_t position = 0) : data(data), position(position) {}
+
+    size_t offset() const { return position; }
+    unsigned char byte() { return static_cast<unsigned char>(*take(1)); }
+    uint32_t u32() {
+        uint32_t value;
+        std::memcpy(&value, take(sizeof value), sizeof value);
+        return value;
+    }
+    double number() {
+        double value;
+        std::memcpy(&value, take(sizeof value), sizeof value);
+        return value;
+    }
+    std::string string() {
+        uint32_t size = u32();
+        return std::string(take(size), size);
+    }
+    // A count of things each at least `size` bytes long, checked against
+    // what is left so that a corrupt count can't exhaust memory.
+    uint32_t count(size_t size) {
+        uint32_t count = u32();
+        if (count > (data.size() - position) / size) throw LoxError("Snapshot is truncated.");
+        return count;
+    }
+};
+
+// Numbers every function declaration of a module in pre-order, the same way
+// on both ends.
+void numberFunctions(const std::vector<std::unique_ptr<Stmt>>& statements,
+                     const std::function<void(FunctionStmt&)>& visit);
+
+void numberFunctions(Stmt& stmt, const std::function<void(FunctionStmt&)>& visit) {
+    if (auto* function = dynamic_cast<FunctionStmt*>(&stmt)) {
+        visit(*function);
+        numberFunctions(function->body, visit);
+    } else if (auto* klass = dynamic_cast<ClassStmt*>(&stmt)) {
+        for (auto& method : klass->methods) numberFunctions(*method, visit);
+    } else if (auto* block = dynamic_cast<BlockStmt*>(&stmt)) {
+        numberFunctions(block->statements, visit);
+    } else if (auto* if_ = dynamic_cast<IfStmt*>(&stmt)) {
+        numberFunctions(*if_->thenBranch, visit);
+        if (if_->elseBranch != nullptr) numberFunctions(*if_->elseBranch, visit);
+    } else if (auto* while_ = dynamic_cast<WhileStmt*>(&stmt)) {
+        numberFunctions(*while_->body, visit);
+    }
+}
+
+void numberFunctions(const std::vector<std::unique_ptr<Stmt>>& statements,
+                     const std::function<void(FunctionStmt&)>& visit) {
+    for (auto& statement : statements) numberFunctions(*statement, visit);
+}
+
+}  // namespace
+
+// Numbers objects and upvalues as it first meets them and writes their
+// records in that order, so a record only ever refers to numbers the
+// reader has seen or will see.
+struct Snapshot::Writer {
+    std::string out;
+    const Environment& globals;
+    std::unordered_map<const FunctionStmt*, uint32_t> declarations;
+    std::unordered_map<const LoxObject*, uint32_t> objectIds;
+    std::vector<const LoxObject*> objects;
+    std::unordered_map<const LoxUpvalue*, uint32_t> upvalueIds;
+    std::vector<const LoxUpvalue*> upvalues;
+
+    Writer(const Module& prelude, const Environment& globals) : globals(globals) {
+        numberFunctions(prelude.statements, [&](FunctionStmt& function) {
+            declarations.emplace(&function, static_cast<uint32_t>(declarations.size()));
+        });
+    }
+
+    uint32_t id(const LoxObject& object) {
+        auto found = objectIds.find(&object);
+        if (found != objectIds.end()) return found->second;
+
+        if (object.type() == ObjType::MODULE) {
+            throw LoxError("Can't snapshot module " + object.toString() + ".");
+        }
+        if (object.type() == ObjType::BOUND_NATIVE) {
+            throw LoxError("Can't snapshot bound method " + object.toString() + ".");
+        }
+        uint32_t id = static_cast<uint32_t>(objects.size());
+        objectIds.emplace(&object, id);
+        objects.push_back(&object);
+        return id;
+    }
+
+    uint32_t id(const LoxUpvalue* upvalue) {
+        if (upvalue->location != &upvalue->closed) throw LoxError("Can't snapshot an open upvalue.");
+        auto found = upvalueIds.find(upvalue);
+        if (found != upvalueIds.end()) return found->second;
+
+        uint32_t id = static_cast<uint32_t>(upvalues.size());
+        upvalueIds.emplace(upvalue, id);
+        upvalues.push_back(upvalue);
+        return id;
+    }
+
+    void value(const Value& value) {
+        if (value.isNil()) {
+            putByte(out, static_cast<unsigned char>(Tag::NIL));
+        } else if (value.isBool()) {
+            putByte(out, static_cast<unsigned char>(value.asBool() ? Tag::TRUE : Tag::FALSE));
+        } else if (value.isNumber()) {
+            putByte(out, static_cast<unsigned char>(Tag::NUMBER));
+            double number = value.asNumber();
+            putRaw(out, &number, sizeof number);
+        } else if (value.isString()) {
+            putByte(out, static_cast<unsigned char>(Tag::STRING));
+            putString(out, value.asString());
+        } else if (value.asObject() == nullptr) {
+            putByte(out, static_cast<unsigned char>(Tag::NIL));
+        } else {
+            putByte(out, static_cast<unsigned char>(Tag::OBJECT));
+            putU32(out, id(*value.asObject()));
+        }
+    }
+
+    void fields(const FlatHashMap<std::string, Value>& fields) {
+        putU32(out, static_cast<uint32_t>(fields.size()));
+        for (const auto& field : fields) {
+            putString(out, field.key);
+            value(field.value);
+        }
+    }
+
+    void record(const LoxObject& object) {
+        switch (object.type()) {
+            case ObjType::FUNCTION: {
+                const auto& function = static_cast<const LoxFunction&>(object);
+                auto declaration = declarations.find(function.declaration);
+                if (declaration == declarations.end() || function.globals.get() != &globals) {
+                    throw LoxError("Can't snapshot " + function.toString() + ", declared outside the prelude.");
+                }
+                putByte(out, static_cast<unsigned char>(Kind::FUNCTION));
+                putU32(out, declaration->second);
+                putByte(out, function.isInitializer);
+                putU32(out, static_cast<uint32_t>(function.upvalues.size()));
+                for (const auto& upvalue : function.upvalues) putU32(out, id(upvalue.get()));
+                break;
+            }
+            case ObjType::NATIVE:
+                putByte(out, static_cast<unsigned char>(Kind::NATIVE));
+                putString(out, static_cast<const NativeFunction&>(object).name);
+                break;
+            case ObjType::CLASS: {
+                const auto& klass = static_cast<const LoxClass&>(object);
+                putByte(out, static_cast<unsigned char>(Kind::CLASS));
+                putString(out, klass.name);
+                putU32(out, klass.superclass != nullptr ? id(*klass.superclass) : NONE);
+                // Inherited methods are copied down again when it is restored.
+                std::vector<std::pair<const std::string*, const LoxFunction*>> own;
+                for (const auto& method : klass.methods) {
+                    if (klass.superclass == nullptr ||
+                        klass.superclass->findMethod(method.key, MethodTable::hashOf(method.key)) != method.value.get()) {
+                        own.emplace_back(&method.key, method.value.get());
+                    }
+                }
+                putU32(out, static_cast<uint32_t>(own.size()));
+                for (const auto& method : own) {
+                    putString(out, *method.first);
+                    putU32(out, id(*method.second));
+                }
+                break;
+            }
+            case ObjType::INSTANCE: {
+                const auto& instance = static_cast<const LoxInstance&>(object);
+                putByte(out, static_cast<unsigned char>(Kind::INSTANCE));
+                putU32(out, id(*instance.klass));
+                fields(instance.fields);
+                break;
+            }
+            case ObjType::LIST: {
+                const auto& list = static_cast<const LoxList&>(object);
+                putByte(out, static_cast<unsigned char>(Kind::LIST));
+                putU32(out, static_cast<uint32_t>(list.elements.size()));
+                for (const Value& element : list.elements) value(element);
+                break;
+            }
+            case ObjType::MAP: {
+                const auto& map = static_cast<const LoxMap&>(object);
+                putByte(out, static_cast<unsigned char>(Kind::MAP));
+                uint32_t count = 0;
+                for (const auto& entry : map.getEntries()) count += !entry.removed;
+                putU32(out, count);
+                for (const auto& entry : map.getEntries()) {
+                    if (entry.removed) continue;
+                    value(entry.key);
+                    value(entry.value);
+                }
+                break;
+            }
+            case ObjType::STRING_BUILDER:
+                putByte(out, static_cast<unsigned char>(Kind::STRING_BUILDER));
+                putString(out, static_cast<const LoxStringBuilder&>(object).buffer);
+                break;
+            case ObjType::BOUND_METHOD: {
+                const auto& bound = static_cast<const LoxBoundMethod&>(object);
+                putByte(out, static_cast<unsigned char>(Kind::BOUND_METHOD));
+                putU32(out, id(*bound.receiver));
+                putU32(out, id(*bound.method));
+                break;
+            }
+            case ObjType::MODULE:
+            case ObjType::BOUND_NATIVE:
+                break;  // refused by id()
+        }
+    }
+
+    void write() {
+        fields(globals.values);
+        size_t nextObject = 0;
+        size_t nextUpvalue = 0;
+        while (nextObject < objects.size() || nextUpvalue < upvalues.size()) {
+            if (nextUpvalue < upvalues.size()) {
+                putByte(out, static_cast<unsigned char>(Kind::UPVALUE));
+                value(upvalues[nextUpvalue++]->closed);
+            } else {
+                record(*objects[nextObject++]);
+            }
+        }
+        putByte(out, static_cast<unsigned char>(Kind::END));
+    }
+};
+
+// Reads every record before creating anything, then builds the objects in
+// dependency order: what a constructor needs (a function's upvalues, a
+// class's superclass and methods, an instance's class) is made first, and
+// the contents of upvalues, collections and instances, which may refer
+// back to anything, are filled in last.
+struct Snapshot::Reader {
+    // A value as saved, with objects still numbers.
+    struct Saved {
+        Tag tag = Tag::NIL;
+        double number = 0;
+        std::string string;
+        uint32_t id = NONE;
+    };
+
+    struct Record {
+        Kind kind;
+        std::string name;     // native, class; string builder contents
+        // function: declaration; class: superclass; instance, bound method: class, receiver
+        uint32_t id = NONE;
+        bool isInitializer = false;
+        std::vector<uint32_t> ids;                            // function: upvalues; bound method: function
+        std::vector<std::pair<std::string, uint32_t>> methods;
+        std::vector<std::pair<std::string, Saved>> fields;
+        std::vector<Saved> values;                            // list; map keys and values in turn
+    };
+
+    Input in;
+    std::vector<FunctionStmt*> declarations;
+    std::vector<std::pair<std::string, Saved>> globals;
+    std::vector<Record> records;
+    std::vector<Saved> upvalueValues;
+    std::vector<std::shared_ptr<LoxObject>> objects;
+    std::vector<std::shared_ptr<LoxUpvalue>> upvalues;
+
+    Reader(const std::string& heap, const Module& prelude) : in(heap) {
+        numberFunctions(prelude.statements, [&](FunctionStmt& function) {
+            declarations.push_back(&function);
+        });
+    }
+
+    Saved saved() {
+        Saved value;
+        value.tag = static_cast<Tag>(in.byte());
+        switch (value.tag) {
+            case Tag::NIL:
+            case Tag::FALSE:
+            case Tag::TRUE: break;
+            case Tag::NUMBER: value.number = in.number(); break;
+            case Tag::STRING: value.string = in.string(); break;
+            case Tag::OBJECT: value.id = in.u32(); break;
+            default: throw LoxError("Snapshot has an unknown value tag.");
+        }
+        return value;
+    }
+
+    std::vector<std::pair<std::string, Saved>> fields() {
+        std::vector<std::pair<std::string, Saved>> fields(in.count(5));
+        for (auto& field : fields) {
+            field.first = in.string();
+            field.second = saved();
+        }
+        return fields;
+    }
+
+    void read() {
+        globals = fields();
+        for (;;) {
+            Record record;
+            record.kind = static_cast<Kind>(in.byte());
+            switch (record.kind) {
+                case Kind::END: return;
+                case Kind::UPVALUE: upvalueValues.push_back(saved()); continue;
+                case Kind::FUNCTION:
+                    record.id = in.u32();
+                    record.isInitializer = in.byte() != 0;
+                    record.ids.resize(in.count(4));
+                    for (uint32_t& id : record.ids) id = in.u32();
+                    break;
+                case Kind::NATIVE:
+                case Kind::STRING_BUILDER: record.name = in.string(); break;
+                case Kind::CLASS:
+                    record.name = in.string();
+                    record.id = in.u32();
+                    record.methods.resize(in.count(8));
+                    for (auto& method : record.methods) {
+                        method.first = in.string();
+                        method.second = in.u32();
+                    }
+                    break;
+                case Kind::INSTANCE:
+                    record.id = in.u32();
+                    record.fields = fields();
+                    break;
+                case Kind::BOUND_METHOD:
+                    record.id = in.u32();
+                    record.ids.push_back(in.u32());
+                    break;
+                case Kind::LIST:
+                    record.values.resize(in.count(1));
+                    for (Saved& value : record.values) value = saved();
+                    break;
+                case Kind::MAP:
+                    record.values.resize(2 * static_cast<size_t>(in.count(2)));
+                    for (Saved& value : record.values) value = saved();
+                    break;
+                default: throw LoxError("Snapshot has an unknown record kind.");
+            }
+            records.push_back(std::move(record));
+        }
+    }
+
+    const std::shared_ptr<LoxObject>& object(uint32_t id, ObjType type) {
+        if (id >= objects.size() || objects[id] == nullptr || objects[id]->type() != type) {
+            throw LoxError("Snapshot refers to a missing object.");
+        }
+        return objects[id];
+    }
+
+    Value value(const Saved& saved) {
+        switch (saved.tag) {
+            case Tag::FALSE: return Value(false);
+            case Tag::TRUE: return Value(true);
+            case Tag::NUMBER: return Value(saved.number);
+            case Tag::STRING: return Value(saved.string);
+            case Tag::OBJECT:
+                if (saved.id >= objects.size() || objects[saved.id] == nullptr) {
+                    throw LoxError("Snapshot refers to a missing object.");
+                }
+                return Value(objects[saved.id]);
+            default: return Value();
+        }
+    }
+
+    std::shared_ptr<LoxClass> makeClass(uint32_t id, std::vector<bool>& making) {
+        if (id >= records.size() || records[id].kind != Kind::CLASS) {
+            throw LoxError("Snapshot refers to a missing class.");
+        }
+        if (objects[id] != nullptr) return std::static_pointer_cast<LoxClass>(objects[id]);
+        if (making[id]) throw LoxError("Snapshot has a class inheriting from itself.");
+        making[id] = true;
+
+        const Record& record = records[id];
+        std::shared_ptr<LoxClass> superclass;
+        if (record.id != NONE) superclass = makeClass(record.id, making);
+        MethodTable methods;
+        for (const auto& method : record.methods) {
+            methods[method.first] = std::static_pointer_cast<LoxFunction>(object(method.second, ObjType::FUNCTION));
+        }
+        auto klass = makePooled<LoxClass>(record.name, std::move(superclass), std::move(methods));
+        objects[id] = klass;
+        return klass;
+    }
+
+    void restore(const std::shared_ptr<Environment>& globalEnv) {
+        read();
+        objects.resize(records.size());
+        upvalues.reserve(upvalueValues.size());
+        for (size_t i = 0; i < upvalueValues.size(); i++) {
+            upvalues.push_back(makePooled<LoxUpvalue>(Value()));
+        }
+
+        for (size_t i = 0; i < records.size(); i++) {
+            const Record& record = records[i];
+            switch (record.kind) {
+                case Kind::NATIVE: {
+                    const Value* native = globalEnv->enclosing->values.find(record.name);
+                    if (native == nullptr || !native->isObjType(ObjType::NATIVE)) {
+                        throw LoxError("Snapshot needs native function '" + record.name + "'.");
+                    }
+                    objects[i] = native->asObject();
+                    break;
+                }
+                case Kind::LIST: objects[i] = makePooled<LoxList>(); break;
+                case Kind::MAP: objects[i] = makePooled<LoxMap>(); break;
+                case Kind::STRING_BUILDER: {
+                    auto builder = makePooled<LoxStringBuilder>();
+                    builder->buffer = record.name;
+                    objects[i] = builder;
+                    break;
+                }
+                case Kind::FUNCTION: {
+                    if (record.id >= declarations.size()) {
+                        throw LoxError("Snapshot doesn't match its prelude's source.");
+                    }
+                    FunctionStmt& declaration = *declarations[record.id];
+                    if (record.ids.size() != declaration.captures.size()) {
+                        throw LoxError("Snapshot doesn't match its prelude's source.");
+                    }
+                    std::vector<std::shared_ptr<LoxUpvalue>> captured;
+                    captured.reserve(record.ids.size());
+                    for (uint32_t id : record.ids) {
+                        if (id >= upvalues.size()) throw LoxError("Snapshot refers to a missing upvalue.");
+                        captured.push_back(upvalues[id]);
+                    }
+                    objects[i] = makePooled<LoxFunction>(declaration, globalEnv, std::move(captured),
+                                                               record.isInitializer);
+                    break;
+                }
+                default: break;
+            }
+        }
+
+        std::vector<bool> making(records.size());
+        for (size_t i = 0; i < records.size(); i++) {
+            if (records[i].kind == Kind::CLASS) makeClass(static_cast<uint32_t>(i), making);
+        }
+        for (size_t i = 0; i < records.size(); i++) {
+            if (records[i].kind != Kind::INSTANCE) continue;
+            auto klass = std::static_pointer_cast<LoxClass>(object(records[i].id, ObjType::CLASS));
+            objects[i] = makePooled<LoxInstance>(std::move(klass));
+        }
+        for (size_t i = 0; i < records.size(); i++) {
+            if (records[i].kind != Kind::BOUND_METHOD) continue;
+            const std::shared_ptr<LoxObject>& receiver = object(records[i].id, ObjType::INSTANCE);
+            auto method = std::static_pointer_cast<LoxFunction>(object(records[i].ids[0], ObjType::FUNCTION));
+            objects[i] = makePooled<LoxBoundMethod>(receiver, std::move(method));
+        }
+
+        for (size_t i = 0; i < upvalues.size(); i++) {
+            upvalues[i]->closed = value(upvalueValues[i]);
+        }
+        for (size_t i = 0; i < records.size(); i++) {
+            const Record& record = records[i];
+            switch (record.kind) {
+                case Kind::INSTANCE: {
+                    auto& instance = static_cast<LoxInstance&>(*objects[i]);
+                    for (const auto& field : record.fields) instance.fields[field.first] = value(field.second);
+                    break;
+                }
+                case Kind::LIST: {
+                    auto& list = static_cast<LoxList&>(*objects[i]);
+                    list.elements.reserve(record.values.size());
+                    for (const Saved& element : record.values) list.elements.push_back(value(element));
+                    break;
+                }
+                case Kind::MAP: {
+                    auto& map = static_cast<LoxMap&>(*objects[i]);
+                    for (size_t j = 0; j < record.values.size(); j += 2) {
+                        map.set(value(record.values[j]), value(record.values[j + 1]));
+                    }
+                    break;
+                }
+                default: break;
+            }
+        }
+
+        for (const auto& global : globals) globalEnv->define(global.first, value(global.second));
+    }
+};
+
+std::string Snapshot::save(const std::string& path, const std::string& source,
+                           const Module& prelude, Environment& globals) {
+    Writer writer(prelude, globals);
+    putRaw(writer.out, MAGIC, sizeof MAGIC);
+    putU32(writer.out, VERSION);
+    putString(writer.out, path);
+    putString(writer.out, source);
+    writer.write();
+    return std::move(writer.out);
+}
+
+Snapshot Snapshot::load(const std::string& data) {
+    if (data.size() < sizeof MAGIC || std::memcmp(data.data(), MAGIC, sizeof MAGIC) != 0) {
+        throw LoxError("Not a snapshot.");
+    }
+    Input in(data, sizeof MAGIC);
+    if (in.u32() != VERSION) throw LoxError("Snapshot was made by another version of lox.");
+
+    Snapshot snapshot;
+    snapshot.path = in.string();
+    snapshot.source = in.string();
+    snapshot.heap = data.substr(in.offset());
+    return snapshot;
+}
+
+void Snapshot::restore(const Module& prelude, const std::shared_ptr<Environment>& globals) const {
+    Reader reader(heap, prelude);
+    reader.restore(globals);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+class Environment;
+struct Module;
+
+// A startup snapshot: the globals a prelude script defined and every object
+// they reach, saved so that later runs restore them instead of running the
+// prelude again (lox --snapshot, lox --from-snapshot).
+//
+// Function bodies aren't serialized. The prelude's source is saved with the
+// heap and parsed again on restore, and functions refer to their
+// declarations by position in its AST. Restoring skips only the prelude's
+// execution, which is where its start-up time goes.
+class Snapshot {
+public:
+    std::string path;    // of the prelude, for error messages
+    std::string source;  // of the prelude
+
+    // Serializes `globals` after `prelude` has run in them. Throws LoxError
+    // for values that can't be saved: modules, bound native methods and
+    // functions declared outside the prelude.
+    static std::string save(const std::string& path, const std::string& source,
+                            const Module& prelude, Environment& globals);
+    // Reads the contents of a snapshot file. Throws LoxError if they aren't
+    // one.
+    static Snapshot load(const std::string& data);
+
+    // Defines the saved globals in `globals`. `prelude` must be `source`
+    // parsed and resolved. Throws LoxError if the heap doesn't match it.
+    void restore(const Module& prelude, const std::shared_ptr<Environment>& globals) const;
+
+private:
+    struct Writer;
+    struct Reader;
+
+    std::string heap;
+};
@@ -0,0 +1,410 @@
+#include "ast_compiler.h"
+#include <algorithm>
+
+std::unique_ptr<CompiledFunction> AstCompiler::compile(FunctionStmt& function) {
+    auto code = std::make_unique<CompiledFunction>();
+    AstCompiler compiler(*code, function.name);
+    try {
+        for (auto& statement : function.body) {
+            compiler.compile(*statement);
+        }
+        compiler.emit(OpCode::OP_NIL, 1);
+        compiler.emit(OpCode::OP_RETURN, -1);
+    } catch (const Unsupported&) {
+        return nullptr;
+    }
+    return code;
+}
+
+void AstCompiler::emit(OpCode op, int effect) {
+    code.chunk.writeChunk(op, token->line);
+    code.tokens.push_back(token);
+    depth += effect;
+    code.maxStack = std::max(code.maxStack, depth);
+}
+
+void AstCompiler::emit(OpCode op, int effect, int operand) {
+    emit(op, effect);
+    code.chunk.writeChunk(static_cast<unsigned char>(operand), token->line);
+    code.tokens.push_back(token);
+}
+
+// Jumps are emitted with a placeholder offset that patchJump fills in.
+int AstCompiler::emitJump(OpCode op) {
+    emit(op, 0);
+    for (int i = 0; i < 2; i++) {
+        code.chunk.writeChunk(static_cast<unsigned char>(0xff), token->line);
+        code.tokens.push_back(token);
+    }
+    return static_cast<int>(code.chunk.count()) - 2;
+}
+
+void AstCompiler::patchJump(int offset) {
+    size_t jump = code.chunk.count() - offset - 2;
+    if (jump > UINT16_MAX) throw Unsupported();
+    code.chunk.patch(offset, static_cast<unsigned char>((jump >> 8) & 0xff));
+    code.chunk.patch(offset + 1, static_cast<unsigned char>(jump & 0xff));
+}
+
+void AstCompiler::emitLoop(int start) {
+    emit(OpCode::OP_LOOP, 0);
+    size_t jump = code.chunk.count() - start + 2;
+    if (jump > UINT16_MAX) throw Unsupported();
+    code.chunk.writeChunk(static_cast<unsigned char>((jump >> 8) & 0xff), token->line);
+    code.chunk.writeChunk(static_cast<unsigned char>(jump & 0xff), token->line);
+    code.tokens.push_back(token);
+    code.tokens.push_back(token);
+}
+
+// Strings are shared, so that a name used all over a function takes up
+// just one of its constants.
+int AstCompiler::makeConstant(const Value& value) {
+    if (value.isString()) {
+        const std::vector<Value>& constants = code.chunk.getConstants();
+        for (size_t i = 0; i < constants.size(); i++) {
+            if (constants[i].isString() && constants[i].asString() == value.asString()) return static_cast<int>(i);
+        }
+    }
+    return byteOperand(code.chunk.addConstant(value));
+}
+
+int AstCompiler::byteOperand(size_t value) {
+    if (value > UINT8_MAX) throw Unsupported();
+    return static_cast<int>(value);
+}
+
+void AstCompiler::load(const Token& name, const Resolution& resolution) {
+    token = &name;
+    switch (resolution.kind) {
+        case Resolution::Kind::LOCAL: emit(OpCode::OP_GET_LOCAL, 1, byteOperand(resolution.slot)); break;
+        case Resolution::Kind::UPVALUE: emit(OpCode::OP_GET_UPVALUE, 1, byteOperand(resolution.slot)); break;
+        case Resolution::Kind::GLOBAL: emit(OpCode::OP_GET_GLOBAL, 1, makeConstant(Value(name.lexeme))); break;
+    }
+}
+
+// Leaves the value on the stack, as an assignment expression does.
+void AstCompiler::store(const Token& name, const Resolution& resolution) {
+    token = &name;
+    switch (resolution.kind) {
+        case Resolution::Kind::LOCAL: emit(OpCode::OP_SET_LOCAL, 0, byteOperand(resolution.slot)); break;
+        case Resolution::Kind::UPVALUE: emit(OpCode::OP_SET_UPVALUE, 0, byteOperand(resolution.slot)); break;
+        case Resolution::Kind::GLOBAL: emit(OpCode::OP_SET_GLOBAL, 0, makeConstant(Value(name.lexeme))); break;
+    }
+}
+
+void AstCompiler::arguments(const std::vector<std::unique_ptr<Expr>>& arguments) {
+    for (auto& argument : arguments) {
+        compile(*argument);
+    }
+    byteOperand(arguments.size());
+}
+
+// Whether evaluating expr can't assign to anything or call anything.
+static bool isPure(Expr& expr) {
+    if (auto* binary = dynamic_cast<BinaryExpr*>(&expr)) return isPure(*binary->left) && isPure(*binary->right);
+    if (auto* logical = dynamic_cast<LogicalExpr*>(&expr)) return isPure(*logical->left) && isPure(*logical->right);
+    if (auto* unary = dynamic_cast<UnaryExpr*>(&expr)) return isPure(*unary->right);
+    if (auto* grouping = dynamic_cast<GroupingExpr*>(&expr)) return isPure(*grouping->expression);
+    return dynamic_cast<VariableExpr*>(&expr) != nullptr || dynamic_cast<LiteralExpr*>(&expr) != nullptr;
+}
+
+// Locals and literals are read in place, as the tree-walker does, rather
+// than pushed. The left operand is read after the right one is evaluated,
+// so only if that can't change it.
+Value AstCompiler::visitBinaryExpr(BinaryExpr& expr) {
+    bool rightInPlace = expr.rightSlot >= 0 || expr.rightConstant != nullptr;
+    bool leftInPlace = (expr.leftSlot >= 0 || expr.leftConstant != nullptr) && isPure(*expr.right);
+    if (!leftInPlace) compile(*expr.left);
+    if (!rightInPlace) compile(*expr.right);
+
+    OpCode op;
+    switch (expr.operator_.type) {
+        case TokenType::PLUS: op = OpCode::OP_ADD; break;
+        case TokenType::MINUS: op = OpCode::OP_SUBTRACT; break;
+        case TokenType::STAR: op = OpCode::OP_MULTIPLY; break;
+        case TokenType::SLASH: op = OpCode::OP_DIVIDE; break;
+        case TokenType::GREATER: op = OpCode::OP_GREATER; break;
+        case TokenType::GREATER_EQUAL: op = OpCode::OP_GREATER_EQUAL; break;
+        case TokenType::LESS: op = OpCode::OP_LESS; break;
+        case TokenType::LESS_EQUAL: op = OpCode::OP_LESS_EQUAL; break;
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::BANG_EQUAL: op = OpCode::OP_EQUAL; break;
+        default: throw Unsupported();
+    }
+
+    int operands[2];
+    int count = 0;
+    OperandKind left = OperandKind::STACK;
+    OperandKind right = OperandKind::STACK;
+    if (leftInPlace) {
+        left = expr.leftSlot >= 0 ? OperandKind::LOCAL : OperandKind::CONSTANT;
+        operands[count++] = expr.leftSlot >= 0 ? byteOperand(expr.leftSlot) : makeConstant(*expr.leftConstant);
+    }
+    if (rightInPlace) {
+        right = expr.rightSlot >= 0 ? OperandKind::LOCAL : OperandKind::CONSTANT;
+        operands[count++] = expr.rightSlot >= 0 ? byteOperand(expr.rightSlot) : makeConstant(*expr.rightConstant);
+    }
+
+    token = &expr.operator_;
+    int popped = (left == OperandKind::STACK) + (right == OperandKind::STACK);
+    emit(op, 1 - popped, (static_cast<int>(left) << 4) | static_cast<int>(right));
+    for (int i = 0; i < count; i++) {
+        code.chunk.writeChunk(static_cast<unsigned char>(operands[i]), token->line);
+        code.tokens.push_back(token);
+    }
+    if (expr.operator_.type == TokenType::BANG_EQUAL) emit(OpCode::OP_NOT, 0);
+    return Value();
+}
+
+Value AstCompiler::visitGroupingExpr(GroupingExpr& expr) {
+    compile(*expr.expression);
+    return Value();
+}
+
+Value AstCompiler::visitLiteralExpr(LiteralExpr& expr) {
+    if (expr.value.isNil()) {
+        emit(OpCode::OP_NIL, 1);
+    } else if (expr.value.isBool()) {
+        emit(expr.value.asBool() ? OpCode::OP_TRUE : OpCode::OP_FALSE, 1);
+    } else {
+        emit(OpCode::OP_CONSTANT, 1, makeConstant(expr.value));
+    }
+    return Value();
+}
+
+Value AstCompiler::visitUnaryExpr(UnaryExpr& expr) {
+    compile(*expr.right);
+    token = &expr.operator_;
+    emit(expr.operator_.type == TokenType::MINUS ? OpCode::OP_NEGATE : OpCode::OP_NOT, 0);
+    return Value();
+}
+
+Value AstCompiler::visitVariableExpr(VariableExpr& expr) {
+    load(expr.name, expr.resolution);
+    return Value();
+}
+
+Value AstCompiler::visitAssignExpr(AssignExpr& expr) {
+    compile(*expr.value);
+    store(expr.name, expr.resolution);
+    return Value();
+}
+
+// Leaves the deciding operand on the stack without converting it to a
+// boolean, like the tree-walker.
+Value AstCompiler::visitLogicalExpr(LogicalExpr& expr) {
+    compile(*expr.left);
+    token = &expr.operator_;
+    if (expr.operator_.type == TokenType::OR) {
+        int elseJump = emitJump(OpCode::OP_JUMP_IF_FALSE);
+        int endJump = emitJump(OpCode::OP_JUMP);
+        patchJump(elseJump);
+        emit(OpCode::OP_POP, -1);
+        compile(*expr.right);
+        patchJump(endJump);
+    } else {
+        int endJump = emitJump(OpCode::OP_JUMP_IF_FALSE);
+        emit(OpCode::OP_POP, -1);
+        compile(*expr.right);
+        patchJump(endJump);
+    }
+    return Value();
+}
+
+Value AstCompiler::visitCallExpr(CallExpr& expr) {
+    int argCount = static_cast<int>(expr.arguments.size());
+    if (expr.method != nullptr) {
+        method(*expr.method);
+        arguments(expr.arguments);
+        token = &expr.paren;
+        emit(OpCode::OP_INVOKE, -argCount - 1, argCount);
+        return Value();
+    }
+    compile(*expr.callee);
+    arguments(expr.arguments);
+    token = &expr.paren;
+    emit(OpCode::OP_CALL, -argCount, argCount);
+    return Value();
+}
+
+// The callee of `object.name(...)`, and a slot for its receiver
+void AstCompiler::method(GetExpr& get) {
+    compile(*get.object);
+    token = &get.name;
+    emit(OpCode::OP_GET_METHOD, 1, makeConstant(Value(get.name.lexeme)));
+}
+
+Value AstCompiler::visitGetExpr(GetExpr& expr) {
+    compile(*expr.object);
+    token = &expr.name;
+    emit(OpCode::OP_GET_PROPERTY, 0, makeConstant(Value(expr.name.lexeme)));
+    code.chunk.writeChunk(static_cast<unsigned char>(0), token->line);  // the field cache
+    code.tokens.push_back(token);
+    return Value();
+}
+
+Value AstCompiler::visitSetExpr(SetExpr& expr) {
+    compile(*expr.object);
+    compile(*expr.value);
+    token = &expr.name;
+    emit(OpCode::OP_SET_PROPERTY, -1, makeConstant(Value(expr.name.lexeme)));
+    return Value();
+}
+
+Value AstCompiler::visitThisExpr(ThisExpr& expr) {
+    load(expr.keyword, expr.resolution);
+    return Value();
+}
+
+Value AstCompiler::visitSuperExpr(SuperExpr& expr) {
+    load(expr.keyword, expr.resolution);
+    load(expr.keyword, expr.thisResolution);
+    token = &expr.method;
+    emit(OpCode::OP_GET_SUPER, -1, makeConstant(Value(expr.method.lexeme)));
+    return Value();
+}
+
+Value AstCompiler::visitListExpr(ListExpr& expr) {
+    arguments(expr.elements);
+    int count = static_cast<int>(expr.elements.size());
+    token = &expr.bracket;
+    emit(OpCode::OP_BUILD_LIST, 1 - count, count);
+    return Value();
+}
+
+Value AstCompiler::visitMapExpr(MapExpr& expr) {
+    for (size_t i = 0; i < expr.keys.size(); i++) {
+        compile(*expr.keys[i]);
+        compile(*expr.values[i]);
+    }
+    int count = byteOperand(expr.keys.size());
+    token = &expr.brace;
+    emit(OpCode::OP_BUILD_MAP, 1 - 2 * count, count);
+    return Value();
+}
+
+Value AstCompiler::visitSubscriptExpr(SubscriptExpr& expr) {
+    compile(*expr.object);
+    compile(*expr.index);
+    token = &expr.bracket;
+    emit(OpCode::OP_GET_INDEX, -1);
+    return Value();
+}
+
+Value AstCompiler::visitSubscriptSetExpr(SubscriptSetExpr& expr) {
+    compile(*expr.object);
+    compile(*expr.index);
+    compile(*expr.value);
+    token = &expr.bracket;
+    emit(OpCode::OP_SET_INDEX, -2);
+    return Value();
+}
+
+void AstCompiler::visitExpressionStmt(ExpressionStmt& stmt) {
+    // An assignment to a local whose value isn't used is a single store.
+    auto* assignment = dynamic_cast<AssignExpr*>(stmt.expression.get());
+    if (assignment != nullptr && assignment->resolution.kind == Resolution::Kind::LOCAL) {
+        compile(*assignment->value);
+        token = &assignment->name;
+        emit(OpCode::OP_STORE_LOCAL, -1, byteOperand(assignment->resolution.slot));
+        return;
+    }
+    compile(*stmt.expression);
+    emit(OpCode::OP_POP, -1);
+}
+
+void AstCompiler::visitPrintStmt(PrintStmt& stmt) {
+    compile(*stmt.expression);
+    emit(OpCode::OP_PRINT, -1);
+}
+
+void AstCompiler::visitVarStmt(VarStmt& stmt) {
+    if (stmt.initializer != nullptr) {
+        compile(*stmt.initializer);
+    } else {
+        emit(OpCode::OP_NIL, 1);
+    }
+    // Everything declared in a function body is a local.
+    if (stmt.resolution.kind != Resolution::Kind::LOCAL) throw Unsupported();
+    token = &stmt.name;
+    emit(OpCode::OP_STORE_LOCAL, -1, byteOperand(stmt.resolution.slot));
+}
+
+void AstCompiler::visitBlockStmt(BlockStmt& stmt) {
+    for (auto& statement : stmt.statements) {
+        compile(*statement);
+    }
+    if (stmt.capturedFrom >= 0) {
+        emit(OpCode::OP_CLOSE_UPVALUE, 0, byteOperand(stmt.capturedFrom));
+    }
+}
+
+void AstCompiler::visitIfStmt(IfStmt& stmt) {
+    compile(*stmt.condition);
+    int elseJump = emitJump(OpCode::OP_POP_JUMP_IF_FALSE);
+    depth--;
+    compile(*stmt.thenBranch);
+    if (stmt.elseBranch == nullptr) {
+        patchJump(elseJump);
+        return;
+    }
+    int endJump = emitJump(OpCode::OP_JUMP);
+    patchJump(elseJump);
+    compile(*stmt.elseBranch);
+    patchJump(endJump);
+}
+
+void AstCompiler::visitWhileStmt(WhileStmt& stmt) {
+    int loopStart = static_cast<int>(code.chunk.count());
+    compile(*stmt.condition);
+    int exitJump = emitJump(OpCode::OP_POP_JUMP_IF_FALSE);
+    depth--;
+    compile(*stmt.body);
+    emitLoop(loopStart);
+    patchJump(exitJump);
+}
+
+void AstCompiler::visitFunctionStmt(FunctionStmt& stmt) {
+    code.functions.push_back(&stmt);
+    token = &stmt.name;
+    emit(OpCode::OP_CLOSURE, 1, byteOperand(code.functions.size() - 1));
+    if (stmt.resolution.kind != Resolution::Kind::LOCAL) throw Unsupported();
+    emit(OpCode::OP_STORE_LOCAL, -1, byteOperand(stmt.resolution.slot));
+}
+
+void AstCompiler::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.tailCall != nullptr) {
+        CallExpr& call = *stmt.tailCall;
+        int argCount = static_cast<int>(call.arguments.size());
+        if (call.method != nullptr) {
+            method(*call.method);
+            arguments(call.arguments);
+            token = &call.paren;
+            emit(OpCode::OP_TAIL_INVOKE, -argCount - 2, argCount);
+            return;
+        }
+        compile(*call.callee);
+        arguments(call.arguments);
+        token = &call.paren;
+        emit(OpCode::OP_TAIL_CALL, -argCount - 1, argCount);
+        return;
+    }
+
+    token = &stmt.keyword;
+    if (stmt.value != nullptr) {
+        compile(*stmt.value);
+    } else {
+        emit(OpCode::OP_NIL, 1);
+    }
+    emit(OpCode::OP_RETURN, -1);
+}
+
+void AstCompiler::visitClassStmt(ClassStmt& stmt) {
+    (void)stmt;
+    throw Unsupported();
+}
+
+void AstCompiler::visitImportStmt(ImportStmt& stmt) {
+    (void)stmt;
+    throw Unsupported();
+}
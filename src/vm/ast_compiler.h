@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "chunk.h"
+#include "../parser/ast.h"
+
+// Bytecode for one function of the tree-walker's AST, run by the
+// interpreter once the function is hot (lox --tiered). It uses the
+// interpreter's frames, upvalues and objects as they are: locals are read
+// from the frame slots the resolver assigned, and the operand stack sits
+// on the value stack just above the frame.
+struct CompiledFunction {
+    Chunk chunk;
+    // The token each byte of code came from. Instructions that can fail
+    // report errors at it, and name lookups use its precomputed hash.
+    std::vector<const Token*> tokens;
+    std::vector<FunctionStmt*> functions;  // declarations OP_CLOSURE makes closures of
+    int maxStack = 0;                      // operand stack slots the code needs
+};
+
+// Compiles a resolved function body. Functions using something the
+// bytecode doesn't cover (class declarations, imports, more than 256
+// constants, slots or collection elements) aren't compiled and stay in the
+// tree-walker.
+class AstCompiler : public ExprVisitor, public StmtVisitor {
+public:
+    static std::unique_ptr<CompiledFunction> compile(FunctionStmt& function);
+
+    Value visitBinaryExpr(BinaryExpr& expr) override;
+    Value visitGroupingExpr(GroupingExpr& expr) override;
+    Value visitLiteralExpr(LiteralExpr& expr) override;
+    Value visitUnaryExpr(UnaryExpr& expr) override;
+    Value visitVariableExpr(VariableExpr& expr) override;
+    Value visitAssignExpr(AssignExpr& expr) override;
+    Value visitLogicalExpr(LogicalExpr& expr) override;
+    Value visitCallExpr(CallExpr& expr) override;
+    Value visitGetExpr(GetExpr& expr) override;
+    Value visitSetExpr(SetExpr& expr) override;
+    Value visitThisExpr(ThisExpr& expr) override;
+    Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSubscriptExpr(SubscriptExpr& expr) override;
+    Value visitSubscriptSetExpr(SubscriptSetExpr& expr) override;
+
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitImportStmt(ImportStmt& stmt) override;
+
+private:
+    // Thrown to give up on a function the bytecode can't express.
+    struct Unsupported {};
+
+    CompiledFunction& code;
+    const Token* token;  // the source of the instructions being emitted
+    int depth = 0;       // operand stack depth at the current instruction
+
+    explicit AstCompiler(CompiledFunction& code, const Token& name) : code(code), token(&name) {}
+
+    void compile(Expr& expr) { expr.accept(*this); }
+    void compile(Stmt& stmt) { stmt.accept(*this); }
+
+    // `effect` is the instruction's net change to the operand stack.
+    void emit(OpCode op, int effect);
+    void emit(OpCode op, int effect, int operand);
+    int emitJump(OpCode op);
+    void patchJump(int offset);
+    void emitLoop(int start);
+    int makeConstant(const Value& value);
+    int byteOperand(size_t value);
+
+    void load(const Token& name, const Resolution& resolution);
+    void store(const Token& name, const Resolution& resolution);
+    void arguments(const std::vector<std::unique_ptr<Expr>>& arguments);
+    void method(GetExpr& get);
+};
@@ -43,18 +43,122 @@ int Chunk::disassembleInstruction(int offset) const {
             return simpleInstruction("OP_TRUE", offset);
         case OpCode::OP_FALSE:
             return simpleInstruction("OP_FALSE", offset);
+        case OpCode::OP_POP:
+            return simpleInstruction("OP_POP", offset);
+        case OpCode::OP_GET_LOCAL:
+            return byteInstruction("OP_GET_LOCAL", offset);
+        case OpCode::OP_SET_LOCAL:
+            return byteInstruction("OP_SET_LOCAL", offset);
+        case OpCode::OP_STORE_LOCAL:
+            return byteInstruction("OP_STORE_LOCAL", offset);
+        case OpCode::OP_GET_GLOBAL:
+            return constantInstruction("OP_GET_GLOBAL", offset);
+        case OpCode::OP_DEFINE_GLOBAL:
+            return constantInstruction("OP_DEFINE_GLOBAL", offset);
+        case OpCode::OP_SET_GLOBAL:
+            return constantInstruction("OP_SET_GLOBAL", offset);
+        case OpCode::OP_GET_UPVALUE:
+            return byteInstruction("OP_GET_UPVALUE", offset);
+        case OpCode::OP_SET_UPVALUE:
+            return byteInstruction("OP_SET_UPVALUE", offset);
+        case OpCode::OP_GET_PROPERTY:
+            return propertyInstruction("OP_GET_PROPERTY", offset);
+        case OpCode::OP_SET_PROPERTY:
+            return constantInstruction("OP_SET_PROPERTY", offset);
+        case OpCode::OP_GET_SUPER:
+            return constantInstruction("OP_GET_SUPER", offset);
+        case OpCode::OP_GET_METHOD:
+            return constantInstruction("OP_GET_METHOD", offset);
+        case OpCode::OP_EQUAL:
+            return binaryInstruction("OP_EQUAL", offset);
+        case OpCode::OP_GREATER:
+            return binaryInstruction("OP_GREATER", offset);
+        case OpCode::OP_LESS:
+            return binaryInstruction("OP_LESS", offset);
+        case OpCode::OP_GREATER_EQUAL:
+            return binaryInstruction("OP_GREATER_EQUAL", offset);
+        case OpCode::OP_LESS_EQUAL:
+            return binaryInstruction("OP_LESS_EQUAL", offset);
         case OpCode::OP_ADD:
-            return simpleInstruction("OP_ADD", offset);
+            return binaryInstruction("OP_ADD", offset);
         case OpCode::OP_SUBTRACT:
-            return simpleInstruction("OP_SUBTRACT", offset);
+            return binaryInstruction("OP_SUBTRACT", offset);
         case OpCode::OP_MULTIPLY:
-            return simpleInstruction("OP_MULTIPLY", offset);
+            return binaryInstruction("OP_MULTIPLY", offset);
         case OpCode::OP_DIVIDE:
-            return simpleInstruction("OP_DIVIDE", offset);
+            return binaryInstruction("OP_DIVIDE", offset);
         case OpCode::OP_NEGATE:
             return simpleInstruction("OP_NEGATE", offset);
+        case OpCode::OP_NOT:
+            return simpleInstruction("OP_NOT", offset);
+        case OpCode::OP_PRINT:
+            return simpleInstruction("OP_PRINT", offset);
+        case OpCode::OP_JUMP:
+            return jumpInstruction("OP_JUMP", 1, offset);
+        case OpCode::OP_JUMP_IF_FALSE:
+            return jumpInstruction("OP_JUMP_IF_FALSE", 1, offset);
+        case OpCode::OP_POP_JUMP_IF_FALSE:
+            return jumpInstruction("OP_POP_JUMP_IF_FALSE", 1, offset);
+        case OpCode::OP_LOOP:
+            return jumpInstruction("OP_LOOP", -1, offset);
+        case OpCode::OP_CALL:
+            return byteInstruction("OP_CALL", offset);
+        case OpCode::OP_TAIL_CALL:
+            return byteInstruction("OP_TAIL_CALL", offset);
+        case OpCode::OP_INVOKE:
+            return byteInstruction("OP_INVOKE", offset);
+        case OpCode::OP_TAIL_INVOKE:
+            return byteInstruction("OP_TAIL_INVOKE", offset);
+        case OpCode::OP_CLOSURE:
+            return byteInstruction("OP_CLOSURE", offset);
+        case OpCode::OP_CLOSE_UPVALUE:
+            return byteInstruction("OP_CLOSE_UPVALUE", offset);
         case OpCode::OP_RETURN:
             return simpleInstruction("OP_RETURN", offset);
+        case OpCode::OP_BUILD_LIST:
+            return byteInstruction("OP_BUILD_LIST", offset);
+        case OpCode::OP_BUILD_MAP:
+            return byteInstruction("OP_BUILD_MAP", offset);
+        case OpCode::OP_GET_INDEX:
+            return simpleInstruction("OP_GET_INDEX", offset);
+        case OpCode::OP_SET_INDEX:
+            return simpleInstruction("OP_SET_INDEX", offset);
+        case OpCode::OP_GREATER_NUM:
+            return binaryInstruction("OP_GREATER_NUM", offset);
+        case OpCode::OP_LESS_NUM:
+            return binaryInstruction("OP_LESS_NUM", offset);
+        case OpCode::OP_GREATER_EQUAL_NUM:
+            return binaryInstruction("OP_GREATER_EQUAL_NUM", offset);
+        case OpCode::OP_LESS_EQUAL_NUM:
+            return binaryInstruction("OP_LESS_EQUAL_NUM", offset);
+        case OpCode::OP_ADD_NUM:
+            return binaryInstruction("OP_ADD_NUM", offset);
+        case OpCode::OP_SUBTRACT_NUM:
+            return binaryInstruction("OP_SUBTRACT_NUM", offset);
+        case OpCode::OP_MULTIPLY_NUM:
+            return binaryInstruction("OP_MULTIPLY_NUM", offset);
+        case OpCode::OP_DIVIDE_NUM:
+            return binaryInstruction("OP_DIVIDE_NUM", offset);
+        case OpCode::OP_GREATER_GENERIC:
+            return binaryInstruction("OP_GREATER_GENERIC", offset);
+        case OpCode::OP_LESS_GENERIC:
+            return binaryInstruction("OP_LESS_GENERIC", offset);
+        case OpCode::OP_GREATER_EQUAL_GENERIC:
+            return binaryInstruction("OP_GREATER_EQUAL_GENERIC", offset);
+        case OpCode::OP_LESS_EQUAL_GENERIC:
+            return binaryInstruction("OP_LESS_EQUAL_GENERIC", offset);
+        case OpCode::OP_ADD_GENERIC:
+            return binaryInstruction("OP_ADD_GENERIC", offset);
+        case OpCode::OP_SUBTRACT_GENERIC:
+            return binaryInstruction("OP_SUBTRACT_GENERIC", offset);
+        case OpCode::OP_MULTIPLY_GENERIC:
+            return binaryInstruction("OP_MULTIPLY_GENERIC", offset);
+        case OpCode::OP_DIVIDE_GENERIC:
+            return binaryInstruction("OP_DIVIDE_GENERIC", offset);
+        case OpCode::OP_GET_PROPERTY_CACHED:
+            return propertyInstruction("OP_GET_PROPERTY_CACHED", offset);
+        case OpCode::OP_GET_PROPERTY_GENERIC:
+            return propertyInstruction("OP_GET_PROPERTY_GENERIC", offset);
         default:
             std::cout << "Unknown opcode " << static_cast<int>(instruction) << std::endl;
             return offset + 1;
@@ -81,6 +185,35 @@ int Chunk::byteInstruction(const std::string& name, int offset) const {
     return offset + 2;
 }
 
+int Chunk::binaryInstruction(const std::string& name, int offset) const {
+    unsigned char kinds = code[offset + 1];
+    offset += 2;
+    std::cout << std::left << std::setw(16) << name;
+    for (OperandKind kind : {static_cast<OperandKind>(kinds >> 4), static_cast<OperandKind>(kinds & 0xf)}) {
+        switch (kind) {
+            case OperandKind::STACK:
+                std::cout << " stack";
+                break;
+            case OperandKind::LOCAL:
+                std::cout << " local " << static_cast<int>(code[offset++]);
+                break;
+            case OperandKind::CONSTANT:
+                std::cout << " '" << constants[code[offset++]].toString() << "'";
+                break;
+        }
+    }
+    std::cout << std::endl;
+    return offset;
+}
+
+int Chunk::propertyInstruction(const std::string& name, int offset) const {
+    unsigned char constant = code[offset + 1];
+    unsigned char slot = code[offset + 2];
+    std::cout << std::left << std::setw(16) << name << " " << std::setw(4) << static_cast<int>(constant)
+              << " '" << constants[constant].toString() << "' (slot " << static_cast<int>(slot) << ")" << std::endl;
+    return offset + 3;
+}
+
 int Chunk::jumpInstruction(const std::string& name, int sign, int offset) const {
     unsigned short jump = static_cast<unsigned short>(code[offset + 1] << 8);
     jump |= code[offset + 2];
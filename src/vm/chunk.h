@@ -15,6 +15,9 @@ public:
     void writeChunk(unsigned char byte, int line);
     void writeChunk(OpCode opcode, int line);
     int addConstant(const Value& value);
+    void patch(int offset, unsigned char byte) { code[offset] = byte; }
+    // For quickening, which rewrites instructions in place as they run.
+    unsigned char* getRewritableCode() { return code.data(); }
     
     // Getters
     const std::vector<unsigned char>& getCode() const { return code; }
@@ -35,6 +38,8 @@ private:
     int constantInstruction(const std::string& name, int offset) const;
     int simpleInstruction(const std::string& name, int offset) const;
     int byteInstruction(const std::string& name, int offset) const;
+    int binaryInstruction(const std::string& name, int offset) const;
+    int propertyInstruction(const std::string& name, int offset) const;
     int jumpInstruction(const std::string& name, int sign, int offset) const;
     int invokeInstruction(const std::string& name, int offset) const;
 };
\ No newline at end of file
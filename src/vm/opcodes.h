@@ -1,5 +1,11 @@
 #pragma once
 
+enum class OperandKind : unsigned char {
+    STACK,
+    LOCAL,
+    CONSTANT
+};
+
 enum class OpCode : unsigned char {
     OP_CONSTANT,
     OP_NIL,
@@ -8,17 +14,28 @@ enum class OpCode : unsigned char {
     OP_POP,
     OP_GET_LOCAL,
     OP_SET_LOCAL,
+    OP_STORE_LOCAL,  // operand: slot; like OP_SET_LOCAL, then pops
     OP_GET_GLOBAL,
     OP_DEFINE_GLOBAL,
     OP_SET_GLOBAL,
     OP_GET_UPVALUE,
     OP_SET_UPVALUE,
+    // operands: name constant, field cache (see OP_GET_PROPERTY_CACHED)
     OP_GET_PROPERTY,
     OP_SET_PROPERTY,
     OP_GET_SUPER,
+    // operand: name constant. For a call `object.name(...)`: leaves the
+    // method and the object as its receiver if name is a method of the
+    // object's class, or else the property and an empty (nil) receiver slot.
+    OP_GET_METHOD,
+    // Binary operators are followed by a byte saying where their operands
+    // are, (left << 4) | right, each an OperandKind. An operand that isn't
+    // on the stack is then given by a slot or constant index, left first.
     OP_EQUAL,
     OP_GREATER,
     OP_LESS,
+    OP_GREATER_EQUAL,
+    OP_LESS_EQUAL,
     OP_ADD,
     OP_SUBTRACT,
     OP_MULTIPLY,
@@ -28,14 +45,46 @@ enum class OpCode : unsigned char {
     OP_PRINT,
     OP_JUMP,
     OP_JUMP_IF_FALSE,
+    OP_POP_JUMP_IF_FALSE,  // pops the condition either way
     OP_LOOP,
     OP_CALL,
-    OP_INVOKE,
-    OP_SUPER_INVOKE,
-    OP_CLOSURE,
-    OP_CLOSE_UPVALUE,
+    OP_TAIL_CALL,    // operand: argument count; replaces the current frame
+    OP_INVOKE,       // operand: argument count; calls what OP_GET_METHOD left
+    OP_TAIL_INVOKE,  // operand: argument count; OP_INVOKE replacing the current frame
+    OP_CLOSURE,      // operand: index of the function declaration
+    OP_CLOSE_UPVALUE,  // operand: frame slot; closes upvalues at or above it
     OP_RETURN,
     OP_CLASS,
     OP_INHERIT,
-    OP_METHOD
+    OP_METHOD,
+    OP_BUILD_LIST,   // operand: element count
+    OP_BUILD_MAP,    // operand: entry count; keys and values alternate
+    OP_GET_INDEX,
+    OP_SET_INDEX,
+    // Quickened forms. The compiler emits the generic instructions above;
+    // the first time one of these runs, Interpreter::run rewrites it in
+    // place to the form that suits the operands it saw. A _NUM form
+    // assumes numbers and a _CACHED one a field where the last instance
+    // kept it; when that's wrong they rewrite themselves, for good, to
+    // their _GENERIC form, which never tries a fast path first.
+    OP_GREATER_NUM,
+    OP_LESS_NUM,
+    OP_GREATER_EQUAL_NUM,
+    OP_LESS_EQUAL_NUM,
+    OP_ADD_NUM,
+    OP_SUBTRACT_NUM,
+    OP_MULTIPLY_NUM,
+    OP_DIVIDE_NUM,
+    OP_GREATER_GENERIC,
+    OP_LESS_GENERIC,
+    OP_GREATER_EQUAL_GENERIC,
+    OP_LESS_EQUAL_GENERIC,
+    OP_ADD_GENERIC,
+    OP_SUBTRACT_GENERIC,
+    OP_MULTIPLY_GENERIC,
+    OP_DIVIDE_GENERIC,
+    // The field cache operand is the slot of the instance's field table
+    // the field was found in.
+    OP_GET_PROPERTY_CACHED,
+    OP_GET_PROPERTY_GENERIC
 };
\ No newline at end of file
@@ -0,0 +1,79 @@
+#!/bin/sh
+# Regression tests that check output, run by `make test` after the
+# examples. Usage: tests/run.sh LOX
+lox=$1
+status=0
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# check EXPECTED COMMAND...: runs the command and compares its output,
+# stdout and stderr together, and exit status with the file EXPECTED.
+check() {
+    expected=$1
+    shift
+    { "$@"; echo "exit $?"; } > "$tmp/out" 2>&1
+    if ! diff -u "$expected" "$tmp/out"; then
+        echo "FAIL: $*"
+        status=1
+    fi
+}
+
+# agree SCRIPT OPTIONS...: runs the script with the options and checks it
+# behaves exactly as it does in the tree-walker alone.
+agree() {
+    script=$1
+    shift
+    { "$lox" "$script"; echo "exit $?"; } > "$tmp/expected" 2>&1
+    check "$tmp/expected" "$lox" "$@" "$script"
+}
+
+# A bad option value is a usage error, not a crash.
+for option in --tier-up --gc-pause --max-heap --output-buffer; do
+    printf 'Invalid value for %s: 1x\nexit 64\n' "$option" > "$tmp/expected"
+    check "$tmp/expected" "$lox" "$option" 1x examples/fibonacci.lox
+done
+
+# The REPL keeps its isolate across lines: an error must leave nothing of
+# the failed calls behind.
+for script in tests/repl/*.lox; do
+    check "${script%.lox}.expected" "$lox" < "$script"
+done
+
+# Lists and maps, and the errors they raise.
+for script in tests/collections/*.lox; do
+    check "${script%.lox}.expected" "$lox" "$script"
+    check "${script%.lox}.expected" "$lox" --closures --tier-up 2 "$script"
+done
+
+# A script started from a snapshot of the prelude sees the globals running
+# the prelude would have left.
+if ! "$lox" --snapshot tests/snapshot/prelude.lox -o "$tmp/prelude.snap"; then
+    echo "FAIL: $lox --snapshot tests/snapshot/prelude.lox"
+    status=1
+fi
+check tests/snapshot/main.expected "$lox" --from-snapshot "$tmp/prelude.snap" tests/snapshot/main.lox
+
+# Code the closure engine compiles with numbers unboxed, including the
+# generic code it falls back to when a guess about them is wrong.
+for script in tests/closures/*.lox; do
+    check "${script%.lox}.expected" "$lox" --closures "$script"
+    check "${script%.lox}.expected" "$lox" --closures --tier-up 2 "$script"
+done
+
+# Compiled code that quickens: a threshold of 1 compiles every function
+# before its first call, so each instruction's first run is the call's.
+for script in tests/tiered/*.lox; do
+    check "${script%.lox}.expected" "$lox" "$script"
+    check "${script%.lox}.expected" "$lox" --tier-up 1 "$script"
+done
+
+# A tier-up threshold of 2 moves every function called more than once to
+# bytecode, and functions called once stay in the tree-walker, or in their
+# closures with --closures.
+for script in examples/*.lox demo.lox test_*.lox; do
+    agree "$script" --tier-up 2
+    agree "$script" --closures
+    agree "$script" --closures --tier-up 2
+done
+
+exit $status
@@ -5,6 +5,11 @@ import json
 import subprocess
 import tempfile
 import os
+import urllib.request
+
+# Set LOX_SERVE=127.0.0.1:8081 to forward /run to a running `lox serve`
+# daemon instead of starting a new lox process for every request.
+LOX_SERVE = os.environ.get('LOX_SERVE')
 
 class LoxHandler(http.server.SimpleHTTPRequestHandler):
     def do_POST(self):
@@ -13,6 +18,10 @@ class LoxHandler(http.server.SimpleHTTPRequestHandler):
             post_data = self.rfile.read(content_length)
             data = json.loads(post_data.decode('utf-8'))
             
+            if LOX_SERVE:
+                self.forward(post_data)
+                return
+            
             try:
                 with tempfile.NamedTemporaryFile(mode='w', suffix='.lox', delete=False) as f:
                     f.write(data['code'])
@@ -40,6 +49,20 @@ class LoxHandler(http.server.SimpleHTTPRequestHandler):
                 response = {'success': False, 'error': str(e)}
                 self.wfile.write(json.dumps(response).encode())
 
+    def forward(self, post_data):
+        try:
+            request = urllib.request.Request('http://' + LOX_SERVE + '/run', data=post_data,
+                                             headers={'Content-Type': 'application/json'})
+            with urllib.request.urlopen(request) as upstream:
+                body = upstream.read()
+            self.send_response(200)
+        except Exception as e:
+            body = json.dumps({'success': False, 'error': str(e)}).encode()
+            self.send_response(500)
+        self.send_header('Content-type', 'application/json')
+        self.end_headers()
+        self.wfile.write(body)
+
 PORT = 8080
 os.chdir('/Users/rudxkush/lox-interpreter/web')
 with socketserver.TCPServer(("", PORT), LoxHandler) as httpd: